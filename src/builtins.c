@@ -367,19 +367,20 @@ KRK_METHOD(filter,__call__,{
 #define IS_enumerate(o) (krk_isInstanceOf(o,enumerate))
 #define AS_enumerate(o) (AS_INSTANCE(o))
 static KrkClass * enumerate;
+static const char * const enumerateArgs[] = {"iterable", "start"};
 KRK_METHOD(enumerate,__init__,{
-	METHOD_TAKES_EXACTLY(1);
+	KrkValue iterable;
 	KrkValue start = INTEGER_VAL(0);
-	if (hasKw) krk_tableGet(AS_DICT(argv[argc]), OBJECT_VAL(S("start")), &start);
+	if (!krk_parseMethodArgs("O|O", enumerateArgs, &iterable, &start)) return NONE_VAL();
 
 	krk_attachNamedValue(&self->fields, "_counter", start);
 
 	/* Attach iterator */
-	KrkClass * type = krk_getType(argv[1]);
+	KrkClass * type = krk_getType(iterable);
 	if (!type->_iter) {
-		return krk_runtimeError(vm.exceptions->typeError, "'%s' object is not iterable", krk_typeName(argv[1]));
+		return krk_runtimeError(vm.exceptions->typeError, "'%s' object is not iterable", krk_typeName(iterable));
 	}
-	krk_push(argv[1]);
+	krk_push(iterable);
 	KrkValue asIter = krk_callDirect(type->_iter, 1);
 	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return NONE_VAL();
 	krk_attachNamedValue(&self->fields, "_iterator", asIter);
@@ -436,13 +437,12 @@ KRK_METHOD(enumerate,__call__,{
 		base = krk_operator_add(base, indexer); \
 	} \
 } while (0)
+static const char * const sumArgs[] = {"iterable", "start"};
 KRK_FUNC(sum,{
-	FUNCTION_TAKES_AT_LEAST(1);
+	KrkValue iterable;
 	KrkValue base = INTEGER_VAL(0);
-	if (hasKw) {
-		krk_tableGet(AS_DICT(argv[argc]), OBJECT_VAL(S("start")), &base);
-	}
-	unpackIterableFast(argv[0]);
+	if (!krk_parseArgs("O|O", sumArgs, &iterable, &base)) return NONE_VAL();
+	unpackIterableFast(iterable);
 	return base;
 })
 #undef unpackArray
@@ -41,6 +41,8 @@
 #include <kuroko/debug.h>
 #include <kuroko/vm.h>
 
+#include "private.h"
+
 /**
  * @brief Token parser state.
  *
@@ -252,6 +254,22 @@ static Parser parser;
 static Compiler * current = NULL;
 static ClassCompiler * currentClass = NULL;
 
+/**
+ * @brief The tuple most recently built from a comma-separated expression list.
+ *
+ * Lets @ref complexAssignment recognize a value list that matches its
+ * targets, so the values can be assigned without packing them into a tuple.
+ */
+static struct {
+	const char * position; /**< Scanner position the list started at */
+	ChunkRecorder before;  /**< Chunk state before the OP_TUPLE */
+	size_t end;            /**< Chunk offset after the OP_TUPLE */
+	size_t count;          /**< Number of elements in the list */
+} lastValueList;
+
+/** Scanner position at the start of the expression statement being compiled. */
+static const char * statementPosition = NULL;
+
 #define currentChunk() (&current->codeobject->chunk)
 
 #define EMIT_OPERAND_OP(opc, arg) do { if (arg < 256) { emitBytes(opc, arg); } \
@@ -365,8 +383,9 @@ static void declareVariable(void);
 static void string(int exprType);
 static KrkToken decorator(size_t level, FunctionType type);
 static void complexAssignment(ChunkRecorder before, KrkScanner oldScanner, Parser oldParser, size_t targetCount, int parenthesized);
-static void complexAssignmentTargets(KrkScanner oldScanner, Parser oldParser, size_t targetCount, int parenthesized);
+static void complexAssignmentTargets(KrkScanner oldScanner, Parser oldParser, size_t targetCount, int parenthesized, int valuesOnStack);
 static int invalidTarget(int exprType, const char * description);
+static void namedVariable(KrkToken name, int exprType);
 
 /* These are not the real parse functions. */
 static void commaX(int exprType) { }
@@ -545,6 +564,11 @@ static KrkCodeObject * endCompiler(void) {
 		args++;
 	}
 
+	if (!parser.hadError) {
+		if (!(vm.globalFlags & KRK_GLOBAL_DISABLE_OPTIMIZER)) _optimizeCodeObject(function);
+		_fuseInstructions(function);
+	}
+
 #ifndef KRK_NO_DISASSEMBLY
 	if ((krk_currentThread.flags & KRK_THREAD_ENABLE_DISASSEMBLY) && !parser.hadError) {
 		krk_disassembleCodeObject(stderr, function, function->name ? function->name->chars : "(module)");
@@ -1137,6 +1161,7 @@ static void declaration(void) {
 }
 
 static void expressionStatement(void) {
+	statementPosition = krk_tellScanner().cur;
 	parsePrecedence(PREC_ASSIGNMENT);
 	emitByte(OP_POP);
 }
@@ -1886,6 +1911,52 @@ static void whileStatement(void) {
 	patchBreaks(loopStart);
 }
 
+/**
+ * Look ahead to see if the iterable of a for loop is a plain call to `range`
+ * with one or two positional arguments, directly followed by the colon.
+ * Such loops are compiled as counted loops by forStatement().
+ */
+static int isRangeCall(void) {
+	if (!check(TOKEN_IDENTIFIER) || parser.current.length != 5 || memcmp(parser.current.start, "range", 5)) return 0;
+
+	KrkScanner scannerBefore = krk_tellScanner();
+	Parser parserBefore = parser;
+	int result = 0;
+
+	advance();
+	if (match(TOKEN_LEFT_PAREN)) {
+		startEatingWhitespace();
+		int depth = 0, commas = 0, argStart = 1;
+		while (!check(TOKEN_EOF) && !parser.hadError) {
+			KrkTokenType type = parser.current.type;
+			if (depth == 0) {
+				if (type == TOKEN_RIGHT_PAREN) {
+					advance();
+					result = !argStart && commas < 2 && check(TOKEN_COLON);
+					break;
+				}
+				if (type == TOKEN_COMMA) {
+					commas++;
+					argStart = 1;
+					advance();
+					continue;
+				}
+				/* Star arguments, keyword arguments, generator expressions and lambdas */
+				if ((argStart && (type == TOKEN_ASTERISK || type == TOKEN_POW)) ||
+				    type == TOKEN_EQUAL || type == TOKEN_FOR || type == TOKEN_LAMBDA) break;
+			}
+			if (type == TOKEN_LEFT_PAREN || type == TOKEN_LEFT_SQUARE || type == TOKEN_LEFT_BRACE) depth++;
+			if (type == TOKEN_RIGHT_PAREN || type == TOKEN_RIGHT_SQUARE || type == TOKEN_RIGHT_BRACE) depth--;
+			argStart = 0;
+			advance();
+		}
+	}
+
+	krk_rewindScanner(scannerBefore);
+	parser = parserBefore;
+	return result;
+}
+
 static void forStatement(void) {
 	/* I'm not sure if I want this to be more like Python or C/Lox/etc. */
 	size_t blockWidth = (parser.previous.type == TOKEN_INDENTATION) ? parser.previous.length : 0;
@@ -1918,14 +1989,47 @@ static void forStatement(void) {
 
 	if (!matchedEquals && match(TOKEN_IN)) {
 
-		beginScope();
-		expression();
-		endScope();
+		if (isRangeCall()) {
+			/*
+			 * The range call is compiled as usual, but preceded by a placeholder
+			 * for the loop bound and guarded by OP_FOR_RANGE_INIT, which turns the
+			 * two slots into the bound and a counter if `range` has not been rebound.
+			 * Otherwise the placeholder stays and OP_FOR_RANGE iterates normally.
+			 */
+			emitByte(OP_NONE);
+			anonymousLocal();
 
-		anonymousLocal();
-		emitByte(OP_INVOKE_ITER);
-		loopStart = currentChunk()->count;
-		exitJump = emitJump(OP_CALL_ITER);
+			beginScope();
+			advance();
+			namedVariable(parser.previous, EXPR_NORMAL);
+			consume(TOKEN_LEFT_PAREN, "Expected '(' after 'range'.");
+			startEatingWhitespace();
+			int argCount = 1;
+			expression();
+			if (match(TOKEN_COMMA)) {
+				expression();
+				argCount = 2;
+			}
+			stopEatingWhitespace();
+			consume(TOKEN_RIGHT_PAREN, "Expected ')' after range arguments.");
+			endScope();
+
+			emitByte(OP_FOR_RANGE_INIT);
+			emitBytes(OP_CALL, argCount);
+			anonymousLocal();
+			emitByte(OP_INVOKE_ITER);
+			loopStart = currentChunk()->count;
+			exitJump = emitJump(OP_FOR_RANGE);
+		} else {
+			beginScope();
+			expression();
+			endScope();
+
+			anonymousLocal();
+			emitByte(OP_INVOKE_ITER);
+			loopStart = currentChunk()->count;
+			exitJump = emitJump(OP_CALL_ITER);
+		}
 
 		if (varCount > 1 || sawComma) {
 			EMIT_OPERAND_OP(OP_UNPACK, varCount);
@@ -2888,7 +2992,7 @@ static void parens(int exprType) {
 			error("Can not assign to generator expression.");
 		} else {
 			rewindChunk(currentChunk(), before);
-			complexAssignmentTargets(scannerBefore, parserBefore, argCount, 2);
+			complexAssignmentTargets(scannerBefore, parserBefore, argCount, 2, 0);
 			if (!matchComplexEnd()) {
 				errorAtCurrent("Unexpected end of nested target list");
 			}
@@ -3059,12 +3163,21 @@ static void ternary(ChunkRecorder before, KrkScanner oldScanner, Parser oldParse
 	parser = outParser;
 }
 
-static void complexAssignmentTargets(KrkScanner oldScanner, Parser oldParser, size_t targetCount, int parenthesized) {
-	emitBytes(OP_DUP, 0);
+static void complexAssignmentTargets(KrkScanner oldScanner, Parser oldParser, size_t targetCount, int parenthesized, int valuesOnStack) {
+	if (valuesOnStack) {
+		/* The values are on the stack in order; the first target takes the first value. */
+		if (targetCount == 2) {
+			emitByte(OP_SWAP);
+		} else {
+			EMIT_OPERAND_OP(OP_REVERSE,targetCount);
+		}
+	} else {
+		emitBytes(OP_DUP, 0);
 
-	if (targetCount > 0) {
-		EMIT_OPERAND_OP(OP_UNPACK,targetCount);
-		EMIT_OPERAND_OP(OP_REVERSE,targetCount);
+		if (targetCount > 0) {
+			EMIT_OPERAND_OP(OP_UNPACK,targetCount);
+			EMIT_OPERAND_OP(OP_REVERSE,targetCount);
+		}
 	}
 
 	/* Rewind */
@@ -3111,13 +3224,29 @@ _errorAtCurrent:
 static void complexAssignment(ChunkRecorder before, KrkScanner oldScanner, Parser oldParser, size_t targetCount, int parenthesized) {
 
 	rewindChunk(currentChunk(), before);
+	const char * valuesPosition = krk_tellScanner().cur;
 	parsePrecedence(PREC_ASSIGNMENT);
 
 	/* Store end state */
 	KrkScanner outScanner = krk_tellScanner();
 	Parser outParser = parser;
 
-	complexAssignmentTargets(oldScanner,oldParser,targetCount,parenthesized);
+	/*
+	 * A statement like `a, b = b, a` discards the value of the assignment,
+	 * so if the right hand side is a list of exactly as many values as
+	 * there are targets, drop the tuple and assign the values directly.
+	 * None stands in for the tuple as the statement's value.
+	 */
+	if (!parenthesized && oldScanner.cur == statementPosition &&
+	    lastValueList.position == valuesPosition &&
+	    lastValueList.end == currentChunk()->count &&
+	    lastValueList.count == targetCount) {
+		rewindChunk(currentChunk(), lastValueList.before);
+		complexAssignmentTargets(oldScanner,oldParser,targetCount,parenthesized,1);
+		emitByte(OP_NONE);
+	} else {
+		complexAssignmentTargets(oldScanner,oldParser,targetCount,parenthesized,0);
+	}
 
 	/* Restore end state */
 	krk_rewindScanner(outScanner);
@@ -3132,7 +3261,12 @@ static void comma(int exprType, ChunkRecorder before, KrkScanner oldScanner, Par
 		parsePrecedence(PREC_TERNARY);
 	} while (match(TOKEN_COMMA));
 
+	ChunkRecorder beforeTuple = recordChunk(currentChunk());
 	EMIT_OPERAND_OP(OP_TUPLE,expressionCount);
+	lastValueList.position = oldScanner.cur;
+	lastValueList.before = beforeTuple;
+	lastValueList.end = currentChunk()->count;
+	lastValueList.count = expressionCount;
 
 	if (exprType == EXPR_CAN_ASSIGN && match(TOKEN_EQUAL)) {
 		complexAssignment(before, oldScanner, oldParser, expressionCount, 0);
@@ -1,10 +1,14 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <kuroko/debug.h>
 #include <kuroko/vm.h>
 #include <kuroko/util.h>
 #include <kuroko/compiler.h>
+#include <kuroko/memory.h>
+
+#include "private.h"
 
 #ifndef KRK_DISABLE_DEBUG
 
@@ -369,34 +373,26 @@ KRK_FUNC(delbreakpoint,{
 		return krk_runtimeError(vm.exceptions->indexError, "invalid breakpoint id");
 })
 
+static const char * const addbreakpointArgs[] = {"func", "lineno", "flags"};
 KRK_FUNC(addbreakpoint,{
-	FUNCTION_TAKES_EXACTLY(2);
-	CHECK_ARG(1,int,krk_integer_type,lineNo);
-
-	int flags = KRK_BREAKPOINT_NORMAL;
-
-	if (hasKw) {
-		KrkValue flagsValue = NONE_VAL();
-		if (krk_tableGet(AS_DICT(argv[argc]), OBJECT_VAL(S("flags")), &flagsValue)) {
-			if (!IS_INTEGER(flagsValue))
-				return TYPE_ERROR(int,flagsValue);
-			flags = AS_INTEGER(flagsValue);
-		}
-	}
+	KrkValue func;
+	krk_integer_type lineNo;
+	krk_integer_type flags = KRK_BREAKPOINT_NORMAL;
+	if (!krk_parseArgs("Oi|$i", addbreakpointArgs, &func, &lineNo, &flags)) return NONE_VAL();
 
 	int result;
-	if (IS_STRING(argv[0])) {
-		result = krk_debug_addBreakpointFileLine(AS_STRING(argv[0]), lineNo, flags);
+	if (IS_STRING(func)) {
+		result = krk_debug_addBreakpointFileLine(AS_STRING(func), lineNo, flags);
 	} else {
 		KrkCodeObject * target = NULL;
-		if (IS_CLOSURE(argv[0])) {
-			target = AS_CLOSURE(argv[0])->function;
-		} else if (IS_BOUND_METHOD(argv[0]) && IS_CLOSURE(OBJECT_VAL(AS_BOUND_METHOD(argv[0])->method))) {
-			target = AS_CLOSURE(OBJECT_VAL(AS_BOUND_METHOD(argv[0])->method))->function;
-		} else if (IS_codeobject(argv[0])) {
-			target = AS_codeobject(argv[0]);
+		if (IS_CLOSURE(func)) {
+			target = AS_CLOSURE(func)->function;
+		} else if (IS_BOUND_METHOD(func) && IS_CLOSURE(OBJECT_VAL(AS_BOUND_METHOD(func)->method))) {
+			target = AS_CLOSURE(OBJECT_VAL(AS_BOUND_METHOD(func)->method))->function;
+		} else if (IS_codeobject(func)) {
+			target = AS_codeobject(func);
 		} else {
-			return TYPE_ERROR(function or method or filename,argv[0]);
+			return TYPE_ERROR(function or method or filename,func);
 		}
 		/* Figure out what instruction this should be on */
 		size_t last = 0;
@@ -553,6 +549,212 @@ int krk_debugBreakpointHandler(void) {
 	return krk_debuggerHook(frame);
 }
 
+/* Instruction counting */
+
+#define SIMPLE(opc) [opc] = #opc,
+#define CONSTANT(opc,more) [opc] = #opc, [opc ## _LONG] = #opc "_LONG",
+#define OPERANDB(opc,more) [opc] = #opc,
+#define OPERAND(opc,more) [opc] = #opc, [opc ## _LONG] = #opc "_LONG",
+#define JUMP(opc,sign) [opc] = #opc,
+#define CLOSURE_MORE
+#define EXPAND_ARGS_MORE
+#define LOCAL_MORE
+static const char * opcodeNames[256] = {
+#include "opcodes.h"
+};
+#undef SIMPLE
+#undef OPERANDB
+#undef OPERAND
+#undef CONSTANT
+#undef JUMP
+#undef CLOSURE_MORE
+#undef LOCAL_MORE
+#undef EXPAND_ARGS_MORE
+
+static const char * opcodeName(size_t opcode) {
+	return opcodeNames[opcode] ? opcodeClean(opcodeNames[opcode]) : "?";
+}
+
+/*
+ * Opcode and pair counts are shared by every thread that counts; per-instruction
+ * counts live on the code objects. Pairs are only counted between consecutive
+ * instructions of the same frame, so calls and returns do not produce pairs
+ * that could never be fused into one instruction.
+ */
+static uint64_t opcodeCounts[256];
+static uint64_t (*pairCounts)[256] = NULL;
+static KrkCallFrame * previousFrame = NULL;
+static uint8_t previousOpcode = 0;
+
+void _debugCountInstruction(KrkCallFrame * frame) {
+	KrkCodeObject * code = frame->closure->function;
+	size_t offset = frame->ip - code->chunk.code;
+	uint8_t opcode = *frame->ip;
+
+	if (unlikely(!code->instructionCounts)) {
+		uint64_t * counts = ALLOCATE(uint64_t, code->chunk.count);
+		memset(counts, 0, sizeof(uint64_t) * code->chunk.count);
+		code->instructionCounts = counts;
+	}
+
+	code->instructionCounts[offset]++;
+	opcodeCounts[opcode]++;
+	if (previousFrame == frame && pairCounts) pairCounts[previousOpcode][opcode]++;
+	previousFrame = frame;
+	previousOpcode = opcode;
+}
+
+int krk_debug_countInstructions(int enable) {
+#ifdef KRK_NO_TRACING
+	return -1;
+#else
+	int wasEnabled = !!(krk_currentThread.flags & KRK_THREAD_COUNT_INSTRUCTIONS);
+	if (enable) {
+		if (!pairCounts) pairCounts = calloc(256, sizeof(*pairCounts));
+		previousFrame = NULL;
+		krk_currentThread.flags |= KRK_THREAD_COUNT_INSTRUCTIONS;
+	} else {
+		krk_currentThread.flags &= ~KRK_THREAD_COUNT_INSTRUCTIONS;
+	}
+	return wasEnabled;
+#endif
+}
+
+void krk_debug_resetInstructionCounts(void) {
+	memset(opcodeCounts, 0, sizeof(opcodeCounts));
+	if (pairCounts) memset(pairCounts, 0, 256 * sizeof(*pairCounts));
+	previousFrame = NULL;
+	for (KrkObj * object = vm.objects; object; object = object->next) {
+		if (object->type != KRK_OBJ_CODEOBJECT) continue;
+		KrkCodeObject * code = (KrkCodeObject*)object;
+		if (code->instructionCounts) memset(code->instructionCounts, 0, sizeof(uint64_t) * code->chunk.count);
+	}
+}
+
+enum CountKind {
+	COUNT_OPCODES,
+	COUNT_PAIRS,
+	COUNT_FUNCTIONS,
+	COUNT_INSTRUCTIONS,
+};
+
+struct CountEntry {
+	KrkCodeObject * code;
+	size_t index;
+	uint64_t count;
+};
+
+static int compareCounts(const void * a, const void * b) {
+	const struct CountEntry * left = a, * right = b;
+	if (left->count != right->count) return left->count < right->count ? 1 : -1;
+	return left->index < right->index ? -1 : left->index > right->index;
+}
+
+/**
+ * Gather the nonzero counts of one kind, most frequent first. For opcodes,
+ * @c index is the opcode; for pairs it is the first opcode shifted left
+ * by eight and or'd with the second; for instructions it is the offset.
+ * Returns a malloc'd array.
+ */
+static struct CountEntry * collectCounts(enum CountKind kind, size_t * countOut) {
+	struct CountEntry * entries = NULL;
+	size_t count = 0, capacity = 0;
+
+#define ADD_ENTRY(c,i,n) do { \
+	if (count == capacity) { \
+		capacity = capacity ? capacity * 2 : 64; \
+		entries = realloc(entries, sizeof(struct CountEntry) * capacity); \
+	} \
+	entries[count++] = (struct CountEntry){(c),(i),(n)}; } while (0)
+
+	switch (kind) {
+		case COUNT_OPCODES:
+			for (size_t i = 0; i < 256; ++i) {
+				if (opcodeCounts[i]) ADD_ENTRY(NULL, i, opcodeCounts[i]);
+			}
+			break;
+		case COUNT_PAIRS:
+			if (!pairCounts) break;
+			for (size_t i = 0; i < 256; ++i) {
+				for (size_t j = 0; j < 256; ++j) {
+					if (pairCounts[i][j]) ADD_ENTRY(NULL, (i << 8) | j, pairCounts[i][j]);
+				}
+			}
+			break;
+		case COUNT_FUNCTIONS:
+		case COUNT_INSTRUCTIONS:
+			for (KrkObj * object = vm.objects; object; object = object->next) {
+				if (object->type != KRK_OBJ_CODEOBJECT) continue;
+				KrkCodeObject * code = (KrkCodeObject*)object;
+				if (!code->instructionCounts) continue;
+				uint64_t total = 0;
+				for (size_t i = 0; i < code->chunk.count; ++i) {
+					if (!code->instructionCounts[i]) continue;
+					if (kind == COUNT_INSTRUCTIONS) ADD_ENTRY(code, i, code->instructionCounts[i]);
+					total += code->instructionCounts[i];
+				}
+				if (kind == COUNT_FUNCTIONS && total) ADD_ENTRY(code, 0, total);
+			}
+			break;
+	}
+#undef ADD_ENTRY
+
+	if (count) qsort(entries, count, sizeof(struct CountEntry), compareCounts);
+	*countOut = count;
+	return entries;
+}
+
+static const char * codeName(KrkCodeObject * code) {
+	if (code->qualname) return code->qualname->chars;
+	if (code->name) return code->name->chars;
+	return "<unnamed>";
+}
+
+void krk_debug_writeInstructionCounts(FILE * f, size_t limit) {
+	uint64_t total = 0;
+	for (size_t i = 0; i < 256; ++i) total += opcodeCounts[i];
+	fprintf(f, "%llu instructions executed\n", (unsigned long long)total);
+	if (!total) return;
+
+	size_t count;
+	struct CountEntry * entries = collectCounts(COUNT_OPCODES, &count);
+	fprintf(f, "\nOpcodes:\n");
+	for (size_t i = 0; i < count && i < limit; ++i) {
+		fprintf(f, "%14llu %5.1f%%  %s\n", (unsigned long long)entries[i].count,
+			100.0 * entries[i].count / total, opcodeName(entries[i].index));
+	}
+	free(entries);
+
+	entries = collectCounts(COUNT_PAIRS, &count);
+	fprintf(f, "\nOpcode pairs:\n");
+	for (size_t i = 0; i < count && i < limit; ++i) {
+		fprintf(f, "%14llu %5.1f%%  %s %s\n", (unsigned long long)entries[i].count,
+			100.0 * entries[i].count / total, opcodeName(entries[i].index >> 8), opcodeName(entries[i].index & 0xFF));
+	}
+	free(entries);
+
+	entries = collectCounts(COUNT_FUNCTIONS, &count);
+	fprintf(f, "\nFunctions:\n");
+	for (size_t i = 0; i < count && i < limit; ++i) {
+		KrkCodeObject * code = entries[i].code;
+		fprintf(f, "%14llu %5.1f%%  %s (%s:%d)\n", (unsigned long long)entries[i].count,
+			100.0 * entries[i].count / total, codeName(code), code->chunk.filename->chars,
+			(int)krk_lineNumber(&code->chunk, 0));
+	}
+	free(entries);
+
+	entries = collectCounts(COUNT_INSTRUCTIONS, &count);
+	fprintf(f, "\nInstructions:\n");
+	for (size_t i = 0; i < count && i < limit; ++i) {
+		KrkCodeObject * code = entries[i].code;
+		fprintf(f, "%14llu %5.1f%%  %s+%zu %s (%s:%d)\n", (unsigned long long)entries[i].count,
+			100.0 * entries[i].count / total, codeName(code), entries[i].index,
+			opcodeName(code->chunk.code[entries[i].index]), code->chunk.filename->chars,
+			(int)krk_lineNumber(&code->chunk, entries[i].index));
+	}
+	free(entries);
+}
+
 /**
  * dis.dis(object)
  */
@@ -616,6 +818,7 @@ KRK_FUNC(build,{
 #define CONSTANT(opc,more) case opc: { constant = chunk->code[offset + 1]; size = 2; more; break; } \
 	case opc ## _LONG: { constant = (chunk->code[offset + 1] << 16) | \
 	(chunk->code[offset + 2] << 8) | (chunk->code[offset + 3]); size = 4; more; break; }
+#define OPERANDB(opc,more) case opc: { operand = chunk->code[offset + 1]; size = 2; more; break; }
 #define OPERAND(opc,more) case opc: { operand = chunk->code[offset + 1]; size = 2; more; break; } \
 	case opc ## _LONG: { operand = (chunk->code[offset + 1] << 16) | \
 	(chunk->code[offset + 2] << 8) | (chunk->code[offset + 3]); size = 4; more; break; }
@@ -695,6 +898,95 @@ KRK_FUNC(examine,{
 #undef LOCAL_MORE
 #undef EXPAND_ARGS_MORE
 
+static const char * const count_instructionsArgs[] = {"enable"};
+KRK_FUNC(count_instructions,{
+	int enable = 1;
+	if (!krk_parseArgs("|p", count_instructionsArgs, &enable)) return NONE_VAL();
+	int wasEnabled = krk_debug_countInstructions(enable);
+	if (wasEnabled < 0) return krk_runtimeError(vm.exceptions->notImplementedError, "instruction counting is not available in this build");
+	return BOOLEAN_VAL(wasEnabled);
+})
+
+KRK_FUNC(reset_counts,{
+	FUNCTION_TAKES_NONE();
+	krk_debug_resetInstructionCounts();
+	return NONE_VAL();
+})
+
+KRK_FUNC(opcode_counts,{
+	FUNCTION_TAKES_NONE();
+	size_t count;
+	struct CountEntry * entries = collectCounts(COUNT_OPCODES, &count);
+	KrkValue result = krk_dict_of(0, NULL, 0);
+	krk_push(result);
+	for (size_t i = 0; i < count; ++i) {
+		krk_attachNamedValue(AS_DICT(result), opcodeName(entries[i].index), FLOATING_VAL((double)entries[i].count));
+	}
+	free(entries);
+	return krk_pop();
+})
+
+KRK_FUNC(opcode_pair_counts,{
+	FUNCTION_TAKES_NONE();
+	size_t count;
+	struct CountEntry * entries = collectCounts(COUNT_PAIRS, &count);
+	KrkValue result = krk_dict_of(0, NULL, 0);
+	krk_push(result);
+	for (size_t i = 0; i < count; ++i) {
+		const char * first = opcodeName(entries[i].index >> 8);
+		const char * second = opcodeName(entries[i].index & 0xFF);
+		KrkTuple * pair = krk_newTuple(2);
+		krk_push(OBJECT_VAL(pair));
+		pair->values.values[pair->values.count++] = OBJECT_VAL(krk_copyString(first, strlen(first)));
+		pair->values.values[pair->values.count++] = OBJECT_VAL(krk_copyString(second, strlen(second)));
+		krk_tableSet(AS_DICT(result), krk_peek(0), FLOATING_VAL((double)entries[i].count));
+		krk_pop();
+	}
+	free(entries);
+	return krk_pop();
+})
+
+static const char * const hotArgs[] = {"limit"};
+
+KRK_FUNC(hot_functions,{
+	krk_integer_type limit = 20;
+	if (!krk_parseArgs("|i", hotArgs, &limit)) return NONE_VAL();
+	size_t count;
+	struct CountEntry * entries = collectCounts(COUNT_FUNCTIONS, &count);
+	KrkValue result = krk_list_of(0, NULL, 0);
+	krk_push(result);
+	for (size_t i = 0; i < count && (krk_integer_type)i < limit; ++i) {
+		KrkTuple * entry = krk_newTuple(2);
+		krk_push(OBJECT_VAL(entry));
+		entry->values.values[entry->values.count++] = OBJECT_VAL(entries[i].code);
+		entry->values.values[entry->values.count++] = FLOATING_VAL((double)entries[i].count);
+		krk_writeValueArray(AS_LIST(result), krk_peek(0));
+		krk_pop();
+	}
+	free(entries);
+	return krk_pop();
+})
+
+KRK_FUNC(hot_instructions,{
+	krk_integer_type limit = 20;
+	if (!krk_parseArgs("|i", hotArgs, &limit)) return NONE_VAL();
+	size_t count;
+	struct CountEntry * entries = collectCounts(COUNT_INSTRUCTIONS, &count);
+	KrkValue result = krk_list_of(0, NULL, 0);
+	krk_push(result);
+	for (size_t i = 0; i < count && (krk_integer_type)i < limit; ++i) {
+		KrkTuple * entry = krk_newTuple(3);
+		krk_push(OBJECT_VAL(entry));
+		entry->values.values[entry->values.count++] = OBJECT_VAL(entries[i].code);
+		entry->values.values[entry->values.count++] = INTEGER_VAL(entries[i].index);
+		entry->values.values[entry->values.count++] = FLOATING_VAL((double)entries[i].count);
+		krk_writeValueArray(AS_LIST(result), krk_peek(0));
+		krk_pop();
+	}
+	free(entries);
+	return krk_pop();
+})
+
 _noexport
 void _createAndBind_disMod(void) {
 	KrkInstance * module = krk_newInstance(vm.baseClasses->moduleClass);
@@ -759,12 +1051,43 @@ void _createAndBind_disMod(void) {
 		"Disable the breakpoint specified by @p handle. May raise @ref IndexError if "
 		"@p handle is not a valid breakpoint handle.");
 
+	KRK_DOC(BIND_FUNC(module, count_instructions),
+		"@brief Count the instructions executed by the current thread.\n"
+		"@arguments enable=True\n\n"
+		"While enabled, every instruction the VM executes is counted by opcode, by pair of "
+		"consecutive opcodes in the same call, and by code object and offset. Counts accumulate "
+		"until @ref reset_counts is called. Returns whether counting was already enabled.");
+
+	KRK_DOC(BIND_FUNC(module, reset_counts),
+		"@brief Discard all instruction counts.");
+
+	KRK_DOC(BIND_FUNC(module, opcode_counts),
+		"@brief Get the number of times each opcode was executed.\n\n"
+		"Returns a dict mapping opcode names to counts. Counts are floats, as they can outgrow an int.");
+
+	KRK_DOC(BIND_FUNC(module, opcode_pair_counts),
+		"@brief Get the number of times each opcode was followed by another.\n\n"
+		"Returns a dict mapping tuples of two opcode names to counts, as floats.");
+
+	KRK_DOC(BIND_FUNC(module, hot_functions),
+		"@brief Get the code objects that executed the most instructions.\n"
+		"@arguments limit=20\n\n"
+		"Returns a list of up to @p limit tuples of a code object and its instruction count, as a float.");
+
+	KRK_DOC(BIND_FUNC(module, hot_instructions),
+		"@brief Get the most frequently executed instructions.\n"
+		"@arguments limit=20\n\n"
+		"Returns a list of up to @p limit tuples of a code object, an instruction offset, "
+		"and its execution count as a float. Offsets match those of @ref examine.");
+
+
 	krk_attachNamedValue(&module->fields, "BREAKPOINT_ONCE", INTEGER_VAL(KRK_BREAKPOINT_ONCE));
 	krk_attachNamedValue(&module->fields, "BREAKPOINT_REPEAT", INTEGER_VAL(KRK_BREAKPOINT_REPEAT));
 
 #define OPCODE(opc) krk_attachNamedValue(&module->fields, #opc, INTEGER_VAL(opc));
 #define SIMPLE(opc) OPCODE(opc)
 #define CONSTANT(opc,more) OPCODE(opc) OPCODE(opc ## _LONG)
+#define OPERANDB(opc,more) OPCODE(opc)
 #define OPERAND(opc,more) OPCODE(opc) OPCODE(opc ## _LONG)
 #define JUMP(opc,sign) OPCODE(opc)
 #define CLOSURE_MORE
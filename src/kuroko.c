@@ -29,6 +29,8 @@
 #include <kuroko/scanner.h>
 #include <kuroko/compiler.h>
 #include <kuroko/util.h>
+#include <kuroko/profiler.h>
+#include <kuroko/trace.h>
 
 #define PROMPT_MAIN  ">>> "
 #define PROMPT_BLOCK "  > "
@@ -742,6 +744,34 @@ static int compileFile(char * argv[], int flags, char * fileName) {
 	return func == NULL;
 }
 
+static void writeProfile(const char * profileFile) {
+	if (!profileFile) return;
+	krk_profilerStop();
+	FILE * f = fopen(profileFile, "w");
+	if (!f) {
+		fprintf(stderr, "%s: %s\n", profileFile, strerror(errno));
+		return;
+	}
+	krk_profilerWriteFolded(f);
+	fclose(f);
+}
+
+static void writeInstructionCounts(const char * countsFile) {
+#ifndef KRK_DISABLE_DEBUG
+	if (!countsFile) return;
+	krk_debug_countInstructions(0);
+	FILE * f = fopen(countsFile, "w");
+	if (!f) {
+		fprintf(stderr, "%s: %s\n", countsFile, strerror(errno));
+		return;
+	}
+	krk_debug_writeInstructionCounts(f, 40);
+	fclose(f);
+#else
+	(void)countsFile;
+#endif
+}
+
 #ifdef BUNDLE_LIBS
 #define BUNDLED(name) do { \
 	extern KrkValue krk_module_onload_ ## name (); \
@@ -761,6 +791,10 @@ int main(int argc, char * argv[]) {
 	int flags = 0;
 	int moduleAsMain = 0;
 	int inspectAfter = 0;
+	char * profileFile = NULL;
+	int profileFrequency = 100;
+	char * countsFile = NULL;
+	char * traceFile = NULL;
 	int opt;
 	while ((opt = getopt(argc, argv, "+:c:C:dgGim:rstTMSV-:")) != -1) {
 		switch (opt) {
@@ -823,6 +857,29 @@ int main(int argc, char * argv[]) {
 			case '-':
 				if (!strcmp(optarg,"version")) {
 					return runString(argv,0,"import kuroko; print('Kuroko',kuroko.version)\n");
+				} else if (!strncmp(optarg,"profile=",8)) {
+					/* Sample the main thread and write folded stacks on exit. */
+					profileFile = optarg + 8;
+					break;
+				} else if (!strncmp(optarg,"opcode-stats=",13)) {
+					/* Count executed instructions and write a report on exit. */
+					countsFile = optarg + 13;
+					break;
+				} else if (!strncmp(optarg,"trace-events=",13)) {
+					/* Record calls on every thread as trace events. */
+					traceFile = optarg + 13;
+					break;
+				} else if (!strncmp(optarg,"profile-frequency=",18)) {
+					profileFrequency = atoi(optarg + 18);
+					if (profileFrequency <= 0) {
+						fprintf(stderr, "%s: invalid profile frequency '%s'\n", argv[0], optarg + 18);
+						return 1;
+					}
+					break;
+				} else if (!strcmp(optarg,"no-optimize")) {
+					/* Emit bytecode exactly as the compiler produced it. */
+					flags |= KRK_GLOBAL_DISABLE_OPTIMIZER;
+					break;
 				} else if (!strcmp(optarg,"help")) {
 #ifndef KRK_NO_DOCUMENTATION
 					fprintf(stderr,"usage: %s [flags] [FILE...]\n"
@@ -843,6 +900,11 @@ int main(int argc, char * argv[]) {
 						" -V          Print version information.\n"
 						"\n"
 						" --version   Print version information.\n"
+						" --no-optimize Don't optimize bytecode after compilation.\n"
+						" --profile=FILE Write sampled call stacks to FILE, for flamegraphs.\n"
+						" --profile-frequency=HZ Samples per second for --profile (default 100).\n"
+						" --opcode-stats=FILE Write counts of executed opcodes and instructions to FILE.\n"
+						" --trace-events=FILE Write calls as Chrome trace events to FILE, for Perfetto.\n"
 						" --help      Show this help text.\n"
 						"\n"
 						"If no files are provided, the interactive REPL will run.\n",
@@ -866,15 +928,16 @@ _finishArgs:
 #endif
 
 	/* Attach kuroko.argv - argv[0] will be set to an empty string for the repl */
-	if (argc == optind) krk_push(OBJECT_VAL(krk_copyString("",0)));
-	for (int arg = optind; arg < argc; ++arg) {
-		krk_push(OBJECT_VAL(krk_copyString(argv[arg],strlen(argv[arg]))));
-	}
-	KrkValue argList = krk_list_of(argc - optind + (optind == argc), &krk_currentThread.stackTop[-(argc - optind + (optind == argc))],0);
+	KrkValue argList = krk_list_of(0,NULL,0);
 	krk_push(argList);
+	/* Append each argument as it is made; pushing can move the stack, so pointers into it do not last. */
+	for (int arg = optind; arg < argc + (optind == argc); ++arg) {
+		krk_push(OBJECT_VAL(arg < argc ? krk_copyString(argv[arg],strlen(argv[arg])) : S("")));
+		krk_writeValueArray(AS_LIST(argList), krk_peek(0));
+		krk_pop();
+	}
 	krk_attachNamedValue(&vm.system->fields, "argv", argList);
 	krk_pop();
-	for (int arg = optind; arg < argc + (optind == argc); ++arg) krk_pop();
 
 	/* Bind interrupt signal */
 	bindSignalHandlers();
@@ -906,6 +969,22 @@ _finishArgs:
 		"If provided, @p syntax specifies the name of an @c rline syntax module to "
 		"provide color highlighting of the input line.");
 
+	if (profileFile && !krk_profilerStart(profileFrequency)) {
+		fprintf(stderr, "%s: profiling is not supported on this platform\n", argv[0]);
+		profileFile = NULL;
+	}
+
+	if (traceFile && !krk_traceStart(traceFile)) {
+		fprintf(stderr, "%s: %s\n", traceFile, strerror(errno));
+	}
+
+#ifndef KRK_DISABLE_DEBUG
+	if (countsFile && krk_debug_countInstructions(1) < 0) {
+		fprintf(stderr, "%s: instruction counting is not available in this build\n", argv[0]);
+		countsFile = NULL;
+	}
+#endif
+
 	if (moduleAsMain) {
 		krk_push(OBJECT_VAL(krk_copyString("__main__",8)));
 		int out = !krk_importModule(
@@ -915,7 +994,12 @@ _finishArgs:
 			krk_dumpTraceback();
 			krk_resetStack();
 		}
-		if (!inspectAfter) return out;
+		if (!inspectAfter) {
+			writeProfile(profileFile);
+			writeInstructionCounts(countsFile);
+			krk_traceStop();
+			return out;
+		}
 		if (IS_INSTANCE(krk_peek(0))) {
 			krk_currentThread.module = AS_INSTANCE(krk_peek(0));
 		}
@@ -1147,6 +1231,10 @@ _finishArgs:
 		}
 	}
 
+	writeProfile(profileFile);
+	writeInstructionCounts(countsFile);
+	krk_traceStop();
+
 	if (vm.globalFlags & KRK_GLOBAL_CALLGRIND) {
 		fclose(vm.callgrindFile);
 		vm.globalFlags &= ~(KRK_GLOBAL_CALLGRIND);
@@ -73,6 +73,31 @@ typedef enum {
 	OP_INVOKE_AWAIT,
 	OP_FLOORDIV,
 	OP_UNSET,
+	OP_FOR_RANGE_INIT,
+
+	/* Type-specialized forms of the operators above, written over them by the VM */
+	OP_ADD_INT,
+	OP_ADD_FLOAT,
+	OP_ADD_STR,
+	OP_SUBTRACT_INT,
+	OP_SUBTRACT_FLOAT,
+	OP_MULTIPLY_INT,
+	OP_MULTIPLY_FLOAT,
+	OP_LESS_INT,
+	OP_LESS_FLOAT,
+	OP_GREATER_INT,
+	OP_GREATER_FLOAT,
+	OP_LESS_EQUAL_INT,
+	OP_LESS_EQUAL_FLOAT,
+	OP_GREATER_EQUAL_INT,
+	OP_GREATER_EQUAL_FLOAT,
+
+	/* Comparisons fused with the OP_JUMP_IF_FALSE_OR_POP that follows them */
+	OP_EQUAL_JUMP_IF_FALSE,
+	OP_LESS_JUMP_IF_FALSE,
+	OP_GREATER_JUMP_IF_FALSE,
+	OP_LESS_EQUAL_JUMP_IF_FALSE,
+	OP_GREATER_EQUAL_JUMP_IF_FALSE,
 
 	/* One-opcode instructions */
 	OP_CALL,
@@ -107,6 +132,12 @@ typedef enum {
 	OP_MAKE_SET,
 	OP_REVERSE,
 
+	/* Superinstructions; these also run the (short) instruction that follows them */
+	OP_GET_LOCAL_GET_LOCAL,
+	OP_GET_LOCAL_CONSTANT,
+	OP_GET_LOCAL_GET_PROPERTY,
+	OP_SET_LOCAL_POP,
+
 	/* Two opcode instructions */
 	OP_JUMP_IF_FALSE_OR_POP,
 	OP_JUMP_IF_TRUE_OR_POP,
@@ -116,6 +147,7 @@ typedef enum {
 	OP_PUSH_WITH,
 	OP_YIELD_FROM,
 	OP_CALL_ITER,
+	OP_FOR_RANGE,
 
 	/* Three opcode instructions */
 	OP_CALL_LONG,
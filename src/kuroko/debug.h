@@ -209,6 +209,32 @@ extern int krk_debug_examineBreakpoint(int breakIndex, KrkCodeObject ** funcOut,
  */
 extern void krk_debug_dumpStack(FILE * f, KrkCallFrame * frame);
 
+/**
+ * @brief Enable or disable instruction counting for the current thread.
+ *
+ * While enabled, the VM counts each instruction it executes by opcode,
+ * by pair of consecutive opcodes within the same call, and by code
+ * object and offset. Counts accumulate until
+ * @ref krk_debug_resetInstructionCounts is called.
+ *
+ * @param enable 1 to start counting, 0 to stop.
+ * @return The previous state, or -1 if the VM was built with KRK_NO_TRACING.
+ */
+extern int krk_debug_countInstructions(int enable);
+
+/**
+ * @brief Discard all instruction counts.
+ */
+extern void krk_debug_resetInstructionCounts(void);
+
+/**
+ * @brief Write a report of instruction counts.
+ *
+ * Lists the most frequently executed opcodes, opcode pairs, functions,
+ * and individual instructions, up to @p limit entries each.
+ */
+extern void krk_debug_writeInstructionCounts(FILE * f, size_t limit);
+
 /**
  * @def KRK_BREAKPOINT_NORMAL
  *
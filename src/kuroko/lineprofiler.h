@@ -0,0 +1,63 @@
+#pragma once
+/**
+ * @file lineprofiler.h
+ * @brief Line profiler.
+ *
+ * While running, the thread that started the line profiler counts how many
+ * times each line of a set of selected functions begins executing, and how
+ * much time passes until the next line of the same call begins or the call
+ * returns. Time spent in functions called from a line is included in that
+ * line's time. Functions that were not selected are not timed, so most of
+ * their cost while profiling is one flag check per instruction.
+ *
+ * Results are reported as annotated source, one block per function.
+ *
+ * Also exported to user code as the @c lineprofiler module.
+ */
+#include <stdio.h>
+#include "vm.h"
+
+/**
+ * @brief Select a function for line profiling.
+ *
+ * @param code Code object of the function.
+ * @return 1 if the function was added, 0 if it was already selected.
+ */
+extern int krk_lineProfilerAdd(KrkCodeObject * code);
+
+/**
+ * @brief Start profiling the selected functions on the current thread.
+ *
+ * @return 1 if the profiler was started, 0 if it is already running.
+ */
+extern int krk_lineProfilerStart(void);
+
+/**
+ * @brief Stop profiling. Collected counts and times are kept.
+ */
+extern void krk_lineProfilerStop(void);
+
+/**
+ * @brief Discard the counts and times collected for the selected functions.
+ */
+extern void krk_lineProfilerReset(void);
+
+/**
+ * @brief Stop profiling and forget all selected functions.
+ */
+extern void krk_lineProfilerClear(void);
+
+/**
+ * @brief Get the collected counts and times.
+ *
+ * @return A dict mapping @c file:line strings to tuples of the number of
+ *         times the line began executing and the seconds spent on it.
+ */
+extern KrkValue krk_lineProfilerStats(void);
+
+/**
+ * @brief Write the selected functions' source annotated with counts and times.
+ *
+ * @param f Stream to write to.
+ */
+extern void krk_lineProfilerWriteReport(FILE * f);
@@ -69,6 +69,15 @@ typedef enum {
 	KRK_STRING_INVALID = 5, /**< This is an invalid string. */
 } KrkStringType;
 
+/**
+ * @brief Distance, in codepoints, between entries in a string's offset index.
+ *
+ * Non-ASCII strings are indexed by walking forward from the nearest
+ * checkpoint, so this bounds the number of UTF-8 sequences decoded
+ * for each random access.
+ */
+#define KRK_STRING_STRIDE 32
+
 #undef KrkString
 /**
  * @brief Immutable sequence of Unicode codepoints.
@@ -80,7 +89,8 @@ typedef struct KrkString {
 	size_t length;       /**< @brief String length in bytes */
 	size_t codesLength;  /**< @brief String length in Unicode codepoints */
 	char * chars;        /**< @brief UTF8 canonical data */
-	void * codes;        /**< @brief Codepoint data */
+	void * codes;        /**< @brief Codepoint data, built on demand and released by the GC */
+	size_t * offsets;    /**< @brief Byte offset of every KRK_STRING_STRIDE'th codepoint, built on demand */
 } KrkString;
 
 /**
@@ -120,6 +130,19 @@ typedef struct {
 
 struct KrkInstance;
 
+/**
+ * @brief Resolved global name lookup, kept per name constant of a code object.
+ *
+ * @c entry is the table entry the name was found in, either in the code
+ * object's globals or in the builtins. It may be used as long as both
+ * tables still have the versions recorded here.
+ */
+typedef struct {
+	size_t globalsVersion;    /**< @brief Version of the globals table when @c entry was found */
+	size_t builtinsVersion;   /**< @brief Version of the builtins table when @c entry was found */
+	KrkTableEntry * entry;    /**< @brief The resolved entry */
+} KrkGlobalCache;
+
 /**
  * @brief Code object.
  * @extends KrkObj
@@ -142,6 +165,12 @@ typedef struct {
 	unsigned int flags;                    /**< @brief Function type flags */
 	struct KrkInstance * globalsContext;   /**< @brief The globals namespace the function should reference when called */
 	KrkString * qualname;                  /**< @brief The dotted name of the function */
+	uint8_t * quickenCounters;             /**< @brief Per-instruction execution counts for generic operators, allocated when first needed */
+	KrkGlobalCache * globalCaches;         /**< @brief Global lookups, indexed by name constant, allocated when first needed */
+	KrkTable argumentIndex;                /**< @brief Maps argument names to their slots for keyword binding, built when first needed */
+	uint64_t * instructionCounts;          /**< @brief Executions of each instruction while instruction counting is enabled, allocated when first needed */
+	uint64_t traceName;                    /**< @brief Recording session and index of the function's name while trace events are recorded */
+	uint64_t * lineProfile;                /**< @brief Hits and nanoseconds for each entry of the line map, allocated when selected for line profiling */
 } KrkCodeObject;
 
 #define KRK_CODEOBJECT_FLAGS_COLLECTS_ARGS 0x0001
@@ -170,6 +199,14 @@ typedef struct {
 
 typedef void (*KrkCleanupCallback)(struct KrkInstance *);
 
+/**
+ * @brief Advance a native iterator.
+ *
+ * Stores the next value of the iterator in @p value and returns 1,
+ * or returns 0 if the iterator is exhausted.
+ */
+typedef int (*KrkIterNextCallback)(struct KrkInstance * iterator, KrkValue * value);
+
 /**
  * @brief Type object.
  * @extends KrkObj
@@ -187,6 +224,8 @@ typedef struct KrkClass {
 	size_t allocSize;         /**< @brief Size to allocate when creating instances of this class */
 	KrkCleanupCallback _ongcscan;   /**< @brief C function to call when the garbage collector visits an instance of this class in the scan phase */
 	KrkCleanupCallback _ongcsweep;  /**< @brief C function to call when the garbage collector is discarding an instance of this class */
+	KrkIterNextCallback _iternext;  /**< @brief C function that does what @c %__call__ does for an iterator class, so loops can advance instances without a call */
+	KrkIterNextCallback _iterpair;  /**< @brief Like @c _iternext for iterators of pairs, storing the two elements to @c value[0] and @c value[1] instead of building a tuple */
 
 	KrkObj * _getter;         /**< @brief @c %__getitem__  Called when an instance is subscripted */
 	KrkObj * _setter;         /**< @brief @c %__setitem__  Called when a subscripted instance is assigned to */
@@ -369,22 +408,38 @@ extern KrkString * krk_copyString(const char * chars, size_t length);
  *
  * Obtain an untyped pointer to the codepoint representation of a string.
  * If the string does not have a codepoint representation allocated, it will
- * be generated by this function and remain with the string for the duration
- * of its lifetime.
+ * be generated by this function. The representation is a cache: for non-ASCII
+ * strings it may be released by the garbage collector, so the returned pointer
+ * should not be held across anything that can allocate GC-tracked memory.
  *
  * @param string String to obtain the codepoint representation of.
  * @return A pointer to the bytes of the codepoint representation.
  */
 extern void * krk_unicodeString(KrkString * string);
 
+/**
+ * @brief Obtain the byte offset of a codepoint in a string.
+ * @memberof KrkString
+ *
+ * Translates a codepoint index to an offset into the UTF-8 data of
+ * @p string, using the sparse offset index (which is built on first use)
+ * rather than a full codepoint representation. An index equal to or
+ * greater than the string's length yields the length of the string in bytes.
+ *
+ * @param string String to index into.
+ * @param index  Offset of the codepoint to find.
+ * @return Offset in bytes of the start of the requested codepoint.
+ */
+extern size_t krk_unicodeOffset(KrkString * string, size_t index);
+
 /**
  * @brief Obtain the codepoint at a given index in a string.
  * @memberof KrkString
  *
- * This is a convenience function which ensures that a Unicode codepoint
- * representation has been generated and returns the codepoint value at
- * the requested index. If you need to find multiple codepoints, it
- * is recommended that you use the KRK_STRING_FAST macro after calling
+ * This is a convenience function which returns the codepoint value at
+ * the requested index, decoding it directly from the UTF-8 data if no
+ * codepoint representation is available. If you need to find many codepoints,
+ * it is recommended that you use the KRK_STRING_FAST macro after calling
  * krk_unicodeString instead.
  *
  * @note This function does not perform any bounds checking.
@@ -395,6 +450,20 @@ extern void * krk_unicodeString(KrkString * string);
  */
 extern uint32_t krk_unicodeCodepoint(KrkString * string, size_t index);
 
+/**
+ * @brief Obtain a string object containing a single codepoint.
+ * @memberof KrkString
+ *
+ * Strings for codepoints in the Latin-1 range are preallocated when the VM
+ * is initialized and are never collected, so they are returned directly
+ * without hashing or a string table lookup. Other codepoints are encoded
+ * and interned as with krk_copyString.
+ *
+ * @param codepoint Codepoint to obtain a string for.
+ * @return A string object of length 1.
+ */
+extern KrkString * krk_codepointString(uint32_t codepoint);
+
 /**
  * @brief Convert an integer codepoint to a UTF-8 byte representation.
  * @memberof KrkString
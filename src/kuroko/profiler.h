@@ -0,0 +1,56 @@
+#pragma once
+/**
+ * @file profiler.h
+ * @brief Statistical sampling profiler.
+ *
+ * The profiler interrupts the thread that started it at a fixed rate of
+ * CPU time and records which functions are on its call stack. The
+ * samples are written to a preallocated ring buffer by the signal
+ * handler, and folded into per-stack counts by the VM between instructions,
+ * so the cost of a sample does not depend on the depth of the code being
+ * profiled and nothing is allocated while interrupted.
+ *
+ * Results are available as folded stacks, one line per distinct stack
+ * with frames separated by semicolons and followed by a sample count,
+ * which is the input format of flamegraph tools.
+ *
+ * Also exported to user code as the @c profiler module.
+ */
+#include <stdio.h>
+#include "vm.h"
+
+/**
+ * @brief Start sampling the current thread.
+ *
+ * @param frequency Samples per second of CPU time.
+ * @return 1 if the profiler was started, 0 if it is already running or
+ *         sampling is not supported on this platform.
+ */
+extern int krk_profilerStart(int frequency);
+
+/**
+ * @brief Stop sampling.
+ *
+ * Collected samples are kept until @ref krk_profilerReset is called, and
+ * a later @ref krk_profilerStart adds to them.
+ */
+extern void krk_profilerStop(void);
+
+/**
+ * @brief Discard all collected samples.
+ *
+ * If the profiler is stopped, its sample buffer is also released.
+ */
+extern void krk_profilerReset(void);
+
+/**
+ * @brief Get the collected samples as a dict of folded stacks to counts.
+ */
+extern KrkValue krk_profilerStacks(void);
+
+/**
+ * @brief Write the collected samples as folded stacks.
+ *
+ * @param f Stream to write to.
+ */
+extern void krk_profilerWriteFolded(FILE * f);
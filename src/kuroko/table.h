@@ -24,11 +24,17 @@ typedef struct {
 
 /**
  * @brief Simple hash table of arbitrary keys to values.
+ *
+ * @c version changes whenever a key is added or removed or the entries
+ * are reallocated, so a pointer to an entry found while the table had a
+ * given version remains valid for as long as the version is unchanged.
+ * Overwriting the value of an existing key does not change the version.
  */
 typedef struct {
 	size_t count;
 	size_t capacity;
 	KrkTableEntry * entries;
+	size_t version;
 } KrkTable;
 
 /**
@@ -127,6 +133,19 @@ extern int krk_tableGet(KrkTable * table, KrkValue key, KrkValue * value);
  */
 extern int krk_tableGet_fast(KrkTable * table, KrkString * str, KrkValue * value);
 
+/**
+ * @brief Find the entry for a string key in a table.
+ * @memberof KrkTable
+ *
+ * Like krk_tableGet_fast(), but returns the entry itself so that callers
+ * can hold on to it for as long as the table's version does not change.
+ *
+ * @param table Table to look up.
+ * @param str   Key to look for.
+ * @return The entry for @p str, or NULL if the key was not found.
+ */
+extern KrkTableEntry * krk_tableGetEntry_fast(KrkTable * table, KrkString * str);
+
 /**
  * @brief Remove a key from a hash table.
  * @memberof KrkTable
@@ -0,0 +1,52 @@
+#pragma once
+/**
+ * @file trace.h
+ * @brief Trace events for timeline views.
+ *
+ * While recording, the VM notes the start and end of every function call,
+ * and of every slice of a generator or coroutine between being resumed and
+ * yielding, along with the thread that ran it. Named spans and instant events
+ * can be added by user code. Each thread writes its events to a ring buffer of
+ * its own, which a background thread drains to the output file, so threads do
+ * not contend with each other while recording.
+ *
+ * The output is Chrome trace-event JSON, which can be loaded into Perfetto or
+ * chrome://tracing.
+ *
+ * Also exported to user code as the @c trace module.
+ */
+#include "vm.h"
+
+/**
+ * @brief Start recording trace events to a file.
+ *
+ * @param path File to write; it is replaced if it exists.
+ * @return 1 if recording was started, 0 if the file could not be opened or
+ *         events are already being recorded.
+ */
+extern int krk_traceStart(const char * path);
+
+/**
+ * @brief Stop recording, write the remaining events and close the file.
+ *
+ * Events that other threads record while recording is stopping may be lost.
+ */
+extern void krk_traceStop(void);
+
+/**
+ * @brief Begin a named span on the current thread.
+ *
+ * Spans nest with calls and other spans; each must be ended by
+ * @ref krk_traceEnd on the same thread.
+ */
+extern void krk_traceBegin(const char * name);
+
+/**
+ * @brief End the innermost span begun on the current thread.
+ */
+extern void krk_traceEnd(void);
+
+/**
+ * @brief Record a named instant event on the current thread.
+ */
+extern void krk_traceInstant(const char * name);
@@ -0,0 +1,40 @@
+#pragma once
+/**
+ * @file tracemalloc.h
+ * @brief Allocation tracer.
+ *
+ * While tracing, every allocation made through @ref krk_reallocate is
+ * attributed to the instruction the current thread was executing, and
+ * the tracer keeps the number of live bytes and blocks for each of those
+ * allocation sites. Snapshots resolve sites to source lines, so growth
+ * between two points in a program can be found by comparing snapshots.
+ *
+ * Allocations can be sampled to reduce the overhead of tracing: with a
+ * sampling interval of N bytes, one allocation is traced for roughly
+ * every N bytes allocated, and each traced allocation stands for at least
+ * N bytes, so totals remain estimates of the real figures.
+ *
+ * Also exported to user code as the @c tracemalloc module.
+ */
+#include "vm.h"
+
+/**
+ * @brief Start tracing allocations.
+ *
+ * @param interval Sampling interval in bytes; 0 or 1 traces every allocation.
+ * @return 1 if tracing was started, 0 if it was already running.
+ */
+extern int krk_tracemallocStart(size_t interval);
+
+/**
+ * @brief Stop tracing allocations and discard all traces.
+ */
+extern void krk_tracemallocStop(void);
+
+/**
+ * @brief Get the live allocations, by source line.
+ *
+ * @return A dict mapping @c file:line strings to tuples of the
+ *         number of live bytes and blocks allocated there.
+ */
+extern KrkValue krk_tracemallocSnapshot(void);
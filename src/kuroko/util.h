@@ -81,6 +81,52 @@
 #define BIND_PROP(klass,method) krk_defineNativeProperty(&klass->methods, #method, _ ## klass ## _ ## method)
 #define BIND_FUNC(module,func) krk_defineNative(&module->fields, #func, _krk_ ## func)
 
+/**
+ * @brief Parse the arguments to a native function into C locals.
+ *
+ * @p format has one character per argument, naming its type:
+ *  - @c O any value, stored to a @c KrkValue
+ *  - @c i an @ref int, stored to a @c krk_integer_type
+ *  - @c d a @ref float or @ref int, stored to a @c double
+ *  - @c p any value, stored to an @c int as its truthiness
+ *  - @c s a @ref str, stored to a <tt>const char *</tt>
+ *  - @c z a @ref str or @c None, stored to a <tt>const char *</tt> that is @c NULL for @c None
+ *  - @c S a @ref str, stored to a <tt>KrkString *</tt>
+ *  - @c y a @ref bytes, stored to a <tt>KrkBytes *</tt>
+ *
+ * Arguments after a @c | are optional, and their locals are left as they were
+ * when not passed. Arguments after a @c $ may only be passed by keyword.
+ *
+ * @p names has one entry per argument. The strings are interned on the first
+ * call into @p interned, which the caller keeps for later calls, so each keyword
+ * argument is found with a single pointer lookup. @p generation records the
+ * @c vm.generation they were interned for; they are interned again for a new VM.
+ *
+ * @return 1 on success, 0 with an exception set on failure.
+ */
+extern int krk_parseArgs_impl(const char * methodName, int argc, const KrkValue argv[], int hasKw,
+	const char * format, const char * const names[], size_t * generation, KrkString ** interned, ...);
+
+/**
+ * @brief Parse the arguments of a @ref KRK_FUNC.
+ *
+ * @p names should be a static array of argument names; the interned copies are
+ * cached in a static array for each call site. Returns 1 on success, or 0 with
+ * an exception set.
+ */
+#define krk_parseArgs(format,names,...) __extension__ ({ \
+	static size_t _interned_generation; \
+	static KrkString * _interned_names[sizeof(names)/sizeof(*names)]; \
+	krk_parseArgs_impl(_method_name, argc, argv, hasKw, format, names, &_interned_generation, _interned_names, __VA_ARGS__); })
+
+/**
+ * @brief Parse the arguments of a @ref KRK_METHOD, after the receiver.
+ */
+#define krk_parseMethodArgs(format,names,...) __extension__ ({ \
+	static size_t _interned_generation; \
+	static KrkString * _interned_names[sizeof(names)/sizeof(*names)]; \
+	krk_parseArgs_impl(_method_name, argc - 1, argv + 1, hasKw, format, names, &_interned_generation, _interned_names, __VA_ARGS__); })
+
 /**
  * @brief Inline flexible string array.
  */
@@ -193,13 +239,13 @@ static inline KrkValue discardStringBuilder(struct StringBuilder * sb) {
 #define AS_class(o)    AS_CLASS(o)
 
 #define IS_listiterator(o) krk_isInstanceOf(o,vm.baseClasses->listiteratorClass)
-#define AS_listiterator(o) AS_INSTANCE(o)
+#define AS_listiterator(o) ((struct ListIterator*)AS_OBJECT(o))
 
 #define IS_str(o)     (IS_STRING(o)||krk_isInstanceOf(o,vm.baseClasses->strClass))
 #define AS_str(o)     (KrkString*)AS_OBJECT(o)
 
 #define IS_striterator(o) (krk_isInstanceOf(o,vm.baseClasses->striteratorClass))
-#define AS_striterator(o) (AS_INSTANCE(o))
+#define AS_striterator(o) ((struct StrIterator*)AS_OBJECT(o))
 
 #define IS_dict(o)    ((IS_INSTANCE(o) && AS_INSTANCE(o)->_class == vm.baseClasses->dictClass) || krk_isInstanceOf(o,vm.baseClasses->dictClass))
 #define AS_dict(o)    (KrkDict*)AS_OBJECT(o)
@@ -211,7 +257,7 @@ static inline KrkValue discardStringBuilder(struct StringBuilder * sb) {
 #define AS_dictkeys(o) ((struct DictKeys*)AS_OBJECT(o))
 
 #define IS_bytesiterator(o) (krk_isInstanceOf(o,vm.baseClasses->bytesiteratorClass))
-#define AS_bytesiterator(o) (AS_INSTANCE(o))
+#define AS_bytesiterator(o) ((struct BytesIterator*)AS_OBJECT(o))
 
 #ifndef unpackError
 #define unpackError(fromInput) return krk_runtimeError(vm.exceptions->typeError, "'%s' object is not iterable", krk_typeName(fromInput));
@@ -49,6 +49,7 @@ typedef struct {
 	size_t slots;         /**< Offset into the stack at which this function call's arguments begin */
 	size_t outSlots;      /**< Offset into the stack at which stackTop will be reset upon return */
 	KrkTable * globals;   /**< Pointer to the attribute table containing valud global vairables for this call */
+	struct KrkInstance * generator; /**< Generator this frame was resumed from by a loop, which gets its state back when the frame yields or returns */
 	struct timespec in_time;
 } KrkCallFrame;
 
@@ -225,6 +226,7 @@ typedef struct KrkVM {
 
 	KrkThreadState * threads;         /**< Invasive linked list of all VM threads. */
 	FILE * callgrindFile;             /**< File to write unprocessed callgrind data to. */
+	size_t generation;                /**< Distinct for each krk_initVM(), so caches of VM objects can tell they are stale. */
 } KrkVM;
 
 /* Thread-specific flags */
@@ -234,6 +236,11 @@ typedef struct KrkVM {
 #define KRK_THREAD_HAS_EXCEPTION       (1 << 3)
 #define KRK_THREAD_SINGLE_STEP         (1 << 4)
 #define KRK_THREAD_SIGNALLED           (1 << 5)
+#define KRK_THREAD_PROFILE_DRAIN       (1 << 6)
+#define KRK_THREAD_COUNT_INSTRUCTIONS  (1 << 7)
+/* Set at runtime only; not accepted by krk_initVM() */
+#define KRK_THREAD_GC_CALLBACKS        (1 << 16)
+#define KRK_THREAD_LINE_PROFILE        (1 << 17)
 
 /* Global flags */
 #define KRK_GLOBAL_ENABLE_STRESS_GC    (1 << 8)
@@ -242,6 +249,10 @@ typedef struct KrkVM {
 #define KRK_GLOBAL_CALLGRIND           (1 << 11)
 #define KRK_GLOBAL_REPORT_GC_COLLECTS  (1 << 12)
 #define KRK_GLOBAL_THREADS             (1 << 13)
+#define KRK_GLOBAL_DISABLE_OPTIMIZER   (1 << 14)
+#define KRK_GLOBAL_TRACE_ALLOCATIONS   (1 << 15)
+/* Set at runtime only; not accepted by krk_initVM() */
+#define KRK_GLOBAL_TRACE_EVENTS        (1 << 16)
 
 #ifdef ENABLE_THREADING
 #  define threadLocal __thread
@@ -0,0 +1,401 @@
+/**
+ * @file    lineprofiler.c
+ * @brief   Line profiler and the @c lineprofiler module.
+ *
+ * When KRK_THREAD_LINE_PROFILE is set, the VM calls _lineProfilerStep()
+ * before each instruction. Every frame depth has a slot holding the line
+ * the frame at that depth is currently on, if it is running a selected
+ * function: the index of that line's entry in the line map, the range of
+ * instruction offsets the entry covers, and when it began. An instruction
+ * outside that range, or at or before the previous offset of the slot, is
+ * the start of a new line, and the time since the old line began is added
+ * to the old line. Frames that have returned or been unwound since the
+ * previous instruction end their lines when the depth is seen to drop.
+ *
+ * Counts are kept per line map entry in the code object's @c lineProfile
+ * array, as pairs of hits and nanoseconds, and summed by line number for
+ * output. Selected code objects are marked by the garbage collector so
+ * their results survive the functions that ran them.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <kuroko/vm.h>
+#include <kuroko/value.h>
+#include <kuroko/object.h>
+#include <kuroko/memory.h>
+#include <kuroko/util.h>
+#include <kuroko/lineprofiler.h>
+
+#include "private.h"
+
+/**
+ * @brief The line a frame at some depth is on.
+ */
+struct LineSlot {
+	KrkCodeObject * code;  /* NULL if the frame is not running a selected function */
+	size_t entry;          /* Index in the line map */
+	size_t lastOffset;
+	size_t endOffset;      /* Start of the next line map entry */
+	uint64_t start;
+};
+
+static struct {
+	KrkThreadState * thread;  /* Thread being profiled, or NULL when stopped */
+	size_t depth;             /* Frame count at the previous instruction */
+	struct LineSlot slots[KRK_CALL_FRAMES_MAX];
+	KrkCodeObject ** functions;
+	size_t functionCount;
+	size_t functionCapacity;
+} lineprof;
+
+static uint64_t now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void endLine(struct LineSlot * slot, uint64_t * time) {
+	if (!slot->code) return;
+	if (!*time) *time = now();
+	slot->code->lineProfile[slot->entry * 2 + 1] += *time - slot->start;
+	slot->code = NULL;
+}
+
+static size_t findEntry(KrkChunk * chunk, size_t offset) {
+	size_t low = 0, high = chunk->linesCount;
+	while (high - low > 1) {
+		size_t middle = (low + high) / 2;
+		if (chunk->lines[middle].startOffset <= offset) low = middle;
+		else high = middle;
+	}
+	return low;
+}
+
+void _lineProfilerStep(KrkCallFrame * frame) {
+	size_t depth = krk_currentThread.frameCount;
+	uint64_t time = 0;
+
+	while (lineprof.depth > depth) endLine(&lineprof.slots[--lineprof.depth], &time);
+	lineprof.depth = depth;
+
+	KrkCodeObject * code = frame->closure->function;
+	struct LineSlot * slot = &lineprof.slots[depth - 1];
+	size_t offset = frame->ip - code->chunk.code;
+
+	if (slot->code == code) {
+		if (offset > slot->lastOffset && offset < slot->endOffset) {
+			slot->lastOffset = offset;
+			return;
+		}
+	} else {
+		/* Another call at the same depth, without an instruction of the caller in between */
+		endLine(slot, &time);
+		if (!code->lineProfile || !code->chunk.linesCount) return;
+	}
+
+	endLine(slot, &time);
+	if (!time) time = now();
+
+	size_t entry = findEntry(&code->chunk, offset);
+	slot->code = code;
+	slot->entry = entry;
+	slot->lastOffset = offset;
+	slot->endOffset = entry + 1 < code->chunk.linesCount ? code->chunk.lines[entry + 1].startOffset : code->chunk.count;
+	slot->start = time;
+	code->lineProfile[entry * 2]++;
+}
+
+void _lineProfilerMarkRoots(void) {
+	for (size_t i = 0; i < lineprof.functionCount; ++i) {
+		krk_markObject((KrkObj*)lineprof.functions[i]);
+	}
+}
+
+int krk_lineProfilerAdd(KrkCodeObject * code) {
+	if (code->lineProfile) return 0;
+	if (lineprof.functionCount == lineprof.functionCapacity) {
+		lineprof.functionCapacity = lineprof.functionCapacity ? lineprof.functionCapacity * 2 : 8;
+		lineprof.functions = realloc(lineprof.functions, sizeof(KrkCodeObject*) * lineprof.functionCapacity);
+	}
+	lineprof.functions[lineprof.functionCount++] = code;
+	uint64_t * counts = ALLOCATE(uint64_t, code->chunk.linesCount * 2);
+	memset(counts, 0, sizeof(uint64_t) * code->chunk.linesCount * 2);
+	code->lineProfile = counts;
+	return 1;
+}
+
+int krk_lineProfilerStart(void) {
+#ifdef KRK_NO_TRACING
+	return 0;
+#else
+	if (lineprof.thread) return 0;
+	lineprof.thread = &krk_currentThread;
+	lineprof.depth = 0;
+	krk_currentThread.flags |= KRK_THREAD_LINE_PROFILE;
+	return 1;
+#endif
+}
+
+void krk_lineProfilerStop(void) {
+	if (!lineprof.thread) return;
+	lineprof.thread->flags &= ~KRK_THREAD_LINE_PROFILE;
+	lineprof.thread = NULL;
+
+	uint64_t time = 0;
+	while (lineprof.depth) endLine(&lineprof.slots[--lineprof.depth], &time);
+}
+
+void krk_lineProfilerReset(void) {
+	for (size_t i = 0; i < lineprof.functionCount; ++i) {
+		KrkCodeObject * code = lineprof.functions[i];
+		memset(code->lineProfile, 0, sizeof(uint64_t) * code->chunk.linesCount * 2);
+	}
+	/* Lines that are running start over from now */
+	uint64_t time = now();
+	for (size_t i = 0; i < lineprof.depth; ++i) lineprof.slots[i].start = time;
+}
+
+void krk_lineProfilerClear(void) {
+	krk_lineProfilerStop();
+	for (size_t i = 0; i < lineprof.functionCount; ++i) {
+		KrkCodeObject * code = lineprof.functions[i];
+		FREE_ARRAY(uint64_t, code->lineProfile, code->chunk.linesCount * 2);
+		code->lineProfile = NULL;
+	}
+	free(lineprof.functions);
+	lineprof.functions = NULL;
+	lineprof.functionCount = 0;
+	lineprof.functionCapacity = 0;
+}
+
+static const char * codeFile(KrkCodeObject * code) {
+	return code->chunk.filename ? code->chunk.filename->chars : "<unknown>";
+}
+
+static const char * codeName(KrkCodeObject * code) {
+	if (code->qualname) return code->qualname->chars;
+	return code->name ? code->name->chars : "<unnamed>";
+}
+
+KrkValue krk_lineProfilerStats(void) {
+	KrkValue result = krk_dict_of(0, NULL, 0);
+	krk_push(result);
+	for (size_t i = 0; i < lineprof.functionCount; ++i) {
+		KrkCodeObject * code = lineprof.functions[i];
+		for (size_t j = 0; j < code->chunk.linesCount; ++j) {
+			uint64_t hits = code->lineProfile[j * 2];
+			if (!hits) continue;
+			double seconds = (double)code->lineProfile[j * 2 + 1] / 1e9;
+
+			char key[1024];
+			snprintf(key, sizeof(key), "%s:%d", codeFile(code), (int)code->chunk.lines[j].line);
+			krk_push(OBJECT_VAL(krk_copyString(key, strlen(key))));
+
+			/* A line can have several entries in the line map; they add up. */
+			KrkValue existing;
+			if (krk_tableGet(AS_DICT(result), krk_peek(0), &existing)) {
+				hits += AS_INTEGER(AS_TUPLE(existing)->values.values[0]);
+				seconds += AS_FLOATING(AS_TUPLE(existing)->values.values[1]);
+			}
+			KrkTuple * entry = krk_newTuple(2);
+			krk_push(OBJECT_VAL(entry));
+			entry->values.values[entry->values.count++] = INTEGER_VAL(hits);
+			entry->values.values[entry->values.count++] = FLOATING_VAL(seconds);
+			krk_tableSet(AS_DICT(result), krk_peek(1), krk_peek(0));
+			krk_pop();
+			krk_pop();
+		}
+	}
+	return krk_pop();
+}
+
+/**
+ * Read the lines of a source file. Returns a malloc'd array of
+ * pointers into one malloc'd buffer, or NULL if it can not be read.
+ */
+static char ** readSource(const char * path, size_t * countOut) {
+	FILE * f = fopen(path, "r");
+	if (!f) return NULL;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if (size < 0) {
+		fclose(f);
+		return NULL;
+	}
+	char * buffer = malloc(size + 1);
+	size_t length = fread(buffer, 1, size, f);
+	buffer[length] = '\0';
+	fclose(f);
+
+	size_t count = 0, capacity = 64;
+	char ** lines = malloc(sizeof(char*) * capacity);
+	char * line = buffer;
+	while (*line) {
+		if (count == capacity) {
+			capacity *= 2;
+			lines = realloc(lines, sizeof(char*) * capacity);
+		}
+		lines[count++] = line;
+		char * end = strchr(line, '\n');
+		if (!end) break;
+		*end = '\0';
+		line = end + 1;
+	}
+	if (!count) {
+		free(buffer);
+		free(lines);
+		return NULL;
+	}
+	*countOut = count;
+	return lines;
+}
+
+static void writeFunction(FILE * f, KrkCodeObject * code) {
+	size_t first = SIZE_MAX, last = 0;
+	uint64_t total = 0;
+	for (size_t i = 0; i < code->chunk.linesCount; ++i) {
+		size_t line = code->chunk.lines[i].line;
+		if (line < first) first = line;
+		if (line > last) last = line;
+		total += code->lineProfile[i * 2 + 1];
+	}
+	if (first > last) return;
+
+	size_t span = last - first + 1;
+	uint64_t * hits = calloc(span * 2, sizeof(uint64_t));
+	for (size_t i = 0; i < code->chunk.linesCount; ++i) {
+		size_t line = code->chunk.lines[i].line - first;
+		hits[line * 2] += code->lineProfile[i * 2];
+		hits[line * 2 + 1] += code->lineProfile[i * 2 + 1];
+	}
+
+	size_t sourceCount = 0;
+	char ** source = readSource(codeFile(code), &sourceCount);
+
+	fprintf(f, "Function: %s at %s:%zu\n", codeName(code), codeFile(code), first);
+	fprintf(f, "Total time: %.6f s\n\n", (double)total / 1e9);
+	fprintf(f, "%6s %10s %12s %10s %8s  %s\n", "Line", "Hits", "Time (us)", "Per hit", "% Time", "Line contents");
+	fprintf(f, "%.*s\n", 72, "========================================================================");
+	for (size_t i = 0; i < span; ++i) {
+		size_t line = first + i;
+		const char * text = source && line <= sourceCount ? source[line - 1] : "";
+		if (hits[i * 2]) {
+			double micros = (double)hits[i * 2 + 1] / 1e3;
+			fprintf(f, "%6zu %10llu %12.1f %10.1f %8.1f  %s\n", line, (unsigned long long)hits[i * 2],
+				micros, micros / hits[i * 2], total ? 100.0 * hits[i * 2 + 1] / total : 0.0, text);
+		} else {
+			fprintf(f, "%6zu %10s %12s %10s %8s  %s\n", line, "", "", "", "", text);
+		}
+	}
+	fprintf(f, "\n");
+
+	if (source) {
+		free(source[0]);
+		free(source);
+	}
+	free(hits);
+}
+
+void krk_lineProfilerWriteReport(FILE * f) {
+	for (size_t i = 0; i < lineprof.functionCount; ++i) {
+		writeFunction(f, lineprof.functions[i]);
+	}
+}
+
+static const char * const addArgs[] = {"function"};
+KRK_FUNC(add,{
+	KrkValue func;
+	if (!krk_parseArgs("O", addArgs, &func)) return NONE_VAL();
+	KrkCodeObject * code;
+	if (IS_CLOSURE(func)) {
+		code = AS_CLOSURE(func)->function;
+	} else if (IS_BOUND_METHOD(func) && IS_CLOSURE(OBJECT_VAL(AS_BOUND_METHOD(func)->method))) {
+		code = AS_CLOSURE(OBJECT_VAL(AS_BOUND_METHOD(func)->method))->function;
+	} else if (IS_codeobject(func)) {
+		code = AS_codeobject(func);
+	} else {
+		return TYPE_ERROR(function or method or codeobject,func);
+	}
+	krk_lineProfilerAdd(code);
+	return func;
+})
+
+KRK_FUNC(start,{
+	FUNCTION_TAKES_NONE();
+	if (lineprof.thread) return krk_runtimeError(vm.exceptions->valueError, "line profiler is already running");
+	if (!krk_lineProfilerStart()) return krk_runtimeError(vm.exceptions->notImplementedError, "line profiling is not supported in this build");
+})
+
+KRK_FUNC(stop,{
+	FUNCTION_TAKES_NONE();
+	krk_lineProfilerStop();
+})
+
+KRK_FUNC(reset,{
+	FUNCTION_TAKES_NONE();
+	krk_lineProfilerReset();
+})
+
+KRK_FUNC(clear,{
+	FUNCTION_TAKES_NONE();
+	krk_lineProfilerClear();
+})
+
+KRK_FUNC(running,{
+	FUNCTION_TAKES_NONE();
+	return BOOLEAN_VAL(lineprof.thread != NULL);
+})
+
+KRK_FUNC(stats,{
+	FUNCTION_TAKES_NONE();
+	return krk_lineProfilerStats();
+})
+
+static const char * const reportArgs[] = {"path"};
+KRK_FUNC(report,{
+	const char * path = NULL;
+	if (!krk_parseArgs("|z", reportArgs, &path)) return NONE_VAL();
+	if (!path) {
+		krk_lineProfilerWriteReport(stdout);
+		fflush(stdout);
+		return NONE_VAL();
+	}
+	FILE * f = fopen(path, "w");
+	if (!f) return krk_runtimeError(vm.exceptions->ioError, "%s: could not open for writing", path);
+	krk_lineProfilerWriteReport(f);
+	fclose(f);
+})
+
+_noexport
+void _createAndBind_lineprofilerMod(void) {
+	KrkInstance * module = krk_newInstance(vm.baseClasses->moduleClass);
+	krk_attachNamedObject(&vm.modules, "lineprofiler", (KrkObj*)module);
+	krk_attachNamedObject(&module->fields, "__name__", (KrkObj*)S("lineprofiler"));
+	krk_attachNamedValue(&module->fields, "__file__", NONE_VAL());
+	KRK_DOC(module, "@brief Line profiler.\n\n"
+		"Counts how many times each line of the selected functions runs on the thread that started "
+		"the profiler, and how long it takes, including the time of the calls it makes.");
+	KRK_DOC(BIND_FUNC(module,add),
+		"@brief Select a function for line profiling.\n"
+		"@arguments function\n\n"
+		"Returns @p function, so it can be used as a decorator.");
+	KRK_DOC(BIND_FUNC(module,start),
+		"@brief Start profiling the selected functions on the current thread.");
+	KRK_DOC(BIND_FUNC(module,stop),
+		"@brief Stop profiling. Collected results are kept.");
+	KRK_DOC(BIND_FUNC(module,reset),
+		"@brief Discard the results collected for the selected functions.");
+	KRK_DOC(BIND_FUNC(module,clear),
+		"@brief Stop profiling and forget all selected functions and their results.");
+	KRK_DOC(BIND_FUNC(module,running),
+		"@brief Whether the line profiler is currently running.");
+	KRK_DOC(BIND_FUNC(module,stats),
+		"@brief Get a @ref dict mapping @c file:line to a tuple of the number of times the line ran and the seconds spent on it.");
+	KRK_DOC(BIND_FUNC(module,report),
+		"@brief Write the selected functions' source annotated with counts and times.\n"
+		"@arguments path=None\n\n"
+		"Writes to the file at @p path, or to standard output if it is not given.");
+}
@@ -1,3 +1,5 @@
+#include <time.h>
+
 #include <kuroko/vm.h>
 #include <kuroko/memory.h>
 #include <kuroko/object.h>
@@ -5,8 +7,26 @@
 #include <kuroko/table.h>
 #include <kuroko/util.h>
 
+#include "private.h"
+
+/* Cumulative collector statistics, reported by gc.stats() */
+static struct {
+	size_t collections;
+	size_t objectsFreed;
+	size_t lastFreed;
+	size_t allocations;
+	size_t bytesAllocated;
+	size_t bytesFreed;
+	uint64_t totalPause;
+	uint64_t maxPause;
+	uint64_t lastPause;
+} gcStats;
+
 void * krk_reallocate(void * ptr, size_t old, size_t new) {
 	vm.bytesAllocated += new - old;
+	if (!ptr && new) gcStats.allocations++;
+	if (new > old) gcStats.bytesAllocated += new - old;
+	else gcStats.bytesFreed += old - new;
 
 	if (new > old && ptr != krk_currentThread.stack && &krk_currentThread == vm.threads && !(vm.globalFlags & KRK_GLOBAL_GC_PAUSED)) {
 #ifndef KRK_NO_STRESS_GC
@@ -19,12 +39,16 @@ void * krk_reallocate(void * ptr, size_t old, size_t new) {
 		}
 	}
 
+	int wasTraced = (unlikely(vm.globalFlags & KRK_GLOBAL_TRACE_ALLOCATIONS) && ptr) ? _tracemallocRelease(ptr) : 0;
+
 	if (new == 0) {
 		free(ptr);
 		return NULL;
 	}
 
-	return realloc(ptr, new);
+	void * out = realloc(ptr, new);
+	if (unlikely(vm.globalFlags & KRK_GLOBAL_TRACE_ALLOCATIONS)) _tracemallocAllocate(out, old, new, wasTraced);
+	return out;
 }
 
 static void freeObject(KrkObj * object) {
@@ -33,11 +57,17 @@ static void freeObject(KrkObj * object) {
 			KrkString * string = (KrkString*)object;
 			FREE_ARRAY(char, string->chars, string->length + 1);
 			if (string->codes && string->codes != string->chars) free(string->codes);
+			if (string->offsets) free(string->offsets);
 			FREE(KrkString, object);
 			break;
 		}
 		case KRK_OBJ_CODEOBJECT: {
 			KrkCodeObject * function = (KrkCodeObject*)object;
+			if (function->quickenCounters) FREE_ARRAY(uint8_t, function->quickenCounters, function->chunk.count);
+			if (function->globalCaches) FREE_ARRAY(KrkGlobalCache, function->globalCaches, function->chunk.constants.count);
+			if (function->instructionCounts) FREE_ARRAY(uint64_t, function->instructionCounts, function->chunk.count);
+			if (function->lineProfile) FREE_ARRAY(uint64_t, function->lineProfile, function->chunk.linesCount * 2);
+			krk_freeTable(&function->argumentIndex);
 			krk_freeChunk(&function->chunk);
 			krk_freeValueArray(&function->requiredArgNames);
 			krk_freeValueArray(&function->keywordArgNames);
@@ -115,8 +145,22 @@ void krk_freeObjects() {
 	free(vm.grayStack);
 }
 
+/*
+ * While gc.get_referrers() is searching, blackening an object reports
+ * whether it refers to any of these objects instead of marking anything.
+ */
+static KrkObj ** referrerTargets = NULL;
+static size_t referrerTargetCount = 0;
+static int referrerFound = 0;
+
 void krk_markObject(KrkObj * object) {
 	if (!object) return;
+	if (unlikely(referrerTargets != NULL)) {
+		for (size_t i = 0; i < referrerTargetCount; ++i) {
+			if (referrerTargets[i] == object) referrerFound = 1;
+		}
+		return;
+	}
 	if (object->flags & KRK_OBJ_FLAGS_IS_MARKED) return;
 	object->flags |= KRK_OBJ_FLAGS_IS_MARKED;
 
@@ -209,6 +253,22 @@ static void traceReferences() {
 	}
 }
 
+/**
+ * Codepoint representations of non-ASCII strings are only a cache of
+ * the canonical UTF-8 data; drop them from surviving strings so that
+ * strings which were indexed once do not stay doubled in size. If other
+ * threads have ever been started, they may be holding a pointer into
+ * the cache, so leave it alone.
+ */
+static void releaseCodes(KrkObj * object) {
+	if (object->type != KRK_OBJ_STRING || (vm.globalFlags & KRK_GLOBAL_THREADS)) return;
+	KrkString * string = (KrkString*)object;
+	if (string->codes && string->codes != string->chars) {
+		free(string->codes);
+		string->codes = NULL;
+	}
+}
+
 static size_t sweep() {
 	KrkObj * previous = NULL;
 	KrkObj * object = vm.objects;
@@ -216,6 +276,7 @@ static size_t sweep() {
 	while (object) {
 		if (object->flags & (KRK_OBJ_FLAGS_IMMORTAL | KRK_OBJ_FLAGS_IS_MARKED)) {
 			object->flags &= ~(KRK_OBJ_FLAGS_IS_MARKED | KRK_OBJ_FLAGS_SECOND_CHANCE);
+			releaseCodes(object);
 			previous = object;
 			object = object->next;
 		} else if (object->flags & KRK_OBJ_FLAGS_SECOND_CHANCE) {
@@ -248,7 +309,7 @@ void krk_markTable(KrkTable * table) {
 static void tableRemoveWhite(KrkTable * table) {
 	for (size_t i = 0; i < table->capacity; ++i) {
 		KrkTableEntry * entry = &table->entries[i];
-		if (IS_OBJECT(entry->key) && !((AS_OBJECT(entry->key))->flags & KRK_OBJ_FLAGS_IS_MARKED)) {
+		if (IS_OBJECT(entry->key) && !((AS_OBJECT(entry->key))->flags & (KRK_OBJ_FLAGS_IMMORTAL | KRK_OBJ_FLAGS_IS_MARKED))) {
 			krk_tableDelete(table, entry->key);
 		}
 	}
@@ -279,6 +340,9 @@ static void markRoots() {
 	}
 
 	krk_markCompilerRoots();
+	_profilerMarkRoots();
+	_lineProfilerMarkRoots();
+	_tracemallocMarkRoots();
 
 	krk_markObject((KrkObj*)vm.builtins);
 	krk_markTable(&vm.modules);
@@ -290,18 +354,79 @@ static void markRoots() {
 	}
 }
 
+static uint64_t monotonicNanoseconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static KrkInstance * gcModule = NULL;
+static KrkString * callbacksName = NULL;
+static int runningCallbacks = 0;
+
+static int haveCallbacks(void) {
+	KrkValue callbacks;
+	return gcModule && callbacksName && !runningCallbacks &&
+		krk_tableGet_fast(&gcModule->fields, callbacksName, &callbacks) &&
+		krk_isInstanceOf(callbacks, vm.baseClasses->listClass) && AS_LIST(callbacks)->count;
+}
+
 size_t krk_collectGarbage(void) {
+	uint64_t start = monotonicNanoseconds();
 	markRoots();
 	traceReferences();
 	tableRemoveWhite(&vm.strings);
 	size_t out = sweep();
 	vm.nextGC = vm.bytesAllocated * 2;
+	uint64_t pause = monotonicNanoseconds() - start;
+
+	gcStats.collections++;
+	gcStats.objectsFreed += out;
+	gcStats.lastFreed = out;
+	gcStats.totalPause += pause;
+	gcStats.lastPause = pause;
+	if (pause > gcStats.maxPause) gcStats.maxPause = pause;
+
+	/* Collections happen inside allocations; callbacks run once the VM reaches the next instruction. */
+	if (haveCallbacks()) krk_currentThread.flags |= KRK_THREAD_GC_CALLBACKS;
+
 	if (vm.globalFlags & KRK_GLOBAL_REPORT_GC_COLLECTS) {
-		fprintf(stderr, "[gc] collected %llu, next collection at %llu\n", (unsigned long long)out, (unsigned long long)vm.nextGC);
+		fprintf(stderr, "[gc] collected %llu in %lluus, next collection at %llu\n", (unsigned long long)out,
+			(unsigned long long)(pause / 1000), (unsigned long long)vm.nextGC);
 	}
 	return out;
 }
 
+void _gcRunCallbacks(void) {
+	krk_currentThread.flags &= ~KRK_THREAD_GC_CALLBACKS;
+	if (!haveCallbacks()) return;
+	runningCallbacks = 1;
+
+	KrkValue callbacks;
+	krk_tableGet_fast(&gcModule->fields, callbacksName, &callbacks);
+	krk_push(callbacks);
+
+	KrkValue info = krk_dict_of(0, NULL, 0);
+	krk_push(info);
+	krk_attachNamedValue(AS_DICT(info), "collections", INTEGER_VAL(gcStats.collections));
+	krk_attachNamedValue(AS_DICT(info), "collected", INTEGER_VAL(gcStats.lastFreed));
+	krk_attachNamedValue(AS_DICT(info), "pause", FLOATING_VAL((double)gcStats.lastPause / 1e9));
+
+	for (size_t i = 0; i < AS_LIST(callbacks)->count; ++i) {
+		size_t frameCount = krk_currentThread.frameCount;
+		size_t stackOffset = krk_currentThread.stackTop - krk_currentThread.stack;
+		krk_push(AS_LIST(callbacks)->values[i]);
+		krk_push(info);
+		krk_callStack(1);
+		/* The code that was running did not cause the exception, so it is not raised there. */
+		if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) _reportUnraisable(frameCount, stackOffset);
+	}
+
+	runningCallbacks = 0;
+	krk_pop(); /* info */
+	krk_pop(); /* callbacks */
+}
+
 KRK_FUNC(collect,{
 	FUNCTION_TAKES_NONE();
 	if (&krk_currentThread != vm.threads) return krk_runtimeError(vm.exceptions->valueError, "only the main thread can do that");
@@ -318,6 +443,120 @@ KRK_FUNC(resume,{
 	vm.globalFlags &= ~(KRK_GLOBAL_GC_PAUSED);
 })
 
+static const char * objectTypeNames[] = {
+	[KRK_OBJ_CODEOBJECT]   = "codeobject",
+	[KRK_OBJ_NATIVE]       = "native",
+	[KRK_OBJ_CLOSURE]      = "function",
+	[KRK_OBJ_STRING]       = "str",
+	[KRK_OBJ_UPVALUE]      = "upvalue",
+	[KRK_OBJ_CLASS]        = "type",
+	[KRK_OBJ_INSTANCE]     = "instance",
+	[KRK_OBJ_BOUND_METHOD] = "method",
+	[KRK_OBJ_TUPLE]        = "tuple",
+	[KRK_OBJ_BYTES]        = "bytes",
+};
+
+/* Objects flagged for release at the next sweep are unreachable, and must not be handed back out. */
+static int isCollectable(KrkObj * object) {
+	return object->type != KRK_OBJ_UPVALUE && !(object->flags & KRK_OBJ_FLAGS_SECOND_CHANCE);
+}
+
+KRK_FUNC(stats,{
+	FUNCTION_TAKES_NONE();
+	int wasPaused = vm.globalFlags & KRK_GLOBAL_GC_PAUSED;
+	vm.globalFlags |= KRK_GLOBAL_GC_PAUSED;
+
+	/* Building the result allocates, so take the counters first. */
+	size_t allocations = gcStats.allocations;
+	size_t bytesAllocated = gcStats.bytesAllocated;
+	size_t bytesFreed = gcStats.bytesFreed;
+	size_t heap = vm.bytesAllocated;
+
+	KrkValue result = krk_dict_of(0, NULL, 0);
+	krk_push(result);
+	krk_attachNamedValue(AS_DICT(result), "collections", INTEGER_VAL(gcStats.collections));
+	krk_attachNamedValue(AS_DICT(result), "collected", FLOATING_VAL((double)gcStats.objectsFreed));
+	krk_attachNamedValue(AS_DICT(result), "total_pause", FLOATING_VAL((double)gcStats.totalPause / 1e9));
+	krk_attachNamedValue(AS_DICT(result), "max_pause", FLOATING_VAL((double)gcStats.maxPause / 1e9));
+	krk_attachNamedValue(AS_DICT(result), "last_pause", FLOATING_VAL((double)gcStats.lastPause / 1e9));
+	krk_attachNamedValue(AS_DICT(result), "allocations", FLOATING_VAL((double)allocations));
+	krk_attachNamedValue(AS_DICT(result), "bytes_allocated", FLOATING_VAL((double)bytesAllocated));
+	krk_attachNamedValue(AS_DICT(result), "bytes_freed", FLOATING_VAL((double)bytesFreed));
+	krk_attachNamedValue(AS_DICT(result), "heap", FLOATING_VAL((double)heap));
+	krk_attachNamedValue(AS_DICT(result), "next_collection", FLOATING_VAL((double)vm.nextGC));
+
+	size_t typeCounts[sizeof(objectTypeNames) / sizeof(*objectTypeNames)] = {0};
+	KrkValue classes = krk_dict_of(0, NULL, 0);
+	krk_push(classes);
+	for (KrkObj * object = vm.objects; object; object = object->next) {
+		typeCounts[object->type]++;
+		if (object->type == KRK_OBJ_INSTANCE) {
+			KrkValue cls = OBJECT_VAL(((KrkInstance*)object)->_class);
+			KrkValue count = INTEGER_VAL(0);
+			krk_tableGet(AS_DICT(classes), cls, &count);
+			krk_tableSet(AS_DICT(classes), cls, INTEGER_VAL(AS_INTEGER(count) + 1));
+		}
+	}
+
+	KrkValue types = krk_dict_of(0, NULL, 0);
+	krk_push(types);
+	for (size_t i = 0; i < sizeof(typeCounts) / sizeof(*typeCounts); ++i) {
+		krk_attachNamedValue(AS_DICT(types), objectTypeNames[i], INTEGER_VAL(typeCounts[i]));
+	}
+
+	krk_attachNamedValue(AS_DICT(result), "types", krk_pop());
+	krk_attachNamedValue(AS_DICT(result), "classes", krk_pop());
+
+	if (!wasPaused) vm.globalFlags &= ~KRK_GLOBAL_GC_PAUSED;
+	return krk_pop();
+})
+
+KRK_FUNC(get_objects,{
+	FUNCTION_TAKES_NONE();
+	int wasPaused = vm.globalFlags & KRK_GLOBAL_GC_PAUSED;
+	vm.globalFlags |= KRK_GLOBAL_GC_PAUSED;
+
+	KrkValue result = krk_list_of(0, NULL, 0);
+	krk_push(result);
+	for (KrkObj * object = vm.objects; object; object = object->next) {
+		if (isCollectable(object) && object != AS_OBJECT(result)) krk_writeValueArray(AS_LIST(result), OBJECT_VAL(object));
+	}
+
+	if (!wasPaused) vm.globalFlags &= ~KRK_GLOBAL_GC_PAUSED;
+	return krk_pop();
+})
+
+KRK_FUNC(get_referrers,{
+	int wasPaused = vm.globalFlags & KRK_GLOBAL_GC_PAUSED;
+	vm.globalFlags |= KRK_GLOBAL_GC_PAUSED;
+
+	KrkValue result = krk_list_of(0, NULL, 0);
+	krk_push(result);
+
+	KrkObj ** targets = malloc(sizeof(KrkObj*) * (argc ? argc : 1));
+	size_t targetCount = 0;
+	for (int i = 0; i < argc; ++i) {
+		if (IS_OBJECT(argv[i])) targets[targetCount++] = AS_OBJECT(argv[i]);
+	}
+
+	if (targetCount) {
+		referrerTargets = targets;
+		referrerTargetCount = targetCount;
+		for (KrkObj * object = vm.objects; object; object = object->next) {
+			if (!isCollectable(object) || object == AS_OBJECT(result)) continue;
+			referrerFound = 0;
+			blackenObject(object);
+			if (referrerFound) krk_writeValueArray(AS_LIST(result), OBJECT_VAL(object));
+		}
+		referrerTargets = NULL;
+		referrerTargetCount = 0;
+	}
+	free(targets);
+
+	if (!wasPaused) vm.globalFlags &= ~KRK_GLOBAL_GC_PAUSED;
+	return krk_pop();
+})
+
 _noexport
 void _createAndBind_gcMod(void) {
 	/**
@@ -325,11 +564,19 @@ void _createAndBind_gcMod(void) {
 	 *
 	 * Namespace for methods for controlling the garbage collector.
 	 */
-	KrkInstance * gcModule = krk_newInstance(vm.baseClasses->moduleClass);
+	callbacksName = NULL;
+	gcModule = krk_newInstance(vm.baseClasses->moduleClass);
 	krk_attachNamedObject(&vm.modules, "gc", (KrkObj*)gcModule);
 	krk_attachNamedObject(&gcModule->fields, "__name__", (KrkObj*)S("gc"));
 	krk_attachNamedValue(&gcModule->fields, "__file__", NONE_VAL());
-	KRK_DOC(gcModule, "@brief Namespace containing methods for controlling the garbage collector.");
+	KRK_DOC(gcModule, "@brief Namespace containing methods for controlling the garbage collector.\n\n"
+		"Functions in the list @c callbacks are called after each collection with a dict "
+		"describing it: the number of @c collections so far, the number of objects @c collected "
+		"and the @c pause time in seconds. As collections happen during allocations, the "
+		"callbacks run when the interpreter reaches its next instruction; if several "
+		"collections happen before then, the callbacks run once, for the latest. "
+		"An exception raised by a callback is reported like an uncaught exception, and the "
+		"remaining callbacks and the program carry on.");
 
 	KRK_DOC(BIND_FUNC(gcModule,collect),
 		"@brief Triggers one cycle of garbage collection.");
@@ -337,4 +584,23 @@ void _createAndBind_gcMod(void) {
 		"@brief Disables automatic garbage collection until @ref resume is called.");
 	KRK_DOC(BIND_FUNC(gcModule,resume),
 		"@brief Re-enable automatic garbage collection after it was stopped by @ref pause ");
+	KRK_DOC(BIND_FUNC(gcModule,stats),
+		"@brief Get statistics about the garbage collector and a census of the heap.\n\n"
+		"Returns a dict with the number of @c collections so far, the number of objects @c collected, "
+		"the @c total_pause, @c max_pause and @c last_pause times in seconds, the cumulative number of "
+		"@c allocations, @c bytes_allocated and @c bytes_freed, the current @c heap size and the size at which the "
+		"@c next_collection will happen. Counts of objects and bytes are floats, as they can outgrow an int. "
+		"The dict under @c types counts objects in the heap by their "
+		"internal object type, and the dict under @c classes counts instances by class.");
+	KRK_DOC(BIND_FUNC(gcModule,get_objects),
+		"@brief Get a list of all objects tracked by the garbage collector.");
+	KRK_DOC(BIND_FUNC(gcModule,get_referrers),
+		"@brief Get a list of the objects that directly refer to any of the arguments.\n"
+		"@arguments *objs");
+
+	callbacksName = S("callbacks");
+	callbacksName->obj.flags |= KRK_OBJ_FLAGS_IMMORTAL;
+	krk_push(krk_list_of(0, NULL, 0));
+	krk_attachNamedValue(&gcModule->fields, "callbacks", krk_peek(0));
+	krk_pop();
 }
@@ -0,0 +1,468 @@
+/**
+ * @file    module__codecs.c
+ * @brief   Native lookup tables for the table-driven codecs in the codecs package.
+ *
+ * The single- and double-byte codecs in modules/codecs describe themselves
+ * with dicts mapping byte values (or tuples of byte values) to codepoints and
+ * back. Walking those dicts one character at a time in managed code is slow,
+ * so this module compiles them once into flat arrays and runs the common
+ * case - characters which map one-to-one without any state - in C.
+ *
+ * Anything the tables can not represent (unmapped characters, multi-codepoint
+ * mappings, three-byte sequences, truncated input) stops the native loop and
+ * is left to the managed implementation, which remains the reference for
+ * error handling.
+ *
+ * The generated data modules do not carry their maps as dicts, but packed into
+ * bytes by codecs.infrastructure.pack_map, so the tables can be built straight
+ * from those without the dicts ever being created. Each entry in a packed map
+ * is a byte giving the number of items in its key (high four bits) and value
+ * (low four bits), with 0 standing for a plain integer rather than a tuple,
+ * followed by the items of the key and then of the value. Byte values take one
+ * byte each and codepoints three, most significant first.
+ */
+#include <string.h>
+#include <stdlib.h>
+
+#include <kuroko/vm.h>
+#include <kuroko/util.h>
+
+/* Marks table slots that must be handled by the managed implementation. */
+#define SLOW_PATH 0xFFFFFFFF
+
+static KrkClass * DecodeTableClass = NULL;
+static KrkClass * EncodeTableClass = NULL;
+
+/**
+ * @brief Decoding table for a single- or double-byte codec.
+ * @extends KrkInstance
+ */
+struct DecodeTable {
+	KrkInstance inst;
+	uint32_t single[256];   /**< Codepoint for each byte when it stands alone */
+	uint8_t  lead[256];     /**< 1 for bytes starting a double-byte sequence, 2 for triple-byte */
+	uint32_t * rows[256];   /**< Codepoints for each trail byte, by lead byte */
+};
+
+struct EncodeEntry {
+	uint32_t codepoint;
+	uint8_t  length;        /**< 0 for codepoints that must be handled by the managed implementation */
+	uint8_t  bytes[3];
+};
+
+/**
+ * @brief Encoding table for a single- or double-byte codec.
+ * @extends KrkInstance
+ */
+struct EncodeTable {
+	KrkInstance inst;
+	uint8_t ascii[128];     /**< Set for ASCII characters which encode as themselves */
+	size_t count;
+	struct EncodeEntry * entries; /**< Sorted by codepoint */
+};
+
+#define IS_DecodeTable(o) (krk_isInstanceOf(o,DecodeTableClass))
+#define AS_DecodeTable(o) ((struct DecodeTable*)AS_OBJECT(o))
+#define IS_EncodeTable(o) (krk_isInstanceOf(o,EncodeTableClass))
+#define AS_EncodeTable(o) ((struct EncodeTable*)AS_OBJECT(o))
+
+static void _decodetable_gcsweep(KrkInstance * _self) {
+	struct DecodeTable * self = (struct DecodeTable*)_self;
+	for (int i = 0; i < 256; ++i) free(self->rows[i]);
+}
+
+static void _encodetable_gcsweep(KrkInstance * _self) {
+	struct EncodeTable * self = (struct EncodeTable*)_self;
+	free(self->entries);
+}
+
+static int _byteValue(KrkValue value) {
+	if (!IS_INTEGER(value) || AS_INTEGER(value) < 0 || AS_INTEGER(value) > 255) return -1;
+	return AS_INTEGER(value);
+}
+
+/** @brief One entry of a packed map; a count of 0 means a plain integer. */
+struct PackedEntry {
+	int keyCount;
+	int valueCount;
+	uint32_t key[15];
+	uint32_t value[15];
+};
+
+static int _unpackItems(KrkBytes * packed, size_t * offset, int count, int codepoints, uint32_t * out) {
+	size_t width = codepoints ? 3 : 1;
+	size_t items = count ? count : 1;
+	if (packed->length - *offset < width * items) return 0;
+	for (size_t i = 0; i < items; ++i) {
+		uint8_t * item = &packed->bytes[*offset];
+		out[i] = codepoints ? ((uint32_t)item[0] << 16) | (item[1] << 8) | item[2] : item[0];
+		*offset += width;
+	}
+	return 1;
+}
+
+/**
+ * @brief Read the entry of @p packed at @p offset and advance past it.
+ *
+ * Keys of decoding maps are bytes and their values codepoints; encoding maps
+ * are the other way around. Returns 0 if the entry is truncated.
+ */
+static int _unpackEntry(KrkBytes * packed, size_t * offset, int decoding, struct PackedEntry * entry) {
+	uint8_t shape = packed->bytes[(*offset)++];
+	entry->keyCount = shape >> 4;
+	entry->valueCount = shape & 0xF;
+	return _unpackItems(packed, offset, entry->keyCount, !decoding, entry->key) &&
+		_unpackItems(packed, offset, entry->valueCount, decoding, entry->value);
+}
+
+/* Returns the number of entries in @p packed, or -1 with an exception set if it is truncated. */
+static ssize_t _countPacked(KrkBytes * packed, int decoding) {
+	struct PackedEntry entry;
+	ssize_t count = 0;
+	for (size_t offset = 0; offset < packed->length; count++) {
+		if (!_unpackEntry(packed, &offset, decoding, &entry)) {
+			krk_runtimeError(vm.exceptions->valueError, "truncated packed map");
+			return -1;
+		}
+	}
+	return count;
+}
+
+static KrkValue _pair(KrkValue a, KrkValue b) {
+	krk_push(a);
+	krk_push(b);
+	KrkTuple * out = krk_newTuple(2);
+	out->values.values[out->values.count++] = krk_peek(1);
+	out->values.values[out->values.count++] = krk_peek(0);
+	krk_pop();
+	krk_pop();
+	return OBJECT_VAL(out);
+}
+
+static KrkValue _unpackedValue(int count, uint32_t * items) {
+	if (!count) return INTEGER_VAL(items[0]);
+	KrkTuple * out = krk_newTuple(count);
+	for (int i = 0; i < count; ++i) out->values.values[out->values.count++] = INTEGER_VAL(items[i]);
+	return OBJECT_VAL(out);
+}
+
+/* unpack_map(packed, decoding) -> dict */
+KRK_FUNC(unpack_map,{
+	FUNCTION_TAKES_EXACTLY(2);
+	CHECK_ARG(0,bytes,KrkBytes*,packed);
+	int decoding = !krk_isFalsey(argv[1]);
+	ssize_t count = _countPacked(packed, decoding);
+	if (count < 0) return NONE_VAL();
+
+	KrkValue out = krk_dict_of(0,NULL,0);
+	krk_push(out);
+	if (count) krk_tableAdjustCapacity(AS_DICT(out), count * 4 / 3 + 1);
+	struct PackedEntry entry;
+	for (size_t offset = 0; offset < packed->length;) {
+		_unpackEntry(packed, &offset, decoding, &entry);
+		krk_push(_unpackedValue(entry.keyCount, entry.key));
+		krk_push(_unpackedValue(entry.valueCount, entry.value));
+		krk_tableSet(AS_DICT(out), krk_peek(1), krk_peek(0));
+		krk_pop();
+		krk_pop();
+	}
+	return krk_pop();
+})
+
+#define CURRENT_CTYPE struct DecodeTable *
+#define CURRENT_NAME  self
+
+static void _decodePair(struct DecodeTable * self, int first, int second, uint32_t codepoint) {
+	if (!self->rows[first]) {
+		self->rows[first] = malloc(sizeof(uint32_t) * 256);
+		for (int j = 0; j < 256; ++j) self->rows[first][j] = SLOW_PATH;
+	}
+	self->rows[first][second] = codepoint;
+}
+
+KRK_METHOD(DecodeTable,__init__,{
+	METHOD_TAKES_EXACTLY(4);
+	if (!IS_BYTES(argv[1]) && !krk_isInstanceOf(argv[1], vm.baseClasses->dictClass)) return TYPE_ERROR(dict or bytes,argv[1]);
+	if (IS_BYTES(argv[1]) && _countPacked(AS_BYTES(argv[1]), 1) < 0) return NONE_VAL();
+	CHECK_ARG(2,bytes,KrkBytes*,dbrange);
+	CHECK_ARG(3,bytes,KrkBytes*,tbrange);
+	CHECK_ARG(4,bytes,KrkBytes*,asciiExceptions);
+
+	/* Start from scratch if this table is being initialized again. */
+	for (int i = 0; i < 256; ++i) {
+		free(self->rows[i]);
+		self->rows[i] = NULL;
+		self->single[i] = SLOW_PATH;
+		self->lead[i] = 0;
+	}
+	for (size_t i = 0; i < dbrange->length; ++i) self->lead[dbrange->bytes[i]] = 1;
+	for (size_t i = 0; i < tbrange->length; ++i) self->lead[tbrange->bytes[i]] = 2;
+
+	if (IS_BYTES(argv[1])) {
+		KrkBytes * packed = AS_BYTES(argv[1]);
+		struct PackedEntry entry;
+		for (size_t offset = 0; offset < packed->length;) {
+			_unpackEntry(packed, &offset, 1, &entry);
+			if (entry.valueCount) continue;
+			if (!entry.keyCount) self->single[entry.key[0]] = entry.value[0];
+			else if (entry.keyCount == 2) _decodePair(self, entry.key[0], entry.key[1], entry.value[0]);
+		}
+	} else {
+		KrkTable * map = AS_DICT(argv[1]);
+		for (size_t i = 0; i < map->capacity; ++i) {
+			KrkTableEntry * entry = &map->entries[i];
+			if (IS_KWARGS(entry->key) || !IS_INTEGER(entry->value)) continue;
+			uint32_t codepoint = AS_INTEGER(entry->value);
+			if (IS_INTEGER(entry->key)) {
+				int byte = _byteValue(entry->key);
+				if (byte >= 0) self->single[byte] = codepoint;
+			} else if (IS_TUPLE(entry->key) && AS_TUPLE(entry->key)->values.count == 2) {
+				int first = _byteValue(AS_TUPLE(entry->key)->values.values[0]);
+				int second = _byteValue(AS_TUPLE(entry->key)->values.values[1]);
+				if (first >= 0 && second >= 0) _decodePair(self, first, second, codepoint);
+			}
+		}
+	}
+
+	/* Plain ASCII takes priority over everything else, as in the managed decoder. */
+	uint8_t exceptions[0x80] = {0};
+	for (size_t i = 0; i < asciiExceptions->length; ++i) {
+		if (asciiExceptions->bytes[i] < 0x80) exceptions[asciiExceptions->bytes[i]] = 1;
+	}
+	for (int i = 0; i < 0x80; ++i) {
+		if (exceptions[i]) continue;
+		self->single[i] = i;
+		self->lead[i] = 0;
+	}
+
+	return argv[0];
+})
+
+/* DecodeTable.decode(data, offset) -> (str, stopped) */
+KRK_METHOD(DecodeTable,decode,{
+	METHOD_TAKES_EXACTLY(2);
+	CHECK_ARG(1,bytes,KrkBytes*,data);
+	CHECK_ARG(2,int,krk_integer_type,offset);
+	if (offset < 0 || (size_t)offset > data->length) return krk_runtimeError(vm.exceptions->indexError, "offset out of range");
+
+	struct StringBuilder sb = {0};
+	size_t i = offset;
+	while (i < data->length) {
+		uint8_t byte = data->bytes[i];
+		uint32_t codepoint;
+		if (self->lead[byte] == 1) {
+			if (i + 1 >= data->length || !self->rows[byte]) break;
+			codepoint = self->rows[byte][data->bytes[i+1]];
+			if (codepoint == SLOW_PATH) break;
+			i += 2;
+		} else if (self->lead[byte] == 2) {
+			break;
+		} else {
+			codepoint = self->single[byte];
+			if (codepoint == SLOW_PATH) break;
+			i += 1;
+		}
+		if (codepoint < 0x80) {
+			pushStringBuilder(&sb, codepoint);
+		} else {
+			unsigned char utf8[4];
+			size_t len = krk_codepointToBytes(codepoint, utf8);
+			pushStringBuilderStr(&sb, (char*)utf8, len);
+		}
+	}
+
+	return _pair(finishStringBuilder(&sb), INTEGER_VAL(i));
+})
+
+#undef CURRENT_CTYPE
+#define CURRENT_CTYPE struct EncodeTable *
+
+static int _compareEntries(const void * a, const void * b) {
+	uint32_t left = ((const struct EncodeEntry *)a)->codepoint;
+	uint32_t right = ((const struct EncodeEntry *)b)->codepoint;
+	return (left > right) - (left < right);
+}
+
+KRK_METHOD(EncodeTable,__init__,{
+	METHOD_TAKES_EXACTLY(2);
+	if (!IS_BYTES(argv[1]) && !krk_isInstanceOf(argv[1], vm.baseClasses->dictClass)) return TYPE_ERROR(dict or bytes,argv[1]);
+	ssize_t packedCount = IS_BYTES(argv[1]) ? _countPacked(AS_BYTES(argv[1]), 0) : 0;
+	if (packedCount < 0) return NONE_VAL();
+	CHECK_ARG(2,bytes,KrkBytes*,asciiExceptions);
+
+	for (int i = 0; i < 0x80; ++i) self->ascii[i] = 1;
+	for (size_t i = 0; i < asciiExceptions->length; ++i) {
+		if (asciiExceptions->bytes[i] < 0x80) self->ascii[asciiExceptions->bytes[i]] = 0;
+	}
+
+	free(self->entries);
+	self->count = 0;
+	if (IS_BYTES(argv[1])) {
+		KrkBytes * packed = AS_BYTES(argv[1]);
+		struct PackedEntry entry;
+		self->entries = malloc(sizeof(struct EncodeEntry) * (packedCount ? packedCount : 1));
+		for (size_t offset = 0; offset < packed->length;) {
+			_unpackEntry(packed, &offset, 0, &entry);
+			struct EncodeEntry * out = &self->entries[self->count++];
+			out->codepoint = entry.key[0];
+			out->length = 0;
+			/* As with dicts, sequences are left to the managed implementation. */
+			if (entry.keyCount || entry.valueCount > 3) continue;
+			out->length = entry.valueCount ? entry.valueCount : 1;
+			for (int j = 0; j < out->length; ++j) out->bytes[j] = entry.value[j];
+		}
+	} else {
+		KrkTable * map = AS_DICT(argv[1]);
+		self->entries = malloc(sizeof(struct EncodeEntry) * (map->count ? map->count : 1));
+		for (size_t i = 0; i < map->capacity; ++i) {
+			KrkTableEntry * entry = &map->entries[i];
+			if (IS_KWARGS(entry->key)) continue;
+			struct EncodeEntry * out = &self->entries[self->count];
+			out->length = 0;
+			if (IS_INTEGER(entry->key)) {
+				out->codepoint = AS_INTEGER(entry->key);
+				int byte = _byteValue(entry->value);
+				if (byte >= 0) {
+					out->length = 1;
+					out->bytes[0] = byte;
+				} else if (IS_TUPLE(entry->value) && AS_TUPLE(entry->value)->values.count <= 3) {
+					KrkTuple * value = AS_TUPLE(entry->value);
+					for (size_t j = 0; j < value->values.count; ++j) {
+						int byte = _byteValue(value->values.values[j]);
+						if (byte < 0) {
+							out->length = 0;
+							break;
+						}
+						out->bytes[out->length++] = byte;
+					}
+				}
+			} else if (IS_TUPLE(entry->key) && AS_TUPLE(entry->key)->values.count && IS_INTEGER(AS_TUPLE(entry->key)->values.values[0])) {
+				/* Multi-codepoint sequence; its first codepoint always needs a closer look. */
+				out->codepoint = AS_INTEGER(AS_TUPLE(entry->key)->values.values[0]);
+			} else {
+				continue;
+			}
+			self->count++;
+		}
+	}
+
+	qsort(self->entries, self->count, sizeof(struct EncodeEntry), _compareEntries);
+
+	/* Sequences mark their leading codepoint for the slow path, even if it also maps alone. */
+	size_t out = 0;
+	for (size_t i = 0; i < self->count; ++i) {
+		if (out && self->entries[out-1].codepoint == self->entries[i].codepoint) {
+			if (!self->entries[i].length) self->entries[out-1].length = 0;
+			continue;
+		}
+		self->entries[out++] = self->entries[i];
+	}
+	self->count = out;
+
+	for (size_t i = 0; i < self->count && self->entries[i].codepoint < 0x80; ++i) {
+		if (!self->entries[i].length) self->ascii[self->entries[i].codepoint] = 0;
+	}
+
+	return argv[0];
+})
+
+static struct EncodeEntry * _findEntry(struct EncodeTable * self, uint32_t codepoint) {
+	size_t low = 0, high = self->count;
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		if (self->entries[mid].codepoint == codepoint) return &self->entries[mid];
+		if (self->entries[mid].codepoint < codepoint) low = mid + 1;
+		else high = mid;
+	}
+	return NULL;
+}
+
+/* EncodeTable.encode(string, offset) -> (bytes, stopped) */
+KRK_METHOD(EncodeTable,encode,{
+	METHOD_TAKES_EXACTLY(2);
+	CHECK_ARG(1,str,KrkString*,string);
+	CHECK_ARG(2,int,krk_integer_type,offset);
+	if (offset < 0 || (size_t)offset > string->codesLength) return krk_runtimeError(vm.exceptions->indexError, "offset out of range");
+
+	struct StringBuilder sb = {0};
+	size_t i = offset;
+	size_t byteOffset = krk_unicodeOffset(string, offset);
+	while (i < string->codesLength) {
+		unsigned char c = string->chars[byteOffset];
+		uint32_t codepoint;
+		size_t width;
+		if (c < 0x80) {
+			codepoint = c;
+			width = 1;
+		} else if (c < 0xE0) {
+			codepoint = ((c & 0x1F) << 6) | (string->chars[byteOffset+1] & 0x3F);
+			width = 2;
+		} else if (c < 0xF0) {
+			codepoint = ((c & 0x0F) << 12) | ((string->chars[byteOffset+1] & 0x3F) << 6) | (string->chars[byteOffset+2] & 0x3F);
+			width = 3;
+		} else {
+			codepoint = ((c & 0x07) << 18) | ((string->chars[byteOffset+1] & 0x3F) << 12) |
+				((string->chars[byteOffset+2] & 0x3F) << 6) | (string->chars[byteOffset+3] & 0x3F);
+			width = 4;
+		}
+		if (codepoint < 0x80 && self->ascii[codepoint]) {
+			pushStringBuilder(&sb, codepoint);
+		} else {
+			struct EncodeEntry * entry = _findEntry(self, codepoint);
+			if (!entry || !entry->length) break;
+			pushStringBuilderStr(&sb, (char*)entry->bytes, entry->length);
+		}
+		byteOffset += width;
+		i++;
+	}
+
+	return _pair(finishStringBuilderBytes(&sb), INTEGER_VAL(i));
+})
+
+KrkValue krk_module_onload__codecs(void) {
+	KrkInstance * module = krk_newInstance(vm.baseClasses->moduleClass);
+	krk_push(OBJECT_VAL(module));
+
+	KRK_DOC(module, "@brief Native lookup tables for the table-driven codecs in the codecs package.");
+
+	KRK_DOC(BIND_FUNC(module,unpack_map),
+		"@brief Rebuild a map packed by @c codecs.infrastructure.pack_map.\n"
+		"@arguments packed,decoding\n\n"
+		"Returns the decoding map if @p decoding is true, or otherwise the encoding map, as a @ref dict.");
+
+	KrkClass * DecodeTable = krk_makeClass(module, &DecodeTableClass, "DecodeTable", vm.baseClasses->objectClass);
+	DecodeTableClass->allocSize = sizeof(struct DecodeTable);
+	DecodeTableClass->_ongcsweep = _decodetable_gcsweep;
+	KRK_DOC(DecodeTable,
+		"@brief Compiled decoding map for a single- or double-byte codec.\n"
+		"@arguments decoding_map,dbrange,tbrange,ascii_exceptions\n\n"
+		"@p decoding_map must be a @ref dict of byte values and pairs of byte values to codepoints, "
+		"or the same packed into @ref bytes by @c codecs.infrastructure.pack_map. "
+		"@p dbrange, @p tbrange and @p ascii_exceptions are @ref bytes listing lead bytes of double- and "
+		"triple-byte sequences, and ASCII bytes which do not decode to themselves.");
+	BIND_METHOD(DecodeTable,__init__);
+	KRK_DOC(BIND_METHOD(DecodeTable,decode),
+		"@brief Decode as much of @p data as possible, starting at @p offset.\n"
+		"@arguments data,offset\n\n"
+		"Returns a tuple of the decoded string and the offset of the first byte that was not decoded, "
+		"which must be handled by the caller.");
+	krk_finalizeClass(DecodeTableClass);
+
+	KrkClass * EncodeTable = krk_makeClass(module, &EncodeTableClass, "EncodeTable", vm.baseClasses->objectClass);
+	EncodeTableClass->allocSize = sizeof(struct EncodeTable);
+	EncodeTableClass->_ongcsweep = _encodetable_gcsweep;
+	KRK_DOC(EncodeTable,
+		"@brief Compiled encoding map for a single- or double-byte codec.\n"
+		"@arguments encoding_map,ascii_exceptions\n\n"
+		"@p encoding_map must be a @ref dict of codepoints to byte values or tuples of byte values, "
+		"or the same packed into @ref bytes by @c codecs.infrastructure.pack_map.");
+	BIND_METHOD(EncodeTable,__init__);
+	KRK_DOC(BIND_METHOD(EncodeTable,encode),
+		"@brief Encode as much of @p string as possible, starting at codepoint @p offset.\n"
+		"@arguments string,offset\n\n"
+		"Returns a tuple of the encoded bytes and the index of the first codepoint that was not encoded, "
+		"which must be handled by the caller.");
+	krk_finalizeClass(EncodeTableClass);
+
+	return krk_pop();
+}
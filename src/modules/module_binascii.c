@@ -0,0 +1,292 @@
+/**
+ * @file    module_binascii.c
+ * @brief   Conversions between binary data and ASCII encodings of it.
+ *
+ * Provides Base64, hexadecimal and CRC-32 over @ref bytes. The conversions are
+ * table-driven and work on whole groups of input at a time; the tables are
+ * built once, when the module is loaded.
+ */
+#include <string.h>
+#include <stdlib.h>
+
+#include <kuroko/vm.h>
+#include <kuroko/value.h>
+#include <kuroko/object.h>
+#include <kuroko/util.h>
+
+static KrkClass * BinasciiError = NULL;
+
+static const char _base64Alphabet[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* Pairs of Base64 digits for every 12-bit group, so each 3-byte chunk takes two lookups. */
+static uint16_t _base64Pairs[4096];
+
+#define B64_INVALID    0xFF
+#define B64_PAD        0xFD
+static uint8_t _base64Values[256];
+
+/* Two hexadecimal digits for every byte value. */
+static uint16_t _hexPairs[256];
+static int8_t _hexValues[256];
+
+/* Slice-by-8 CRC-32 tables for the reflected polynomial 0xEDB88320. */
+static uint32_t _crcTables[8][256];
+
+static void _buildTables(void) {
+	for (int i = 0; i < 4096; ++i) {
+		char pair[2] = {_base64Alphabet[i >> 6], _base64Alphabet[i & 0x3F]};
+		memcpy(&_base64Pairs[i], pair, 2);
+	}
+
+	memset(_base64Values, B64_INVALID, sizeof(_base64Values));
+	for (int i = 0; i < 64; ++i) _base64Values[(unsigned char)_base64Alphabet[i]] = i;
+	_base64Values['='] = B64_PAD;
+
+	memset(_hexValues, -1, sizeof(_hexValues));
+	for (int i = 0; i < 256; ++i) {
+		char pair[2] = {"0123456789abcdef"[i >> 4], "0123456789abcdef"[i & 0xF]};
+		memcpy(&_hexPairs[i], pair, 2);
+	}
+	for (int i = 0; i < 10; ++i) _hexValues['0' + i] = i;
+	for (int i = 0; i < 6; ++i) {
+		_hexValues['a' + i] = 10 + i;
+		_hexValues['A' + i] = 10 + i;
+	}
+
+	for (uint32_t i = 0; i < 256; ++i) {
+		uint32_t crc = i;
+		for (int j = 0; j < 8; ++j) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+		_crcTables[0][i] = crc;
+	}
+	for (int i = 0; i < 256; ++i) {
+		for (int j = 1; j < 8; ++j) {
+			_crcTables[j][i] = (_crcTables[j-1][i] >> 8) ^ _crcTables[0][_crcTables[j-1][i] & 0xFF];
+		}
+	}
+}
+
+/* The a2b_ functions accept either ASCII strings or bytes. */
+static int _asciiData(KrkValue value, const uint8_t ** data, size_t * length) {
+	if (IS_BYTES(value)) {
+		*data = AS_BYTES(value)->bytes;
+		*length = AS_BYTES(value)->length;
+		return 1;
+	} else if (IS_STRING(value)) {
+		if (AS_STRING(value)->type != KRK_STRING_ASCII) {
+			krk_runtimeError(vm.exceptions->valueError, "string argument should contain only ASCII characters");
+			return 0;
+		}
+		*data = (const uint8_t*)AS_CSTRING(value);
+		*length = AS_STRING(value)->length;
+		return 1;
+	}
+	krk_runtimeError(vm.exceptions->typeError, "argument should be bytes or ASCII string, not '%s'", krk_typeName(value));
+	return 0;
+}
+
+static const char * const b2a_base64Args[] = {"data", "newline"};
+KRK_FUNC(b2a_base64,{
+	KrkBytes * data;
+	int newline = 1;
+	if (!krk_parseArgs("y|$p", b2a_base64Args, &data, &newline)) return NONE_VAL();
+
+	size_t length = (data->length + 2) / 3 * 4 + newline;
+	uint8_t * out = malloc(length ? length : 1);
+	uint8_t * o = out;
+	const uint8_t * c = data->bytes;
+	const uint8_t * end = data->bytes + data->length / 3 * 3;
+	while (c < end) {
+		uint32_t group = (c[0] << 16) | (c[1] << 8) | c[2];
+		memcpy(o, &_base64Pairs[group >> 12], 2);
+		memcpy(o + 2, &_base64Pairs[group & 0xFFF], 2);
+		c += 3;
+		o += 4;
+	}
+	size_t rest = data->length - (c - data->bytes);
+	if (rest) {
+		uint32_t group = (c[0] << 16) | (rest > 1 ? c[1] << 8 : 0);
+		*o++ = _base64Alphabet[group >> 18];
+		*o++ = _base64Alphabet[(group >> 12) & 0x3F];
+		*o++ = rest > 1 ? _base64Alphabet[(group >> 6) & 0x3F] : '=';
+		*o++ = '=';
+	}
+	if (newline) *o++ = '\n';
+
+	KrkBytes * result = krk_newBytes(length, out);
+	free(out);
+	return OBJECT_VAL(result);
+})
+
+#define BASE64_ERROR(...) do { free(out); return krk_runtimeError(BinasciiError, __VA_ARGS__); } while (0)
+
+static const char * const a2b_base64Args[] = {"data", "strict_mode"};
+KRK_FUNC(a2b_base64,{
+	KrkValue input;
+	int strict = 0;
+	if (!krk_parseArgs("O|$p", a2b_base64Args, &input, &strict)) return NONE_VAL();
+	const uint8_t * data;
+	size_t length;
+	if (!_asciiData(input, &data, &length)) return NONE_VAL();
+
+	/* Follows CPython: unless strict, other characters are skipped and a complete pad ends the data. */
+	uint8_t * out = malloc(length / 4 * 3 + 3);
+	size_t written = 0;
+	uint32_t group = 0;
+	int digits = 0;
+	int pads = 0;
+	int paddingStarted = 0;
+	for (size_t i = 0; i < length; ++i) {
+		/* Whole groups of four digits are the common case. */
+		if (!digits && !paddingStarted && i + 4 <= length) {
+			uint32_t a = _base64Values[data[i]], b = _base64Values[data[i+1]],
+			         c = _base64Values[data[i+2]], d = _base64Values[data[i+3]];
+			if ((a | b | c | d) < 64) {
+				uint32_t whole = (a << 18) | (b << 12) | (c << 6) | d;
+				out[written++] = whole >> 16;
+				out[written++] = whole >> 8;
+				out[written++] = whole;
+				i += 3;
+				continue;
+			}
+		}
+
+		uint8_t value = _base64Values[data[i]];
+		if (value == B64_PAD) {
+			paddingStarted = 1;
+			if (strict && !i) BASE64_ERROR("Leading padding not allowed");
+			if (digits >= 2 && digits + ++pads >= 4) {
+				if (strict && i + 1 < length) BASE64_ERROR("Excess data after padding");
+				if (digits == 2) {
+					out[written++] = group >> 4;
+				} else {
+					out[written++] = group >> 10;
+					out[written++] = group >> 2;
+				}
+				group = digits = 0;
+				break;
+			}
+			continue;
+		}
+		if (value >= 64) {
+			if (strict) BASE64_ERROR("Only base64 data is allowed");
+			continue;
+		}
+		if (strict && paddingStarted) BASE64_ERROR("Discontinuous padding not allowed");
+		pads = 0;
+		group = (group << 6) | value;
+		if (++digits == 4) {
+			out[written++] = group >> 16;
+			out[written++] = group >> 8;
+			out[written++] = group;
+			group = digits = 0;
+		}
+	}
+	if (digits == 1) {
+		BASE64_ERROR("Invalid base64-encoded string: number of data characters (%zu) cannot be 1 more than a multiple of 4",
+			written / 3 * 4 + 1);
+	} else if (digits) {
+		BASE64_ERROR("Incorrect padding");
+	}
+
+	KrkBytes * result = krk_newBytes(written, out);
+	free(out);
+	return OBJECT_VAL(result);
+})
+
+#undef BASE64_ERROR
+
+KRK_FUNC(hexlify,{
+	FUNCTION_TAKES_EXACTLY(1);
+	CHECK_ARG(0,bytes,KrkBytes*,data);
+	uint8_t * out = malloc(data->length * 2 + 1);
+	for (size_t i = 0; i < data->length; ++i) memcpy(&out[i*2], &_hexPairs[data->bytes[i]], 2);
+	KrkBytes * result = krk_newBytes(data->length * 2, out);
+	free(out);
+	return OBJECT_VAL(result);
+})
+
+KRK_FUNC(unhexlify,{
+	FUNCTION_TAKES_EXACTLY(1);
+	const uint8_t * data;
+	size_t length;
+	if (!_asciiData(argv[0], &data, &length)) return NONE_VAL();
+	if (length & 1) return krk_runtimeError(BinasciiError, "Odd-length string");
+
+	uint8_t * out = malloc(length / 2 + 1);
+	for (size_t i = 0; i < length / 2; ++i) {
+		int high = _hexValues[data[i*2]];
+		int low = _hexValues[data[i*2+1]];
+		if (high < 0 || low < 0) {
+			free(out);
+			return krk_runtimeError(BinasciiError, "Non-hexadecimal digit found");
+		}
+		out[i] = (high << 4) | low;
+	}
+	KrkBytes * result = krk_newBytes(length / 2, out);
+	free(out);
+	return OBJECT_VAL(result);
+})
+
+static const char * const crc32Args[] = {"data", "value"};
+KRK_FUNC(crc32,{
+	KrkBytes * data;
+	krk_integer_type value = 0;
+	if (!krk_parseArgs("y|i", crc32Args, &data, &value)) return NONE_VAL();
+
+	uint32_t crc = ~(uint32_t)value;
+	const uint8_t * c = data->bytes;
+	size_t length = data->length;
+	while (length >= 8) {
+		uint32_t low = crc ^ ((uint32_t)c[0] | ((uint32_t)c[1] << 8) | ((uint32_t)c[2] << 16) | ((uint32_t)c[3] << 24));
+		uint32_t high = (uint32_t)c[4] | ((uint32_t)c[5] << 8) | ((uint32_t)c[6] << 16) | ((uint32_t)c[7] << 24);
+		crc = _crcTables[7][low & 0xFF] ^ _crcTables[6][(low >> 8) & 0xFF] ^
+		      _crcTables[5][(low >> 16) & 0xFF] ^ _crcTables[4][low >> 24] ^
+		      _crcTables[3][high & 0xFF] ^ _crcTables[2][(high >> 8) & 0xFF] ^
+		      _crcTables[1][(high >> 16) & 0xFF] ^ _crcTables[0][high >> 24];
+		c += 8;
+		length -= 8;
+	}
+	while (length--) crc = (crc >> 8) ^ _crcTables[0][(crc ^ *c++) & 0xFF];
+
+	return INTEGER_VAL((krk_integer_type)(uint32_t)~crc);
+})
+
+KrkValue krk_module_onload_binascii(void) {
+	KrkInstance * module = krk_newInstance(vm.baseClasses->moduleClass);
+	krk_push(OBJECT_VAL(module));
+
+	KRK_DOC(module, "@brief Conversions between binary data and ASCII encodings of it.");
+
+	_buildTables();
+
+	krk_makeClass(module, &BinasciiError, "Error", vm.exceptions->valueError);
+	KRK_DOC(BinasciiError, "Raised when data can not be decoded.");
+	krk_finalizeClass(BinasciiError);
+
+	KRK_DOC(BIND_FUNC(module,b2a_base64),
+		"@brief Encode @p data as Base64.\n"
+		"@arguments data,newline=True\n\n"
+		"Returns @ref bytes, with a trailing line feed unless @p newline is false.");
+	KRK_DOC(BIND_FUNC(module,a2b_base64),
+		"@brief Decode Base64 @p data, which may be @ref bytes or an ASCII @ref str.\n"
+		"@arguments data,*,strict_mode=False\n\n"
+		"Characters outside the alphabet are skipped, and decoding stops at the padding that completes a group, "
+		"as in CPython. With @p strict_mode, those characters, data after the padding, and misplaced padding raise "
+		"@ref Error. Incomplete groups raise @ref Error in either mode.");
+	KRK_DOC(BIND_FUNC(module,hexlify),
+		"@brief Encode @p data as hexadecimal digits, two for each byte.\n"
+		"@arguments data");
+	KRK_DOC(BIND_FUNC(module,unhexlify),
+		"@brief Decode a sequence of hexadecimal digits, which may be @ref bytes or an ASCII @ref str.\n"
+		"@arguments data");
+	KRK_DOC(BIND_FUNC(module,crc32),
+		"@brief Compute the CRC-32 of @p data.\n"
+		"@arguments data,value=0\n\n"
+		"To checksum data in pieces, pass the result for the previous piece as @p value. "
+		"As @ref int is 32 bits wide, checksums with the high bit set are returned as negative values.");
+	krk_defineNative(&module->fields, "b2a_hex", _krk_hexlify);
+	krk_defineNative(&module->fields, "a2b_hex", _krk_unhexlify);
+
+	return krk_pop();
+}
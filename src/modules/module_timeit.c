@@ -1,3 +1,12 @@
+/**
+ * @file    module_timeit.c
+ * @brief   Timing of repeated calls without the loop overhead of the interpreter.
+ *
+ * Calls are timed with the highest-resolution monotonic clock available. The
+ * cost of each call can be calibrated out by subtracting the time taken by the
+ * same number of calls to an empty function, which is compiled when the module
+ * is loaded.
+ */
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
@@ -10,37 +19,150 @@
 #include <kuroko/value.h>
 #include <kuroko/object.h>
 #include <kuroko/util.h>
+#include <kuroko/compiler.h>
 
-KRK_FUNC(timeit,{
-	KrkValue number;
-	int times = 1000000;
-	if (hasKw && krk_tableGet_fast(AS_DICT(argv[argc]), S("number"), &number)) {
-		if (!IS_INTEGER(number)) return TYPE_ERROR(int,number);
-		times = AS_INTEGER(number);
-	}
+#ifdef CLOCK_MONOTONIC_RAW
+# define PERF_CLOCK CLOCK_MONOTONIC_RAW
+#else
+# define PERF_CLOCK CLOCK_MONOTONIC
+#endif
+
+static KrkInstance * module = NULL;
 
-	struct timeval tv_before, tv_after;
-	gettimeofday(&tv_before,NULL);
-	for (krk_integer_type t = 0; t < times; ++t) {
-		krk_push(argv[0]);
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(PERF_CLOCK, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
+/**
+ * Call @p callable @p number times and store the elapsed seconds.
+ * Returns 0 if a call raised an exception.
+ */
+static int timeCalls(KrkValue callable, krk_integer_type number, double * elapsed) {
+	double before = now();
+	for (krk_integer_type t = 0; t < number; ++t) {
+		krk_push(callable);
 		krk_callStack(0);
+		if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return 0;
+	}
+	*elapsed = now() - before;
+	return 1;
+}
+
+/**
+ * Time @p number calls of @p callable, less the same number of calls to
+ * the empty function if @p calibrate is set.
+ */
+static int measure(KrkValue callable, krk_integer_type number, int calibrate, double * elapsed) {
+	if (!timeCalls(callable, number, elapsed)) return 0;
+	if (calibrate) {
+		KrkValue empty;
+		double overhead;
+		if (!krk_tableGet_fast(&module->fields, S("_empty"), &empty)) {
+			krk_runtimeError(vm.exceptions->valueError, "calibration function is missing");
+			return 0;
+		}
+		if (!timeCalls(empty, number, &overhead)) return 0;
+		*elapsed = *elapsed > overhead ? *elapsed - overhead : 0.0;
 	}
-	gettimeofday(&tv_after,NULL);
+	return 1;
+}
 
-	double before = (double)tv_before.tv_sec + (double)tv_before.tv_usec / 1000000.0;
-	double after = (double)tv_after.tv_sec + (double)tv_after.tv_usec / 1000000.0;
+static const char * const timeitArgs[] = {"callable", "number", "calibrate"};
+KRK_FUNC(timeit,{
+	KrkValue callable;
+	krk_integer_type number = 1000000;
+	int calibrate = 0;
+	if (!krk_parseArgs("O|$ip", timeitArgs, &callable, &number, &calibrate)) return NONE_VAL();
 
-	return FLOATING_VAL(after-before);
+	double elapsed;
+	if (!measure(callable, number, calibrate, &elapsed)) return NONE_VAL();
+	return FLOATING_VAL(elapsed);
 })
 
+static const char * const repeatArgs[] = {"callable", "repeat", "number", "calibrate"};
+KRK_FUNC(repeat,{
+	KrkValue callable;
+	krk_integer_type repeat = 5;
+	krk_integer_type number = 1000000;
+	int calibrate = 0;
+	if (!krk_parseArgs("O|$iip", repeatArgs, &callable, &repeat, &number, &calibrate)) return NONE_VAL();
+	if (repeat < 1) return krk_runtimeError(vm.exceptions->valueError, "repeat must be positive");
+
+	KrkValue result = krk_list_of(0, NULL, 0);
+	krk_push(result);
+	for (krk_integer_type r = 0; r < repeat; ++r) {
+		double elapsed;
+		if (!measure(callable, number, calibrate, &elapsed)) return NONE_VAL();
+		krk_writeValueArray(AS_LIST(result), FLOATING_VAL(elapsed));
+	}
+	return krk_pop();
+})
+
+static const char * const autorangeArgs[] = {"callable", "target"};
+KRK_FUNC(autorange,{
+	KrkValue callable;
+	double target = 0.2;
+	if (!krk_parseArgs("O|d", autorangeArgs, &callable, &target)) return NONE_VAL();
+
+	/* Try 1, 2, 5, 10, 20, 50, ... calls until they take at least the target time. */
+	krk_integer_type number = 1;
+	double elapsed;
+	for (;;) {
+		for (int step = 0; step < 3; ++step) {
+			krk_integer_type count = number * (step == 0 ? 1 : step == 1 ? 2 : 5);
+			if (!timeCalls(callable, count, &elapsed)) return NONE_VAL();
+			if (elapsed >= target || count >= 500000000) {
+				KrkTuple * result = krk_newTuple(2);
+				result->values.values[result->values.count++] = INTEGER_VAL(count);
+				result->values.values[result->values.count++] = FLOATING_VAL(elapsed);
+				return OBJECT_VAL(result);
+			}
+		}
+		number *= 10;
+	}
+})
+
+/* The calibration baseline is a managed function, so it is called the same way as the functions being timed. */
+static void defineEmptyFunction(void) {
+	KrkInstance * previous = krk_currentThread.module;
+	krk_currentThread.module = module;
+	KrkCodeObject * code = krk_compile("def _empty():\n    pass\n", "<timeit>");
+	if (code) {
+		krk_push(OBJECT_VAL(code));
+		KrkClosure * closure = krk_newClosure(code);
+		krk_pop();
+		krk_push(OBJECT_VAL(closure));
+		krk_callStack(0);
+	}
+	krk_currentThread.module = previous;
+}
+
 KrkValue krk_module_onload_timeit(void) {
-	KrkInstance * module = krk_newInstance(vm.baseClasses->moduleClass);
+	module = krk_newInstance(vm.baseClasses->moduleClass);
 	krk_push(OBJECT_VAL(module));
 
 	KRK_DOC(module, "@brief Run functions very quickly without loop overhead from the interpreter.");
 
-	BIND_FUNC(module,timeit);
+	KRK_DOC(BIND_FUNC(module,timeit),
+		"@brief Time calls to @p callable.\n"
+		"@arguments callable,number=1000000,calibrate=False\n\n"
+		"Returns the seconds taken by @p number calls of @p callable with no arguments. "
+		"If @p calibrate is set, the time taken by the same number of calls to an empty function "
+		"is subtracted, leaving an estimate of the time spent in @p callable itself.");
+	KRK_DOC(BIND_FUNC(module,repeat),
+		"@brief Time calls to @p callable several times.\n"
+		"@arguments callable,repeat=5,number=1000000,calibrate=False\n\n"
+		"Returns a list of @p repeat results of @ref timeit. The minimum is usually the most "
+		"useful figure, as higher results are caused by interference from other processes.");
+	KRK_DOC(BIND_FUNC(module,autorange),
+		"@brief Find a number of calls to @p callable that takes long enough to time.\n"
+		"@arguments callable,target=0.2\n\n"
+		"Tries 1, 2, 5, 10, 20, 50, ... calls until they take at least @p target seconds, "
+		"and returns a tuple of the number of calls and the seconds they took.");
+
+	defineEmptyFunction();
 
-	krk_pop();
-	return OBJECT_VAL(module);
+	return krk_pop();
 }
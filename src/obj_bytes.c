@@ -4,6 +4,8 @@
 #include <kuroko/memory.h>
 #include <kuroko/util.h>
 
+#include "private.h"
+
 #define AS_bytes(o) AS_BYTES(o)
 #define CURRENT_CTYPE KrkBytes *
 #define CURRENT_NAME  self
@@ -133,9 +135,94 @@ KRK_METHOD(bytes,__contains__,{
 	return krk_runtimeError(vm.exceptions->notImplementedError, "not implemented");
 })
 
+/* bytes.decode(encoding='utf-8') */
 KRK_METHOD(bytes,decode,{
+	METHOD_TAKES_AT_MOST(1);
+	KrkEncoding encoding = KRK_ENCODING_UTF8;
+	if (argc > 1) {
+		CHECK_ARG(1,str,KrkString*,name);
+		encoding = _encodingFromName(name->chars);
+		if (encoding == KRK_ENCODING_UNKNOWN) return krk_runtimeError(vm.exceptions->valueError, "unsupported encoding '%s'", name->chars);
+	}
+	size_t ascii = encoding == KRK_ENCODING_UTF8 ? self->length : _asciiPrefix(self->bytes, self->length);
+	if (ascii == self->length) {
+		return OBJECT_VAL(krk_copyString((char*)self->bytes, self->length));
+	} else {
+		/* Every byte is a codepoint; those beyond ASCII take two bytes in UTF-8. */
+		size_t length = self->length;
+		for (size_t i = ascii; i < self->length; ++i) length += self->bytes[i] >> 7;
+		char * chars = ALLOCATE(char, length + 1);
+		memcpy(chars, self->bytes, ascii);
+		char * o = chars + ascii;
+		const uint8_t * c = self->bytes + ascii;
+		const uint8_t * end = self->bytes + self->length;
+		while (c < end) {
+			if (*c < 0x80) {
+				size_t run = _asciiPrefix(c, end - c);
+				memcpy(o, c, run);
+				o += run;
+				c += run;
+			} else {
+				*o++ = 0xC0 | (*c >> 6);
+				*o++ = 0x80 | (*c & 0x3F);
+				c++;
+			}
+		}
+		chars[length] = '\0';
+		return OBJECT_VAL(krk_takeString(chars, length));
+	}
+})
+
+KRK_METHOD(bytes,hex,{
 	METHOD_TAKES_NONE();
-	return OBJECT_VAL(krk_copyString((char*)AS_BYTES(argv[0])->bytes, AS_BYTES(argv[0])->length));
+	static const char digits[] = "0123456789abcdef";
+	size_t length = self->length * 2;
+	char * chars = ALLOCATE(char, length + 1);
+	for (size_t i = 0; i < self->length; ++i) {
+		chars[i*2]   = digits[self->bytes[i] >> 4];
+		chars[i*2+1] = digits[self->bytes[i] & 0xF];
+	}
+	chars[length] = '\0';
+	return OBJECT_VAL(krk_takeString(chars, length));
+})
+
+static int _hexValue(int c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static int _isHexSpace(int c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/* Called on the class; whitespace is allowed between pairs of digits. */
+KRK_FUNC(fromhex,{
+	METHOD_TAKES_EXACTLY(1);
+	CHECK_ARG(1,str,KrkString*,string);
+	struct StringBuilder sb = {0};
+	size_t i = 0;
+	while (i < string->length) {
+		if (_isHexSpace(string->chars[i])) {
+			i++;
+			continue;
+		}
+		int high = _hexValue(string->chars[i]);
+		int low = i + 1 < string->length ? _hexValue(string->chars[i+1]) : -1;
+		if (high < 0 || low < 0) {
+			/* Report the position in characters, not bytes, by skipping UTF-8 continuation bytes. */
+			size_t end = high < 0 ? i : i + 1;
+			size_t position = 0;
+			for (size_t j = 0; j < end; ++j) position += (string->chars[j] & 0xC0) != 0x80;
+			discardStringBuilder(&sb);
+			return krk_runtimeError(vm.exceptions->valueError,
+				"non-hexadecimal number found in fromhex() arg at position %zu", position);
+		}
+		pushStringBuilder(&sb, (high << 4) | low);
+		i += 2;
+	}
+	return finishStringBuilderBytes(&sb);
 })
 
 #define unpackArray(counter, indexer) do { \
@@ -190,39 +277,47 @@ KRK_METHOD(bytes,__iter__,{
 	return OBJECT_VAL(output);
 })
 
+/**
+ * @brief Iterator over the values in a bytes object.
+ * @extends KrkInstance
+ */
+struct BytesIterator {
+	KrkInstance inst;
+	KrkValue b;
+	size_t i;
+};
+
 #undef CURRENT_CTYPE
-#define CURRENT_CTYPE KrkInstance *
+#define CURRENT_CTYPE struct BytesIterator *
+
+static void _bytesiterator_gcscan(KrkInstance * self) {
+	krk_markValue(((struct BytesIterator*)self)->b);
+}
+
+static int _bytesiterator_iternext(KrkInstance * _self, KrkValue * value) {
+	struct BytesIterator * self = (struct BytesIterator*)_self;
+	if (!IS_BYTES(self->b)) {
+		*value = krk_runtimeError(vm.exceptions->typeError, "Corrupt bytes iterator: no bytes pointer");
+		return 1;
+	}
+	if (self->i >= AS_BYTES(self->b)->length) return 0;
+	*value = INTEGER_VAL(AS_BYTES(self->b)->bytes[self->i++]);
+	return 1;
+}
+
 KRK_METHOD(bytesiterator,__init__,{
 	METHOD_TAKES_EXACTLY(1);
 	CHECK_ARG(1,bytes,KrkBytes*,base);
-	krk_push(OBJECT_VAL(self));
-	krk_attachNamedObject(&self->fields, "s", (KrkObj*)base);
-	krk_attachNamedValue(&self->fields, "i", INTEGER_VAL(0));
-	return krk_pop();
+	self->b = argv[1];
+	self->i = 0;
+	return argv[0];
 })
 
 KRK_METHOD(bytesiterator,__call__,{
 	METHOD_TAKES_NONE();
-	KrkValue _bytes;
-	KrkValue _counter;
-	const char * errorStr = NULL;
-	if (!krk_tableGet(&self->fields, OBJECT_VAL(S("s")), &_bytes)) {
-		errorStr = "no str pointer";
-		goto _corrupt;
-	}
-	if (!krk_tableGet(&self->fields, OBJECT_VAL(S("i")), &_counter)) {
-		errorStr = "no index";
-		goto _corrupt;
-	}
-
-	if ((size_t)AS_INTEGER(_counter) >= AS_BYTES(_bytes)->length) {
-		return argv[0];
-	} else {
-		krk_attachNamedValue(&self->fields, "i", INTEGER_VAL(AS_INTEGER(_counter)+1));
-		return INTEGER_VAL(AS_BYTES(_bytes)->bytes[AS_INTEGER(_counter)]);
-	}
-_corrupt:
-	return krk_runtimeError(vm.exceptions->typeError, "Corrupt bytes iterator: %s", errorStr);
+	KrkValue value;
+	if (!_bytesiterator_iternext((KrkInstance*)self, &value)) return argv[0];
+	return value;
 })
 
 _noexport
@@ -243,10 +338,21 @@ void _createAndBind_bytesClass(void) {
 	BIND_METHOD(bytes,__hash__);
 	BIND_METHOD(bytes,decode);
 	BIND_METHOD(bytes,join);
+	KRK_DOC(BIND_METHOD(bytes,hex),
+		"@brief Convert to a string of hexadecimal digits, two for each byte.");
+	KrkNative * fromhex = krk_defineNative(&bytes->methods,"fromhex",_krk_fromhex);
+	fromhex->flags |= KRK_NATIVE_FLAGS_IS_CLASS_METHOD;
+	KRK_DOC(fromhex,
+		"@brief Create a @ref bytes object from a string of hexadecimal digits.\n"
+		"@arguments string\n\n"
+		"Each byte is represented by two digits. Whitespace between bytes is ignored.");
 	krk_defineNative(&bytes->methods,"__str__",FUNC_NAME(bytes,__repr__)); /* alias */
 	krk_finalizeClass(bytes);
 
 	KrkClass * bytesiterator = ADD_BASE_CLASS(vm.baseClasses->bytesiteratorClass, "bytesiterator", vm.baseClasses->objectClass);
+	bytesiterator->allocSize = sizeof(struct BytesIterator);
+	bytesiterator->_ongcscan = _bytesiterator_gcscan;
+	bytesiterator->_iternext = _bytesiterator_iternext;
 	BIND_METHOD(bytesiterator,__init__);
 	BIND_METHOD(bytesiterator,__call__);
 	krk_finalizeClass(bytesiterator);
@@ -234,20 +234,35 @@ KRK_METHOD(dictitems,__iter__,{
 	return argv[0];
 })
 
-KRK_METHOD(dictitems,__call__,{
+static int _dictitems_iterpair(KrkInstance * _self, KrkValue * pair) {
+	struct DictItems * self = (struct DictItems*)_self;
 	do {
-		if (self->i >= AS_DICT(self->dict)->capacity) return argv[0];
+		if (self->i >= AS_DICT(self->dict)->capacity) return 0;
 		if (!IS_KWARGS(AS_DICT(self->dict)->entries[self->i].key)) {
-			KrkTuple * outValue = krk_newTuple(2);
-			krk_push(OBJECT_VAL(outValue));
-			outValue->values.values[0] = AS_DICT(self->dict)->entries[self->i].key;
-			outValue->values.values[1] = AS_DICT(self->dict)->entries[self->i].value;
-			outValue->values.count = 2;
+			pair[0] = AS_DICT(self->dict)->entries[self->i].key;
+			pair[1] = AS_DICT(self->dict)->entries[self->i].value;
 			self->i++;
-			return krk_pop();
+			return 1;
 		}
 		self->i++;
 	} while (1);
+}
+
+static int _dictitems_iternext(KrkInstance * _self, KrkValue * value) {
+	KrkValue pair[2];
+	if (!_dictitems_iterpair(_self, pair)) return 0;
+	KrkTuple * outValue = krk_newTuple(2);
+	outValue->values.values[0] = pair[0];
+	outValue->values.values[1] = pair[1];
+	outValue->values.count = 2;
+	*value = OBJECT_VAL(outValue);
+	return 1;
+}
+
+KRK_METHOD(dictitems,__call__,{
+	KrkValue value;
+	if (!_dictitems_iternext((KrkInstance*)self, &value)) return argv[0];
+	return value;
 })
 
 KRK_METHOD(dictitems,__repr__,{
@@ -318,17 +333,24 @@ KRK_METHOD(dictkeys,__iter__,{
 	return argv[0];
 })
 
-KRK_METHOD(dictkeys,__call__,{
-	METHOD_TAKES_NONE();
+static int _dictkeys_iternext(KrkInstance * _self, KrkValue * value) {
+	struct DictKeys * self = (struct DictKeys*)_self;
 	do {
-		if (self->i >= AS_DICT(self->dict)->capacity) return argv[0];
+		if (self->i >= AS_DICT(self->dict)->capacity) return 0;
 		if (!IS_KWARGS(AS_DICT(self->dict)->entries[self->i].key)) {
-			krk_push(AS_DICT(self->dict)->entries[self->i].key);
+			*value = AS_DICT(self->dict)->entries[self->i].key;
 			self->i++;
-			return krk_pop();
+			return 1;
 		}
 		self->i++;
 	} while (1);
+}
+
+KRK_METHOD(dictkeys,__call__,{
+	METHOD_TAKES_NONE();
+	KrkValue value;
+	if (!_dictkeys_iternext((KrkInstance*)self, &value)) return argv[0];
+	return value;
 })
 
 KRK_METHOD(dictkeys,__repr__,{
@@ -396,6 +418,8 @@ void _createAndBind_dictClass(void) {
 	KrkClass * dictitems = ADD_BASE_CLASS(vm.baseClasses->dictitemsClass, "dictitems", vm.baseClasses->objectClass);
 	dictitems->allocSize = sizeof(struct DictItems);
 	dictitems->_ongcscan = _dictitems_gcscan;
+	dictitems->_iternext = _dictitems_iternext;
+	dictitems->_iterpair = _dictitems_iterpair;
 	BIND_METHOD(dictitems,__init__);
 	BIND_METHOD(dictitems,__iter__);
 	BIND_METHOD(dictitems,__call__);
@@ -405,6 +429,7 @@ void _createAndBind_dictClass(void) {
 	KrkClass * dictkeys = ADD_BASE_CLASS(vm.baseClasses->dictkeysClass, "dictkeys", vm.baseClasses->objectClass);
 	dictkeys->allocSize = sizeof(struct DictKeys);
 	dictkeys->_ongcscan = _dictkeys_gcscan;
+	dictkeys->_iternext = _dictkeys_iternext;
 	BIND_METHOD(dictkeys,__init__);
 	BIND_METHOD(dictkeys,__iter__);
 	BIND_METHOD(dictkeys,__call__);
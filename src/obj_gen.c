@@ -13,6 +13,8 @@
 #include <kuroko/util.h>
 #include <kuroko/debug.h>
 
+#include "private.h"
+
 static KrkClass * generator;
 /**
  * @brief Generator object implementation.
@@ -23,6 +25,7 @@ struct generator {
 	KrkClosure * closure;
 	KrkValue * args;
 	size_t argCount;
+	size_t argCapacity;
 	uint8_t * ip;
 	int running;
 	int started;
@@ -73,6 +76,7 @@ KrkInstance * krk_buildGenerator(KrkClosure * closure, KrkValue * argsIn, size_t
 	struct generator * self = (struct generator *)krk_newInstance(generator);
 	self->args = args;
 	self->argCount = argCount;
+	self->argCapacity = argCount;
 	self->closure = closure;
 	self->ip = self->closure->function->chunk.code;
 	self->result = NONE_VAL();
@@ -106,16 +110,25 @@ KRK_METHOD(generator,__iter__,{
 	return OBJECT_VAL(self);
 })
 
-KRK_METHOD(generator,__call__,{
-	METHOD_TAKES_AT_MOST(1);
-	if (!self->ip) return OBJECT_VAL(self);
-	/* Prepare frame */
-	KrkCallFrame * frame = &krk_currentThread.frames[krk_currentThread.frameCount++];
+/**
+ * @brief Push a call frame for a generator and copy its saved stack onto the thread stack.
+ *
+ * If the generator has already started, @p sent replaces the value of the
+ * yield expression it is suspended at.
+ */
+static KrkCallFrame * pushGeneratorFrame(struct generator * self, KrkValue sent) {
+	KrkCallFrame * frame = &krk_currentThread.frames[krk_currentThread.frameCount];
 	frame->closure = self->closure;
 	frame->ip      = self->ip;
 	frame->slots   = krk_currentThread.stackTop - krk_currentThread.stack;
 	frame->outSlots = frame->slots;
 	frame->globals = &self->closure->function->globalsContext->fields;
+	frame->generator = NULL;
+	__atomic_signal_fence(__ATOMIC_RELEASE);
+	krk_currentThread.frameCount++;
+#ifndef KRK_NO_TRACING
+	if (vm.globalFlags & KRK_GLOBAL_TRACE_EVENTS) _traceEnter(frame);
+#endif
 
 	/* Stick our stack on their stack */
 	for (size_t i = 0; i < self->argCount; ++i) {
@@ -123,21 +136,62 @@ KRK_METHOD(generator,__call__,{
 	}
 
 	if (self->started) {
-		krk_pop();
-		if (argc > 1) {
-			krk_push(argv[1]);
-		} else {
-			krk_push(NONE_VAL());
-		}
+		krk_currentThread.stackTop[-1] = sent;
 	}
 
-	/* Jump into the iterator */
 	self->running = 1;
-	size_t stackBefore = krk_currentThread.stackTop - krk_currentThread.stack;
-	KrkValue result = krk_runNext();
-	size_t stackAfter = krk_currentThread.stackTop - krk_currentThread.stack;
+	return frame;
+}
+
+/**
+ * @brief Save the stack of a generator's frame after it has yielded.
+ *
+ * The saved array only grows, so a generator whose stack depth at each
+ * yield stays the same does not reallocate it.
+ */
+static void saveGeneratorStack(struct generator * self, KrkCallFrame * frame) {
+	size_t count = krk_currentThread.stackTop - (krk_currentThread.stack + frame->slots);
+	if (count > self->argCapacity) {
+		self->args = realloc(self->args, sizeof(KrkValue) * count);
+		self->argCapacity = count;
+	}
+	memcpy(self->args, krk_currentThread.stack + frame->slots, sizeof(KrkValue) * count);
+	self->argCount = count;
+	self->ip       = frame->ip;
+	self->running  = 0;
+	self->started  = 1;
+}
+
+int _generatorResume(KrkInstance * _self) {
+	struct generator * self = (struct generator *)_self;
+	if (!self->ip) return 0;
+	if (self->running || krk_currentThread.frameCount == KRK_CALL_FRAMES_MAX) return -1;
+	KrkCallFrame * frame = pushGeneratorFrame(self, NONE_VAL());
+	frame->generator = _self;
+	return 1;
+}
+
+void _generatorYield(KrkCallFrame * frame) {
+	saveGeneratorStack((struct generator *)frame->generator, frame);
+}
+
+void _generatorFinish(KrkInstance * _self, KrkValue result) {
+	struct generator * self = (struct generator *)_self;
+	self->result  = result;
 	self->running = 0;
+	self->started = 1;
+	_set_generator_done(self);
+}
+
+KRK_METHOD(generator,__call__,{
+	METHOD_TAKES_AT_MOST(1);
+	if (!self->ip) return OBJECT_VAL(self);
+
+	KrkCallFrame * frame = pushGeneratorFrame(self, argc > 1 ? argv[1] : NONE_VAL());
 
+	/* Jump into the iterator */
+	KrkValue result = krk_runNext();
+	self->running = 0;
 	self->started = 1;
 
 	if (IS_KWARGS(result) && AS_INTEGER(result) == 0) {
@@ -153,21 +207,7 @@ KRK_METHOD(generator,__call__,{
 		return NONE_VAL();
 	}
 
-	/* Determine the stack state */
-	if (stackAfter > stackBefore) {
-		size_t newArgs = stackAfter - stackBefore;
-		self->args = realloc(self->args, sizeof(KrkValue) * (self->argCount + newArgs));
-		self->argCount += newArgs;
-	} else if (stackAfter < stackBefore) {
-		size_t deadArgs = stackBefore - stackAfter;
-		self->args = realloc(self->args, sizeof(KrkValue) * (self->argCount - deadArgs));
-		self->argCount -= deadArgs;
-	}
-
-	/* Save stack entries */
-	memcpy(self->args, krk_currentThread.stackTop - self->argCount, sizeof(KrkValue) * self->argCount);
-	self->ip      = frame->ip;
-
+	saveGeneratorStack(self, frame);
 	krk_currentThread.stackTop = krk_currentThread.stack + frame->slots;
 
 	return result;
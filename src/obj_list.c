@@ -397,6 +397,16 @@ KRK_METHOD(list,__add__,{
 	return outList;
 })
 
+/**
+ * @brief Iterator over the values in a list.
+ * @extends KrkInstance
+ */
+struct ListIterator {
+	KrkInstance inst;
+	KrkValue l;
+	size_t i;
+};
+
 FUNC_SIG(listiterator,__init__);
 
 KRK_METHOD(list,__iter__,{
@@ -411,43 +421,35 @@ KRK_METHOD(list,__iter__,{
 })
 
 #undef CURRENT_CTYPE
-#define CURRENT_CTYPE KrkInstance*
+#define CURRENT_CTYPE struct ListIterator *
+
+static void _listiterator_gcscan(KrkInstance * self) {
+	krk_markValue(((struct ListIterator*)self)->l);
+}
+
+static int _listiterator_iternext(KrkInstance * _self, KrkValue * value) {
+	struct ListIterator * self = (struct ListIterator*)_self;
+	if (!IS_list(self->l)) {
+		*value = krk_runtimeError(vm.exceptions->typeError, "Corrupt list iterator: no list pointer");
+		return 1;
+	}
+	if (self->i >= AS_LIST(self->l)->count) return 0;
+	*value = AS_LIST(self->l)->values[self->i++];
+	return 1;
+}
 
 KRK_METHOD(listiterator,__init__,{
 	METHOD_TAKES_EXACTLY(1);
 	CHECK_ARG(1,list,KrkList*,list);
-
-	krk_push(argv[0]);
-	krk_attachNamedValue(&self->fields, "l", OBJECT_VAL(list));
-	krk_attachNamedValue(&self->fields, "i", INTEGER_VAL(0));
-	krk_pop();
-
+	self->l = argv[1];
+	self->i = 0;
 	return argv[0];
 })
 
 KRK_METHOD(listiterator,__call__,{
-	KrkValue _list;
-	KrkValue _counter;
-	const char * errorStr = NULL;
-
-	if (!krk_tableGet(&self->fields, OBJECT_VAL(S("l")), &_list)) {
-		errorStr = "no list pointer";
-		goto _corrupt;
-	}
-	if (!krk_tableGet(&self->fields, OBJECT_VAL(S("i")), &_counter)) {
-		errorStr = "no index";
-		goto _corrupt;
-	}
-
-	if ((size_t)AS_INTEGER(_counter) >= AS_LIST(_list)->count) {
-		return argv[0];
-	} else {
-		krk_attachNamedValue(&self->fields, "i", INTEGER_VAL(AS_INTEGER(_counter)+1));
-		return AS_LIST(_list)->values[AS_INTEGER(_counter)];
-	}
-
-_corrupt:
-	return krk_runtimeError(vm.exceptions->typeError, "Corrupt list iterator: %s", errorStr);
+	KrkValue value;
+	if (!_listiterator_iternext((KrkInstance*)self, &value)) return argv[0];
+	return value;
 })
 
 
@@ -565,6 +567,9 @@ void _createAndBind_listClass(void) {
 		"Creates a new, reversed list from the elements of @p iterable.");
 
 	KrkClass * listiterator = ADD_BASE_CLASS(vm.baseClasses->listiteratorClass, "listiterator", vm.baseClasses->objectClass);
+	listiterator->allocSize = sizeof(struct ListIterator);
+	listiterator->_ongcscan = _listiterator_gcscan;
+	listiterator->_iternext = _listiterator_iternext;
 	BIND_METHOD(listiterator,__init__);
 	BIND_METHOD(listiterator,__call__);
 	krk_finalizeClass(listiterator);
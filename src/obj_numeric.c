@@ -40,6 +40,7 @@ KRK_METHOD(int,__int__,{ return argv[0]; })
 KRK_METHOD(int,__float__,{ return FLOATING_VAL(self); })
 
 KRK_METHOD(int,__chr__,{
+	if (self >= 0 && self <= 0x10FFFF) return OBJECT_VAL(krk_codepointString(self));
 	unsigned char bytes[5] = {0};
 	size_t len = krk_codepointToBytes(self, bytes);
 	return OBJECT_VAL(krk_copyString((char*)bytes, len));
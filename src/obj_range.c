@@ -80,15 +80,20 @@ KRK_METHOD(rangeiterator,__init__,{
 	return argv[0];
 })
 
+static int _rangeiterator_iternext(KrkInstance * _self, KrkValue * value) {
+	struct RangeIterator * self = (struct RangeIterator*)_self;
+	krk_integer_type i = self->i;
+	if (i >= self->max) return 0;
+	self->i = i + 1;
+	*value = INTEGER_VAL(i);
+	return 1;
+}
+
 KRK_METHOD(rangeiterator,__call__,{
 	METHOD_TAKES_NONE();
-	krk_integer_type i = self->i;
-	if (i >= self->max) {
-		return argv[0];
-	} else {
-		self->i = i + 1;
-		return INTEGER_VAL(i);
-	}
+	KrkValue value;
+	if (!_rangeiterator_iternext((KrkInstance*)self, &value)) return argv[0];
+	return value;
 })
 
 _noexport
@@ -108,6 +113,7 @@ void _createAndBind_rangeClass(void) {
 
 	rangeiterator = ADD_BASE_CLASS(vm.baseClasses->rangeiteratorClass, "rangeiterator", vm.baseClasses->objectClass);
 	rangeiterator->allocSize = sizeof(struct RangeIterator);
+	rangeiterator->_iternext = _rangeiterator_iternext;
 	BIND_METHOD(rangeiterator,__init__);
 	BIND_METHOD(rangeiterator,__call__);
 	krk_finalizeClass(rangeiterator);
@@ -208,17 +208,24 @@ KRK_METHOD(setiterator,__init__,{
 	return argv[0];
 })
 
-KRK_METHOD(setiterator,__call__,{
-	METHOD_TAKES_NONE();
+static int _setiterator_iternext(KrkInstance * _self, KrkValue * value) {
+	struct SetIterator * self = (struct SetIterator*)_self;
 	do {
-		if (self->i >= AS_set(self->set)->entries.capacity) return argv[0];
+		if (self->i >= AS_set(self->set)->entries.capacity) return 0;
 		if (!IS_KWARGS(AS_set(self->set)->entries.entries[self->i].key)) {
-			krk_push(AS_set(self->set)->entries.entries[self->i].key);
+			*value = AS_set(self->set)->entries.entries[self->i].key;
 			self->i++;
-			return krk_pop();
+			return 1;
 		}
 		self->i++;
 	} while (1);
+}
+
+KRK_METHOD(setiterator,__call__,{
+	METHOD_TAKES_NONE();
+	KrkValue value;
+	if (!_setiterator_iternext((KrkInstance*)self, &value)) return argv[0];
+	return value;
 })
 
 KrkValue krk_set_of(int argc, KrkValue argv[], int hasKw) {
@@ -272,6 +279,7 @@ void _createAndBind_setClass(void) {
 	krk_makeClass(vm.builtins, &setiterator, "setiterator", vm.baseClasses->objectClass);
 	setiterator->allocSize = sizeof(struct SetIterator);
 	setiterator->_ongcscan = _setiterator_gcscan;
+	setiterator->_iternext = _setiterator_iternext;
 	BIND_METHOD(setiterator,__init__);
 	BIND_METHOD(setiterator,__call__);
 	krk_finalizeClass(setiterator);
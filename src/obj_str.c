@@ -4,6 +4,8 @@
 #include <kuroko/memory.h>
 #include <kuroko/util.h>
 
+#include "private.h"
+
 static KrkValue FUNC_NAME(striterator,__init__)(int,KrkValue[],int);
 
 #define CURRENT_CTYPE KrkString *
@@ -16,13 +18,21 @@ static KrkValue FUNC_NAME(striterator,__init__)(int,KrkValue[],int);
 		stringBytes = realloc(stringBytes, stringCapacity); \
 	} stringBytes[stringLength++] = c; } while (0)
 
+/* Preallocated, immortal strings for the Latin-1 range */
+static KrkString * _codepointStrings[256];
+
+KrkString * krk_codepointString(uint32_t codepoint) {
+	if (codepoint < 256 && _codepointStrings[codepoint]) return _codepointStrings[codepoint];
+	unsigned char bytes[5] = {0};
+	size_t len = krk_codepointToBytes(codepoint, bytes);
+	return krk_copyString((char*)bytes, len);
+}
+
 #define KRK_STRING_FAST(string,offset)  (uint32_t)\
 	(string->type <= 1 ? ((uint8_t*)string->codes)[offset] : \
 	(string->type == 2 ? ((uint16_t*)string->codes)[offset] : \
 	((uint32_t*)string->codes)[offset]))
 
-#define CODEPOINT_BYTES(cp) (cp < 0x80 ? 1 : (cp < 0x800 ? 2 : (cp < 0x10000 ? 3 : 4)))
-
 KRK_METHOD(str,__ord__,{
 	METHOD_TAKES_NONE();
 	if (self->codesLength != 1)
@@ -105,18 +115,9 @@ KRK_METHOD(str,__getslice__,{
 	if (self->type == KRK_STRING_ASCII) {
 		return OBJECT_VAL(krk_copyString(self->chars + start, len));
 	} else {
-		size_t offset = 0;
-		size_t length = 0;
-		/* Figure out where the UTF8 for this string starts. */
-		krk_unicodeString(self);
-		for (long i = 0; i < start; ++i) {
-			uint32_t cp = KRK_STRING_FAST(self,i);
-			offset += CODEPOINT_BYTES(cp);
-		}
-		for (long i = start; i < end; ++i) {
-			uint32_t cp = KRK_STRING_FAST(self,i);
-			length += CODEPOINT_BYTES(cp);
-		}
+		/* Figure out where the UTF8 for this string starts and ends. */
+		size_t offset = krk_unicodeOffset(self, start);
+		size_t length = krk_unicodeOffset(self, end) - offset;
 		return OBJECT_VAL(krk_copyString(self->chars + offset, length));
 	}
 })
@@ -156,19 +157,9 @@ KRK_METHOD(str,__getitem__,{
 		return krk_runtimeError(vm.exceptions->indexError, "String index out of range: %d", asInt);
 	}
 	if (self->type == KRK_STRING_ASCII) {
-		return OBJECT_VAL(krk_copyString(self->chars + asInt, 1));
+		return OBJECT_VAL(_codepointStrings[(unsigned char)self->chars[asInt]]);
 	} else {
-		size_t offset = 0;
-		size_t length = 0;
-		/* Figure out where the UTF8 for this string starts. */
-		krk_unicodeString(self);
-		for (long i = 0; i < asInt; ++i) {
-			uint32_t cp = KRK_STRING_FAST(self,i);
-			offset += CODEPOINT_BYTES(cp);
-		}
-		uint32_t cp = KRK_STRING_FAST(self,asInt);
-		length = CODEPOINT_BYTES(cp);
-		return OBJECT_VAL(krk_copyString(self->chars + offset, length));
+		return OBJECT_VAL(krk_codepointString(krk_unicodeCodepoint(self, asInt)));
 	}
 })
 
@@ -726,9 +717,56 @@ KRK_METHOD(str,__repr__,{
 	return tmp;
 })
 
+_noexport
+KrkEncoding _encodingFromName(const char * name) {
+	char normalized[16];
+	size_t i = 0;
+	for (; name[i] && i < sizeof(normalized) - 1; ++i) {
+		char c = name[i];
+		normalized[i] = (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : (c == '_' ? '-' : c);
+	}
+	if (name[i]) return KRK_ENCODING_UNKNOWN;
+	normalized[i] = '\0';
+	static const char * utf8[] = {"utf-8", "utf8", "u8", NULL};
+	static const char * latin1[] = {"latin-1", "latin1", "iso-8859-1", "iso8859-1", "l1", NULL};
+	for (const char ** n = utf8; *n; ++n) if (!strcmp(normalized, *n)) return KRK_ENCODING_UTF8;
+	for (const char ** n = latin1; *n; ++n) if (!strcmp(normalized, *n)) return KRK_ENCODING_LATIN1;
+	return KRK_ENCODING_UNKNOWN;
+}
+
+/* str.encode(encoding='utf-8') */
 KRK_METHOD(str,encode,{
-	METHOD_TAKES_NONE();
-	return OBJECT_VAL(krk_newBytes(AS_STRING(argv[0])->length, (uint8_t*)AS_CSTRING(argv[0])));
+	METHOD_TAKES_AT_MOST(1);
+	KrkEncoding encoding = KRK_ENCODING_UTF8;
+	if (argc > 1) {
+		CHECK_ARG(1,str,KrkString*,name);
+		encoding = _encodingFromName(name->chars);
+		if (encoding == KRK_ENCODING_UNKNOWN) return krk_runtimeError(vm.exceptions->valueError, "unsupported encoding '%s'", name->chars);
+	}
+	if (encoding == KRK_ENCODING_UTF8 || self->type == KRK_STRING_ASCII) {
+		return OBJECT_VAL(krk_newBytes(self->length, (uint8_t*)self->chars));
+	} else {
+		if (self->type != KRK_STRING_UCS1) {
+			return krk_runtimeError(vm.exceptions->valueError, "'%s' codec can't encode characters beyond U+00FF", "latin-1");
+		}
+		KrkBytes * out = krk_newBytes(self->codesLength, NULL);
+		const unsigned char * c = (const unsigned char *)self->chars;
+		const unsigned char * end = c + self->length;
+		uint8_t * o = out->bytes;
+		while (c < end) {
+			if (*c < 0x80) {
+				size_t run = _asciiPrefix(c, end - c);
+				memcpy(o, c, run);
+				o += run;
+				c += run;
+			} else {
+				/* UCS1 strings only contain two-byte sequences beyond ASCII */
+				*o++ = ((c[0] & 0x1F) << 6) | (c[1] & 0x3F);
+				c += 2;
+			}
+		}
+		return OBJECT_VAL(out);
+	}
 })
 
 KRK_METHOD(str,__str__,{
@@ -840,43 +878,58 @@ KRK_METHOD(str,title, {
 	return finishStringBuilder(&sb);
 })
 
+/**
+ * @brief Iterator over the codepoints of a string.
+ * @extends KrkInstance
+ */
+struct StrIterator {
+	KrkInstance inst;
+	KrkValue s;
+	size_t i;
+};
+
 #undef CURRENT_CTYPE
-#define CURRENT_CTYPE KrkInstance *
+#define CURRENT_CTYPE struct StrIterator *
+
+static void _striterator_gcscan(KrkInstance * self) {
+	krk_markValue(((struct StrIterator*)self)->s);
+}
+
+static int _striterator_iternext(KrkInstance * _self, KrkValue * value) {
+	struct StrIterator * self = (struct StrIterator*)_self;
+	if (!IS_STRING(self->s)) {
+		*value = krk_runtimeError(vm.exceptions->typeError, "Corrupt str iterator: no str pointer");
+		return 1;
+	}
+	if (self->i >= AS_STRING(self->s)->codesLength) return 0;
+	*value = FUNC_NAME(str,__getitem__)(2,(KrkValue[]){self->s,INTEGER_VAL(self->i)},3);
+	self->i++;
+	return 1;
+}
+
 KRK_METHOD(striterator,__init__,{
 	METHOD_TAKES_EXACTLY(1);
 	CHECK_ARG(1,str,KrkString*,base);
-	krk_push(OBJECT_VAL(self));
-	krk_attachNamedObject(&self->fields, "s", (KrkObj*)base);
-	krk_attachNamedValue(&self->fields, "i", INTEGER_VAL(0));
-	return krk_pop();
+	self->s = argv[1];
+	self->i = 0;
+	return argv[0];
 })
 
 KRK_METHOD(striterator,__call__,{
 	METHOD_TAKES_NONE();
-	KrkValue _str;
-	KrkValue _counter;
-	const char * errorStr = NULL;
-	if (!krk_tableGet(&self->fields, OBJECT_VAL(S("s")), &_str)) {
-		errorStr = "no str pointer";
-		goto _corrupt;
-	}
-	if (!krk_tableGet(&self->fields, OBJECT_VAL(S("i")), &_counter)) {
-		errorStr = "no index";
-		goto _corrupt;
-	}
-
-	if ((size_t)AS_INTEGER(_counter) >= AS_STRING(_str)->codesLength) {
-		return argv[0];
-	} else {
-		krk_attachNamedValue(&self->fields, "i", INTEGER_VAL(AS_INTEGER(_counter)+1));
-		return FUNC_NAME(str,__getitem__)(2,(KrkValue[]){_str,_counter},3);
-	}
-_corrupt:
-	return krk_runtimeError(vm.exceptions->typeError, "Corrupt str iterator: %s", errorStr);
+	KrkValue value;
+	if (!_striterator_iternext((KrkInstance*)self, &value)) return argv[0];
+	return value;
 })
 
 _noexport
 void _createAndBind_strClass(void) {
+	memset(_codepointStrings, 0, sizeof(_codepointStrings));
+	for (size_t i = 0; i < 256; ++i) {
+		_codepointStrings[i] = krk_codepointString(i);
+		_codepointStrings[i]->obj.flags |= KRK_OBJ_FLAGS_IMMORTAL;
+	}
+
 	KrkClass * str = ADD_BASE_CLASS(vm.baseClasses->strClass, "str", vm.baseClasses->objectClass);
 	BIND_METHOD(str,__init__);
 	BIND_METHOD(str,__iter__);
@@ -933,6 +986,9 @@ void _createAndBind_strClass(void) {
 	KRK_DOC(str, "Obtain a string representation of an object.");
 
 	KrkClass * striterator = ADD_BASE_CLASS(vm.baseClasses->striteratorClass, "striterator", vm.baseClasses->objectClass);
+	striterator->allocSize = sizeof(struct StrIterator);
+	striterator->_ongcscan = _striterator_gcscan;
+	striterator->_iternext = _striterator_iternext;
 	BIND_METHOD(striterator,__init__);
 	BIND_METHOD(striterator,__call__);
 	krk_finalizeClass(striterator);
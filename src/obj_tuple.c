@@ -127,16 +127,20 @@ static void _tuple_iter_gcscan(KrkInstance * self) {
 	krk_markValue(((struct TupleIter*)self)->myTuple);
 }
 
-static KrkValue _tuple_iter_call(int argc, KrkValue argv[], int hasKw) {
-	struct TupleIter * self = (struct TupleIter *)AS_OBJECT(argv[0]);
+static int _tuple_iter_next(KrkInstance * _self, KrkValue * value) {
+	struct TupleIter * self = (struct TupleIter *)_self;
 	KrkValue t = self->myTuple; /* Tuple to iterate */
 	int i = self->i;
-	if (i >= (krk_integer_type)AS_TUPLE(t)->values.count) {
-		return argv[0];
-	} else {
-		self->i = i+1;
-		return AS_TUPLE(t)->values.values[i];
-	}
+	if (i >= (krk_integer_type)AS_TUPLE(t)->values.count) return 0;
+	self->i = i+1;
+	*value = AS_TUPLE(t)->values.values[i];
+	return 1;
+}
+
+static KrkValue _tuple_iter_call(int argc, KrkValue argv[], int hasKw) {
+	KrkValue value;
+	if (!_tuple_iter_next(AS_INSTANCE(argv[0]), &value)) return argv[0];
+	return value;
 }
 
 KRK_METHOD(tuple,__iter__,{
@@ -183,6 +187,7 @@ void _createAndBind_tupleClass(void) {
 	ADD_BASE_CLASS(vm.baseClasses->tupleiteratorClass, "tupleiterator", vm.baseClasses->objectClass);
 	vm.baseClasses->tupleiteratorClass->allocSize = sizeof(struct TupleIter);
 	vm.baseClasses->tupleiteratorClass->_ongcscan = _tuple_iter_gcscan;
+	vm.baseClasses->tupleiteratorClass->_iternext = _tuple_iter_next;
 	krk_defineNative(&vm.baseClasses->tupleiteratorClass->methods, "__init__", _tuple_iter_init);
 	krk_defineNative(&vm.baseClasses->tupleiteratorClass->methods, "__call__", _tuple_iter_call);
 	krk_finalizeClass(vm.baseClasses->tupleiteratorClass);
@@ -8,6 +8,8 @@
 #include <kuroko/vm.h>
 #include <kuroko/table.h>
 
+#include "private.h"
+
 #define ALLOCATE_OBJECT(type, objectType) \
 	(type*)allocateObject(sizeof(type), objectType)
 
@@ -106,6 +108,13 @@ static int checkString(const char * chars, size_t length, size_t *codepointCount
 	unsigned char * end = (unsigned char *)chars + length;
 	uint32_t maxCodepoint = 0;
 	for (unsigned char * c = (unsigned char *)chars; c < end; ++c) {
+		if (state == UTF8_ACCEPT && *c < 0x80) {
+			/* Skip over runs of ASCII, which can not change the string type. */
+			size_t run = _asciiPrefix(c, end - c);
+			*codepointCount += run;
+			c += run - 1;
+			continue;
+		}
 		if (!decode(&state, &codepoint, *c)) {
 			if (codepoint > maxCodepoint) maxCodepoint = codepoint;
 			(*codepointCount)++;
@@ -135,6 +144,13 @@ static int checkString(const char * chars, size_t length, size_t *codepointCount
 		string->codes = malloc(sizeof(type) * string->codesLength); \
 		type *outPtr = (type *)string->codes; \
 		for (unsigned char * c = (unsigned char *)string->chars; c < end; ++c) { \
+			if (state == UTF8_ACCEPT && *c < 0x80) { \
+				size_t run = _asciiPrefix(c, end - c); \
+				for (size_t i = 0; i < run; ++i) outPtr[i] = c[i]; \
+				outPtr += run; \
+				c += run - 1; \
+				continue; \
+			} \
 			if (!decode(&state, &codepoint, *c)) { \
 				*(outPtr++) = (type)codepoint; \
 			} else if (state == UTF8_REJECT) { \
@@ -156,19 +172,50 @@ void * krk_unicodeString(KrkString * string) {
 	return string->codes;
 }
 
+/* Length of a UTF-8 sequence from its (already validated) leading byte. */
+#define SEQUENCE_LENGTH(c) ((c) < 0x80 ? 1 : ((c) < 0xE0 ? 2 : ((c) < 0xF0 ? 3 : 4)))
+
+static void _readyOffsets(KrkString * string) {
+	string->offsets = malloc(sizeof(size_t) * (string->codesLength / KRK_STRING_STRIDE + 1));
+	unsigned char * start = (unsigned char *)string->chars;
+	unsigned char * c = start;
+	for (size_t i = 0; i < string->codesLength; ++i) {
+		if (!(i % KRK_STRING_STRIDE)) string->offsets[i / KRK_STRING_STRIDE] = c - start;
+		c += SEQUENCE_LENGTH(*c);
+	}
+}
+
+size_t krk_unicodeOffset(KrkString * string, size_t index) {
+	if (index >= string->codesLength) return string->length;
+	if (string->type == KRK_STRING_ASCII) return index;
+	if (!string->offsets) _readyOffsets(string);
+	unsigned char * start = (unsigned char *)string->chars;
+	unsigned char * c = start + string->offsets[index / KRK_STRING_STRIDE];
+	for (size_t i = index % KRK_STRING_STRIDE; i; --i) {
+		c += SEQUENCE_LENGTH(*c);
+	}
+	return c - start;
+}
+
 uint32_t krk_unicodeCodepoint(KrkString * string, size_t index) {
-	krk_unicodeString(string);
 	switch (string->type) {
 		case KRK_STRING_ASCII: return string->chars[index];
-		case KRK_STRING_UCS1: return ((uint8_t*)string->codes)[index];
-		case KRK_STRING_UCS2: return ((uint16_t*)string->codes)[index];
-		case KRK_STRING_UCS4: return ((uint32_t*)string->codes)[index];
+		case KRK_STRING_UCS1: if (string->codes) return ((uint8_t*)string->codes)[index]; break;
+		case KRK_STRING_UCS2: if (string->codes) return ((uint16_t*)string->codes)[index]; break;
+		case KRK_STRING_UCS4: if (string->codes) return ((uint32_t*)string->codes)[index]; break;
 		default:
 			krk_runtimeError(vm.exceptions->valueError, "Internal string error.");
 			return 0;
 	}
+	uint32_t state = 0;
+	uint32_t codepoint = 0;
+	unsigned char * c = (unsigned char *)string->chars + krk_unicodeOffset(string, index);
+	while (decode(&state, &codepoint, *c++));
+	return codepoint;
 }
 
+#undef SEQUENCE_LENGTH
+
 static KrkString * allocateString(char * chars, size_t length, uint32_t hash) {
 	size_t codesLength = 0;
 	int type = checkString(chars,length,&codesLength);
@@ -183,6 +230,7 @@ static KrkString * allocateString(char * chars, size_t length, uint32_t hash) {
 	string->codesLength = codesLength;
 	string->type = type;
 	string->codes = NULL;
+	string->offsets = NULL;
 	if (string->type == KRK_STRING_ASCII) string->codes = string->chars;
 	krk_push(OBJECT_VAL(string));
 	krk_tableSet(&vm.strings, OBJECT_VAL(string), NONE_VAL());
@@ -210,6 +258,8 @@ KrkString * krk_takeString(char * chars, size_t length) {
 		_release_lock(_stringLock);
 		return interned;
 	}
+	/* Buffers handed to us come from malloc(), but will be released through krk_reallocate(). */
+	if (vm.globalFlags & KRK_GLOBAL_TRACE_ALLOCATIONS) _tracemallocAllocate(chars, 0, length + 1, 0);
 	KrkString * result = allocateString(chars, length, hash);
 	return result;
 }
@@ -242,6 +292,12 @@ KrkCodeObject * krk_newCodeObject(void) {
 	codeobject->localNameCount = 0;
 	codeobject->localNames = NULL;
 	codeobject->globalsContext = NULL;
+	codeobject->quickenCounters = NULL;
+	codeobject->globalCaches = NULL;
+	codeobject->instructionCounts = NULL;
+	codeobject->traceName = 0;
+	codeobject->lineProfile = NULL;
+	krk_initTable(&codeobject->argumentIndex);
 	krk_initValueArray(&codeobject->requiredArgNames);
 	krk_initValueArray(&codeobject->keywordArgNames);
 	krk_initChunk(&codeobject->chunk);
@@ -291,6 +347,8 @@ KrkClass * krk_newClass(KrkString * name, KrkClass * baseClass) {
 		_class->allocSize = baseClass->allocSize;
 		_class->_ongcscan = baseClass->_ongcscan;
 		_class->_ongcsweep = baseClass->_ongcsweep;
+		_class->_iternext = baseClass->_iternext;
+		_class->_iterpair = baseClass->_iterpair;
 	}
 
 	return _class;
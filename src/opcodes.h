@@ -47,6 +47,27 @@ SIMPLE(OP_GREATER_EQUAL)
 SIMPLE(OP_LESS_EQUAL)
 SIMPLE(OP_FLOORDIV)
 SIMPLE(OP_UNSET)
+SIMPLE(OP_FOR_RANGE_INIT)
+SIMPLE(OP_ADD_INT)
+SIMPLE(OP_ADD_FLOAT)
+SIMPLE(OP_ADD_STR)
+SIMPLE(OP_SUBTRACT_INT)
+SIMPLE(OP_SUBTRACT_FLOAT)
+SIMPLE(OP_MULTIPLY_INT)
+SIMPLE(OP_MULTIPLY_FLOAT)
+SIMPLE(OP_LESS_INT)
+SIMPLE(OP_LESS_FLOAT)
+SIMPLE(OP_GREATER_INT)
+SIMPLE(OP_GREATER_FLOAT)
+SIMPLE(OP_LESS_EQUAL_INT)
+SIMPLE(OP_LESS_EQUAL_FLOAT)
+SIMPLE(OP_GREATER_EQUAL_INT)
+SIMPLE(OP_GREATER_EQUAL_FLOAT)
+SIMPLE(OP_EQUAL_JUMP_IF_FALSE)
+SIMPLE(OP_LESS_JUMP_IF_FALSE)
+SIMPLE(OP_GREATER_JUMP_IF_FALSE)
+SIMPLE(OP_LESS_EQUAL_JUMP_IF_FALSE)
+SIMPLE(OP_GREATER_EQUAL_JUMP_IF_FALSE)
 CONSTANT(OP_DEFINE_GLOBAL,(void)0)
 CONSTANT(OP_CONSTANT,(void)0)
 CONSTANT(OP_GET_GLOBAL,(void)0)
@@ -78,6 +99,10 @@ OPERAND(OP_MAKE_LIST, (void)0)
 OPERAND(OP_MAKE_DICT, (void)0)
 OPERAND(OP_MAKE_SET, (void)0)
 OPERAND(OP_REVERSE, (void)0)
+OPERANDB(OP_GET_LOCAL_GET_LOCAL, LOCAL_MORE)
+OPERANDB(OP_GET_LOCAL_CONSTANT, LOCAL_MORE)
+OPERANDB(OP_GET_LOCAL_GET_PROPERTY, LOCAL_MORE)
+OPERANDB(OP_SET_LOCAL_POP, LOCAL_MORE)
 JUMP(OP_JUMP_IF_FALSE_OR_POP,+)
 JUMP(OP_JUMP_IF_TRUE_OR_POP,+)
 JUMP(OP_JUMP,+)
@@ -86,3 +111,4 @@ JUMP(OP_PUSH_TRY,+)
 JUMP(OP_PUSH_WITH,+)
 JUMP(OP_YIELD_FROM,+)
 JUMP(OP_CALL_ITER,+)
+JUMP(OP_FOR_RANGE,+)
@@ -0,0 +1,784 @@
+/**
+ * @file    optimizer.c
+ * @brief   Bytecode optimizer.
+ *
+ * The compiler writes bytecode in a single pass and never looks back at what
+ * it has emitted. When a code object is finished, its bytecode is decoded into
+ * a list of instructions here, which is then simplified:
+ *
+ * - Arithmetic on constant operands, and tuples built from constants, are
+ *   folded into single constants.
+ * - Values that are pushed only to be popped again, and conditional jumps on
+ *   constants that can never be taken, are removed.
+ * - Jumps that land on unconditional jumps are threaded through to their final
+ *   destination, and jumps to the following instruction are removed.
+ * - Instructions that can not be reached from the start of the code object, or
+ *   from an exception or context manager handler, are removed.
+ * - Constants that are no longer referenced are dropped, and duplicates merged.
+ *
+ * The result is re-encoded, adjusting jump offsets, the line map, and local
+ * name lifetimes. If anything about the bytecode is unexpected, it is left
+ * alone. Frequent pairs of the remaining instructions are then fused into
+ * superinstructions.
+ *
+ * Large code objects, which are almost always generated tables of data, get
+ * less of this: past MAX_FOLDED_INSTRUCTIONS constants are neither folded nor
+ * merged, and past MAX_OPTIMIZED_SIZE the bytecode is left as compiled, so
+ * that importing them costs about what it would without the optimizer.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include <kuroko/vm.h>
+#include <kuroko/memory.h>
+#include <kuroko/object.h>
+#include <kuroko/value.h>
+
+#include "private.h"
+
+extern KrkValue krk_operator_add(KrkValue,KrkValue);
+extern KrkValue krk_operator_sub(KrkValue,KrkValue);
+extern KrkValue krk_operator_mul(KrkValue,KrkValue);
+extern KrkValue krk_operator_truediv(KrkValue,KrkValue);
+extern KrkValue krk_operator_floordiv(KrkValue,KrkValue);
+extern KrkValue krk_operator_mod(KrkValue,KrkValue);
+extern KrkValue krk_operator_pow(KrkValue,KrkValue);
+extern KrkValue krk_operator_or(KrkValue,KrkValue);
+extern KrkValue krk_operator_xor(KrkValue,KrkValue);
+extern KrkValue krk_operator_and(KrkValue,KrkValue);
+extern KrkValue krk_operator_lshift(KrkValue,KrkValue);
+extern KrkValue krk_operator_rshift(KrkValue,KrkValue);
+
+/* Longest string that will be produced by folding a concatenation. */
+#define MAX_FOLDED_STRING 256
+
+/* Rounds of optimization to run; each can expose more work for the next, but two almost always suffice. */
+#define MAX_ROUNDS 3
+
+/*
+ * Code objects with more instructions than this are usually generated tables of
+ * data, where folding finds little and costs more than the rest of compilation;
+ * their constants are neither folded nor merged.
+ */
+#define MAX_FOLDED_INSTRUCTIONS 4096
+
+/* Bytecode longer than this is not optimized at all. */
+#define MAX_OPTIMIZED_SIZE 16384
+
+enum {
+	KIND_INVALID,
+	KIND_SIMPLE,
+	KIND_CONSTANT,
+	KIND_OPERAND,
+	KIND_JUMP,
+};
+
+typedef struct {
+	uint8_t kind;
+	uint8_t shortForm;
+	uint8_t longForm;
+	int8_t  sign;
+} OpcodeInfo;
+
+/* Superinstructions are never seen here, so OPERANDB entries are left invalid. */
+static const OpcodeInfo opcodeInfo[256] = {
+#define SIMPLE(opc) [opc] = {KIND_SIMPLE, opc, opc, 0},
+#define CONSTANT(opc,more) [opc] = {KIND_CONSTANT, opc, opc ## _LONG, 0}, [opc ## _LONG] = {KIND_CONSTANT, opc, opc ## _LONG, 0},
+#define OPERAND(opc,more) [opc] = {KIND_OPERAND, opc, opc ## _LONG, 0}, [opc ## _LONG] = {KIND_OPERAND, opc, opc ## _LONG, 0},
+#define OPERANDB(opc,more)
+#define JUMP(opc,sign) [opc] = {KIND_JUMP, opc, opc, sign 1},
+#include "opcodes.h"
+#undef SIMPLE
+#undef CONSTANT
+#undef OPERAND
+#undef OPERANDB
+#undef JUMP
+};
+
+typedef struct {
+	size_t offset;    /* Offset of the instruction in the original bytecode */
+	size_t size;      /* Size of the instruction in the original bytecode */
+	size_t extra;     /* Bytes following the operand (the upvalue list of a closure) */
+	size_t line;
+	size_t operand;   /* Operand value; for jumps, the index of the target instruction */
+	uint8_t opcode;   /* Short form of the opcode */
+	uint8_t removed;
+	uint8_t reachable;
+	size_t targeted;  /* How many jumps land on this instruction */
+} Instruction;
+
+typedef struct {
+	KrkCodeObject * function;
+	Instruction * code;
+	size_t count;
+	int large;  /* More than MAX_FOLDED_INSTRUCTIONS */
+} Optimizer;
+
+static int decode(Optimizer * state) {
+	KrkChunk * chunk = &state->function->chunk;
+	size_t * indexOf = malloc(sizeof(size_t) * (chunk->count + 1));
+	for (size_t i = 0; i <= chunk->count; ++i) indexOf[i] = SIZE_MAX;
+
+	state->code = malloc(sizeof(Instruction) * (chunk->count + 1));
+	state->count = 0;
+
+	size_t line = 0;
+	size_t offset = 0;
+	while (offset < chunk->count) {
+		uint8_t opcode = chunk->code[offset];
+		const OpcodeInfo * info = &opcodeInfo[opcode];
+		Instruction * ins = &state->code[state->count];
+		memset(ins, 0, sizeof(Instruction));
+		ins->offset = offset;
+		ins->opcode = info->shortForm;
+
+		while (line + 1 < chunk->linesCount && chunk->lines[line + 1].startOffset <= offset) line++;
+		ins->line = chunk->linesCount ? chunk->lines[line].line : 0;
+
+		switch (info->kind) {
+			case KIND_SIMPLE:
+				ins->size = 1;
+				break;
+			case KIND_CONSTANT:
+			case KIND_OPERAND:
+				if (opcode == info->longForm) {
+					if (offset + 4 > chunk->count) goto _fail;
+					ins->operand = (chunk->code[offset+1] << 16) | (chunk->code[offset+2] << 8) | chunk->code[offset+3];
+					ins->size = 4;
+				} else {
+					if (offset + 2 > chunk->count) goto _fail;
+					ins->operand = chunk->code[offset+1];
+					ins->size = 2;
+				}
+				if (info->kind == KIND_CONSTANT && ins->operand >= chunk->constants.count) goto _fail;
+				if (ins->opcode == OP_CLOSURE) {
+					/* Upvalue references past the 256th take four bytes instead of two; don't bother. */
+					size_t upvalues = AS_codeobject(chunk->constants.values[ins->operand])->upvalueCount;
+					if (upvalues > 256) goto _fail;
+					ins->extra = upvalues * 2;
+					ins->size += ins->extra;
+				}
+				break;
+			case KIND_JUMP: {
+				if (offset + 3 > chunk->count) goto _fail;
+				size_t distance = (chunk->code[offset+1] << 8) | chunk->code[offset+2];
+				ins->size = 3;
+				ins->operand = info->sign > 0 ? offset + 3 + distance : offset + 3 - distance;
+				break;
+			}
+			default:
+				goto _fail;
+		}
+
+		indexOf[offset] = state->count++;
+		offset += ins->size;
+	}
+	if (offset != chunk->count) goto _fail;
+
+	/* Turn jump targets into instruction indexes. */
+	for (size_t i = 0; i < state->count; ++i) {
+		Instruction * ins = &state->code[i];
+		if (opcodeInfo[ins->opcode].kind != KIND_JUMP) continue;
+		if (ins->operand >= chunk->count || indexOf[ins->operand] == SIZE_MAX) goto _fail;
+		ins->operand = indexOf[ins->operand];
+	}
+
+	free(indexOf);
+	return 1;
+
+_fail:
+	free(indexOf);
+	free(state->code);
+	state->code = NULL;
+	return 0;
+}
+
+static size_t nextLive(Optimizer * state, size_t i) {
+	while (i < state->count && state->code[i].removed) i++;
+	return i;
+}
+
+static size_t prevLive(Optimizer * state, size_t i) {
+	while (i > 0) {
+		i--;
+		if (!state->code[i].removed) return i;
+	}
+	return SIZE_MAX;
+}
+
+static int isJump(Instruction * ins) {
+	return opcodeInfo[ins->opcode].kind == KIND_JUMP;
+}
+
+/**
+ * Point jumps at removed instructions to whatever follows them, and
+ * recount how many jumps land on each instruction.
+ */
+static void resolveTargets(Optimizer * state) {
+	for (size_t i = 0; i < state->count; ++i) state->code[i].targeted = 0;
+	for (size_t i = 0; i < state->count; ++i) {
+		Instruction * ins = &state->code[i];
+		if (ins->removed || !isJump(ins)) continue;
+		ins->operand = nextLive(state, ins->operand);
+		if (ins->operand < state->count) state->code[ins->operand].targeted++;
+	}
+}
+
+static KrkValue constantOf(Optimizer * state, Instruction * ins) {
+	return state->function->chunk.constants.values[ins->operand];
+}
+
+static int isNumber(KrkValue value) {
+	return KRK_VAL_TYPE(value) == KRK_VAL_INTEGER || IS_FLOATING(value);
+}
+
+static int isZero(KrkValue value) {
+	return (KRK_VAL_TYPE(value) == KRK_VAL_INTEGER && AS_INTEGER(value) == 0) ||
+		(IS_FLOATING(value) && AS_FLOATING(value) == 0.0);
+}
+
+/* Values that may end up in folded tuples, and that the bytecode marshaller knows how to write. */
+static int isFoldable(KrkValue value) {
+	return isNumber(value) || IS_STRING(value) || IS_BYTES(value) || IS_TUPLE(value);
+}
+
+/**
+ * Evaluate an operator on constant operands the same way the VM would. Only
+ * numbers (and string concatenation) are considered, so this never calls
+ * into managed code, and any operation that would raise is left for runtime.
+ */
+static int foldBinary(uint8_t opcode, KrkValue a, KrkValue b, KrkValue * out) {
+	if (opcode == OP_ADD && IS_STRING(a) && IS_STRING(b)) {
+		if (AS_STRING(a)->length + AS_STRING(b)->length > MAX_FOLDED_STRING) return 0;
+	} else if (!isNumber(a) || !isNumber(b)) {
+		return 0;
+	}
+
+	KrkValue result;
+	switch (opcode) {
+		case OP_ADD:        result = krk_operator_add(a,b); break;
+		case OP_SUBTRACT:   result = krk_operator_sub(a,b); break;
+		case OP_MULTIPLY:   result = krk_operator_mul(a,b); break;
+		case OP_POW:        result = krk_operator_pow(a,b); break;
+		case OP_DIVIDE:     if (isZero(b)) return 0; result = krk_operator_truediv(a,b); break;
+		case OP_FLOORDIV:   if (isZero(b)) return 0; result = krk_operator_floordiv(a,b); break;
+		case OP_MODULO:     if (isZero(b)) return 0; result = krk_operator_mod(a,b); break;
+		case OP_BITOR:      result = krk_operator_or(a,b); break;
+		case OP_BITXOR:     result = krk_operator_xor(a,b); break;
+		case OP_BITAND:     result = krk_operator_and(a,b); break;
+		case OP_SHIFTLEFT:
+		case OP_SHIFTRIGHT:
+			if (!IS_INTEGER(b) || AS_INTEGER(b) < 0 || AS_INTEGER(b) >= (krk_integer_type)(sizeof(krk_integer_type) * 8)) return 0;
+			result = opcode == OP_SHIFTLEFT ? krk_operator_lshift(a,b) : krk_operator_rshift(a,b);
+			break;
+		default:
+			return 0;
+	}
+
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) {
+		krk_currentThread.flags &= ~KRK_THREAD_HAS_EXCEPTION;
+		krk_currentThread.currentException = NONE_VAL();
+		return 0;
+	}
+	if (!isNumber(result) && !IS_STRING(result)) return 0;
+	*out = result;
+	return 1;
+}
+
+static int foldUnary(uint8_t opcode, KrkValue a, KrkValue * out) {
+	if (KRK_VAL_TYPE(a) == KRK_VAL_INTEGER) {
+		if (opcode == OP_NEGATE) *out = INTEGER_VAL(-AS_INTEGER(a));
+		else *out = INTEGER_VAL(~AS_INTEGER(a));
+		return 1;
+	} else if (IS_FLOATING(a) && opcode == OP_NEGATE) {
+		*out = FLOATING_VAL(-AS_FLOATING(a));
+		return 1;
+	}
+	return 0;
+}
+
+static int isBinaryOperator(uint8_t opcode) {
+	switch (opcode) {
+		case OP_ADD: case OP_SUBTRACT: case OP_MULTIPLY: case OP_DIVIDE: case OP_FLOORDIV:
+		case OP_MODULO: case OP_POW: case OP_BITOR: case OP_BITXOR: case OP_BITAND:
+		case OP_SHIFTLEFT: case OP_SHIFTRIGHT:
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * Replace a run of constant loads and the operation consuming them with a
+ * single load of the result. Only the first load may be a jump target.
+ */
+static int foldConstants(Optimizer * state) {
+	KrkChunk * chunk = &state->function->chunk;
+	int changed = 0;
+	resolveTargets(state);
+
+	for (size_t i = 0; i < state->count; ++i) {
+		Instruction * ins = &state->code[i];
+		if (ins->removed || ins->targeted) continue;
+
+		if (ins->opcode == OP_NEGATE || ins->opcode == OP_BITNEGATE) {
+			size_t a = prevLive(state, i);
+			if (a == SIZE_MAX || state->code[a].opcode != OP_CONSTANT) continue;
+			KrkValue result;
+			if (!foldUnary(ins->opcode, constantOf(state, &state->code[a]), &result)) continue;
+			state->code[a].operand = krk_addConstant(chunk, result);
+			ins->removed = 1;
+			changed = 1;
+		} else if (isBinaryOperator(ins->opcode)) {
+			size_t b = prevLive(state, i);
+			if (b == SIZE_MAX || state->code[b].opcode != OP_CONSTANT || state->code[b].targeted) continue;
+			size_t a = prevLive(state, b);
+			if (a == SIZE_MAX || state->code[a].opcode != OP_CONSTANT) continue;
+			KrkValue result;
+			if (!foldBinary(ins->opcode, constantOf(state, &state->code[a]), constantOf(state, &state->code[b]), &result)) continue;
+			state->code[a].operand = krk_addConstant(chunk, result);
+			state->code[b].removed = 1;
+			ins->removed = 1;
+			changed = 1;
+		} else if (ins->opcode == OP_TUPLE) {
+			size_t length = ins->operand;
+			size_t * elements = malloc(sizeof(size_t) * (length + 1));
+			size_t j = i;
+			size_t found = 0;
+			while (found < length) {
+				j = prevLive(state, j);
+				if (j == SIZE_MAX || state->code[j].opcode != OP_CONSTANT || !isFoldable(constantOf(state, &state->code[j]))) break;
+				elements[length - ++found] = j;
+				if (found < length && state->code[j].targeted) break;
+			}
+			if (found == length) {
+				KrkTuple * tuple = krk_newTuple(length);
+				krk_push(OBJECT_VAL(tuple));
+				for (size_t k = 0; k < length; ++k) {
+					tuple->values.values[tuple->values.count++] = constantOf(state, &state->code[elements[k]]);
+				}
+				size_t index = krk_addConstant(chunk, krk_peek(0));
+				krk_pop();
+				/* The tuple takes the place of its first element, or of the TUPLE instruction itself when empty. */
+				Instruction * into = length ? &state->code[elements[0]] : ins;
+				into->opcode = OP_CONSTANT;
+				into->operand = index;
+				for (size_t k = 1; k < length; ++k) state->code[elements[k]].removed = 1;
+				if (length) ins->removed = 1;
+				changed = 1;
+			}
+			free(elements);
+		}
+	}
+
+	return changed;
+}
+
+static int pushesWithoutEffect(uint8_t opcode) {
+	switch (opcode) {
+		case OP_CONSTANT: case OP_NONE: case OP_TRUE: case OP_FALSE:
+		case OP_GET_LOCAL: case OP_GET_UPVALUE: case OP_DUP:
+			return 1;
+	}
+	return 0;
+}
+
+/* Whether an instruction pushes a value that is known to be true (1), false (0), or neither (-1). */
+static int constantTruth(Optimizer * state, Instruction * ins) {
+	switch (ins->opcode) {
+		case OP_TRUE: return 1;
+		case OP_FALSE: case OP_NONE: return 0;
+		case OP_CONSTANT: {
+			KrkValue value = constantOf(state, ins);
+			if (isNumber(value) || IS_STRING(value) || IS_BYTES(value) || IS_TUPLE(value)) return !krk_isFalsey(value);
+			return -1;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Remove pairs of instructions that cancel out, and jumps to the next
+ * instruction. When the first instruction of a pair is a jump target, jumps
+ * to it are sent to whatever follows the pair.
+ */
+static int removeRedundant(Optimizer * state) {
+	int changed = 0;
+	resolveTargets(state);
+
+	for (size_t i = 0; i < state->count; ++i) {
+		Instruction * ins = &state->code[i];
+		if (ins->removed) continue;
+		size_t n = nextLive(state, i + 1);
+
+		if (ins->opcode == OP_JUMP && ins->operand == n) {
+			ins->removed = 1;
+			changed = 1;
+			continue;
+		}
+
+		if (n >= state->count || state->code[n].targeted) continue;
+		Instruction * next = &state->code[n];
+		int truth = constantTruth(state, ins);
+
+		if ((pushesWithoutEffect(ins->opcode) && next->opcode == OP_POP) ||
+		    (truth == 1 && next->opcode == OP_JUMP_IF_FALSE_OR_POP) ||
+		    (truth == 0 && next->opcode == OP_JUMP_IF_TRUE_OR_POP)) {
+			ins->removed = 1;
+			next->removed = 1;
+			size_t after = nextLive(state, n);
+			if (after < state->count) state->code[after].targeted += ins->targeted;
+			changed = 1;
+		}
+	}
+
+	return changed;
+}
+
+/**
+ * Send jumps that land on unconditional jumps straight to the final target.
+ * A conditional jump that lands on another conditional jump of the same sense
+ * will find the same value there and jump again, so it can be threaded too.
+ * Only unconditional jumps can change direction.
+ */
+static int threadJumps(Optimizer * state) {
+	int changed = 0;
+	resolveTargets(state);
+
+	for (size_t i = 0; i < state->count; ++i) {
+		Instruction * ins = &state->code[i];
+		if (ins->removed || !isJump(ins)) continue;
+		int unconditional = ins->opcode == OP_JUMP || ins->opcode == OP_LOOP;
+
+		size_t target = ins->operand;
+		for (int hops = 0; hops < 16 && target < state->count; ++hops) {
+			Instruction * there = &state->code[target];
+			size_t next;
+			if (there->opcode == OP_JUMP || there->opcode == OP_LOOP) {
+				next = nextLive(state, there->operand);
+			} else if ((ins->opcode == OP_JUMP_IF_FALSE_OR_POP || ins->opcode == OP_JUMP_IF_TRUE_OR_POP) && there->opcode == ins->opcode) {
+				next = nextLive(state, there->operand);
+			} else {
+				break;
+			}
+			if (next == target || next >= state->count) break;
+			if (!unconditional && next <= i) break;
+			/* Code only shrinks, so a distance that fit before will fit afterwards. */
+			size_t from = ins->offset + 3, to = state->code[next].offset;
+			if ((from > to ? from - to : to - from) > 0xFFFF) break;
+			target = next;
+		}
+
+		if (target != ins->operand) {
+			ins->operand = target;
+			if (unconditional) ins->opcode = target > i ? OP_JUMP : OP_LOOP;
+			changed = 1;
+		}
+	}
+
+	return changed;
+}
+
+static int isTerminator(uint8_t opcode) {
+	return opcode == OP_RETURN || opcode == OP_RAISE || opcode == OP_JUMP || opcode == OP_LOOP;
+}
+
+/**
+ * Remove instructions that can not be reached by falling through or jumping
+ * from the start of the code object. Handler targets of PUSH_TRY and
+ * PUSH_WITH are jumps like any other for this purpose.
+ */
+static int removeUnreachable(Optimizer * state) {
+	resolveTargets(state);
+	for (size_t i = 0; i < state->count; ++i) state->code[i].reachable = 0;
+
+	size_t * pending = malloc(sizeof(size_t) * (state->count + 1));
+	size_t pendingCount = 0;
+	pending[pendingCount++] = nextLive(state, 0);
+
+	while (pendingCount) {
+		size_t i = pending[--pendingCount];
+		while (i < state->count && !state->code[i].reachable) {
+			Instruction * ins = &state->code[i];
+			ins->reachable = 1;
+			if (isJump(ins) && ins->operand < state->count && !state->code[ins->operand].reachable) {
+				pending[pendingCount++] = ins->operand;
+			}
+			if (isTerminator(ins->opcode)) break;
+			i = nextLive(state, i + 1);
+		}
+	}
+	free(pending);
+
+	int changed = 0;
+	for (size_t i = 0; i < state->count; ++i) {
+		if (!state->code[i].removed && !state->code[i].reachable) {
+			state->code[i].removed = 1;
+			changed = 1;
+		}
+	}
+	return changed;
+}
+
+static size_t encodedSize(Instruction * ins) {
+	switch (opcodeInfo[ins->opcode].kind) {
+		case KIND_SIMPLE: return 1;
+		case KIND_JUMP: return 3;
+		default: return (ins->operand < 256 ? 2 : 4) + ins->extra;
+	}
+}
+
+typedef struct {
+	KrkValue value;
+	size_t index;
+} ConstantUse;
+
+static int compareConstantUses(const void * a, const void * b) {
+	const ConstantUse * left = a, * right = b;
+	if (left->value != right->value) return left->value < right->value ? -1 : 1;
+	return (left->index > right->index) - (left->index < right->index);
+}
+
+/**
+ * Write the remaining instructions back to the code object, if everything
+ * still fits. Unreferenced constants are dropped and duplicates merged on the way.
+ */
+static void encode(Optimizer * state) {
+	KrkCodeObject * function = state->function;
+	KrkChunk * chunk = &function->chunk;
+
+	/* Map constants that are still in use to their new indexes. */
+	size_t * constantMap = malloc(sizeof(size_t) * (chunk->constants.count + 1));
+	for (size_t i = 0; i < chunk->constants.count; ++i) constantMap[i] = SIZE_MAX;
+	for (size_t i = 0; i < state->count; ++i) {
+		Instruction * ins = &state->code[i];
+		if (!ins->removed && opcodeInfo[ins->opcode].kind == KIND_CONSTANT) constantMap[ins->operand] = 0;
+	}
+
+	if (state->large) {
+		for (size_t i = 0; i < chunk->constants.count; ++i) {
+			if (constantMap[i] != SIZE_MAX) constantMap[i] = i;
+		}
+	} else {
+		/* Find the first use of each distinct value by sorting. */
+		ConstantUse * uses = malloc(sizeof(ConstantUse) * (chunk->constants.count + 1));
+		size_t usesCount = 0;
+		for (size_t i = 0; i < chunk->constants.count; ++i) {
+			if (constantMap[i] == SIZE_MAX) continue;
+			uses[usesCount++] = (ConstantUse){chunk->constants.values[i], i};
+		}
+		qsort(uses, usesCount, sizeof(ConstantUse), compareConstantUses);
+		for (size_t i = 0, first = 0; i < usesCount; ++i) {
+			if (uses[i].value != uses[first].value) first = i;
+			constantMap[uses[i].index] = uses[first].index;
+		}
+		free(uses);
+	}
+
+	KrkValueArray constants;
+	krk_initValueArray(&constants);
+	for (size_t i = 0; i < chunk->constants.count; ++i) {
+		if (constantMap[i] == SIZE_MAX) continue;
+		if (constantMap[i] == i) {
+			constantMap[i] = constants.count;
+			krk_writeValueArray(&constants, chunk->constants.values[i]);
+		} else {
+			constantMap[i] = constantMap[constantMap[i]];
+		}
+	}
+
+	/* Lay out the new bytecode. */
+	size_t * newOffset = malloc(sizeof(size_t) * (state->count + 1));
+	size_t newCount = 0;
+	for (size_t i = 0; i < state->count; ++i) {
+		Instruction * ins = &state->code[i];
+		newOffset[i] = newCount;
+		if (ins->removed) continue;
+		if (opcodeInfo[ins->opcode].kind == KIND_CONSTANT) ins->operand = constantMap[ins->operand];
+		newCount += encodedSize(ins);
+	}
+	newOffset[state->count] = newCount;
+
+	uint8_t * code = malloc(newCount ? newCount : 1);
+	KrkLineMap * lines = malloc(sizeof(KrkLineMap) * (state->count + 1));
+	size_t linesCount = 0;
+	for (size_t i = 0; i < state->count; ++i) {
+		Instruction * ins = &state->code[i];
+		if (ins->removed) continue;
+		uint8_t * out = &code[newOffset[i]];
+		const OpcodeInfo * info = &opcodeInfo[ins->opcode];
+
+		if (!linesCount || lines[linesCount-1].line != ins->line) {
+			lines[linesCount++] = (KrkLineMap){newOffset[i], ins->line};
+		}
+
+		switch (info->kind) {
+			case KIND_SIMPLE:
+				out[0] = ins->opcode;
+				break;
+			case KIND_JUMP: {
+				size_t from = newOffset[i] + 3;
+				size_t to = newOffset[nextLive(state, ins->operand)];
+				size_t distance = info->sign > 0 ? to - from : from - to;
+				if ((info->sign > 0 && to < from) || (info->sign < 0 && to > from) || distance > 0xFFFF) goto _bail;
+				out[0] = ins->opcode;
+				out[1] = distance >> 8;
+				out[2] = distance;
+				break;
+			}
+			default:
+				if (ins->operand < 256) {
+					out[0] = info->shortForm;
+					out[1] = ins->operand;
+					out += 2;
+				} else {
+					out[0] = info->longForm;
+					out[1] = ins->operand >> 16;
+					out[2] = ins->operand >> 8;
+					out[3] = ins->operand;
+					out += 4;
+				}
+				memcpy(out, &chunk->code[ins->offset + ins->size - ins->extra], ins->extra);
+				break;
+		}
+	}
+
+	/* Local lifetimes move to the next instruction that survived. */
+	size_t * offsetMap = malloc(sizeof(size_t) * (chunk->count + 1));
+	for (size_t i = 0; i < state->count; ++i) {
+		size_t moved = newOffset[nextLive(state, i)];
+		for (size_t b = 0; b < state->code[i].size; ++b) offsetMap[state->code[i].offset + b] = moved;
+	}
+	offsetMap[chunk->count] = newCount;
+	for (size_t i = 0; i < function->localNameCount; ++i) {
+		KrkLocalEntry * entry = &function->localNames[i];
+		if (entry->birthday <= chunk->count) entry->birthday = offsetMap[entry->birthday];
+		if (entry->deathday <= chunk->count) entry->deathday = offsetMap[entry->deathday];
+	}
+	free(offsetMap);
+
+	if (newCount > chunk->capacity) {
+		size_t old = chunk->capacity;
+		chunk->capacity = newCount;
+		chunk->code = GROW_ARRAY(uint8_t, chunk->code, old, chunk->capacity);
+	}
+	memcpy(chunk->code, code, newCount);
+	chunk->count = newCount;
+
+	if (linesCount > chunk->linesCapacity) {
+		size_t old = chunk->linesCapacity;
+		chunk->linesCapacity = linesCount;
+		chunk->lines = GROW_ARRAY(KrkLineMap, chunk->lines, old, chunk->linesCapacity);
+	}
+	memcpy(chunk->lines, lines, sizeof(KrkLineMap) * linesCount);
+	chunk->linesCount = linesCount;
+
+	krk_freeValueArray(&chunk->constants);
+	chunk->constants = constants;
+	constants.values = NULL;
+
+_bail:
+	if (constants.values) krk_freeValueArray(&constants);
+	free(lines);
+	free(code);
+	free(newOffset);
+	free(constantMap);
+}
+
+void _optimizeCodeObject(KrkCodeObject * function) {
+	if (krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION) return;
+	if (!function->chunk.count || function->chunk.count > MAX_OPTIMIZED_SIZE) return;
+
+	Optimizer state = {function, NULL, 0, 0};
+	if (!decode(&state)) return;
+	state.large = state.count > MAX_FOLDED_INSTRUCTIONS;
+
+	for (int round = 0; round < MAX_ROUNDS; ++round) {
+		int changed = 0;
+		if (!state.large) changed |= foldConstants(&state);
+		changed |= removeRedundant(&state);
+		changed |= threadJumps(&state);
+		changed |= removeUnreachable(&state);
+		if (!changed) break;
+	}
+
+	encode(&state);
+	free(state.code);
+}
+
+/**
+ * Superinstructions.
+ *
+ * Once a code object is complete, frequent pairs of instructions are fused by
+ * rewriting the opcode of the first instruction in the pair to one that also
+ * performs the second and then skips over it. The second instruction is left
+ * in place, so offsets, jump targets and the line map are all unchanged, and a
+ * jump that lands on the second instruction still runs it alone. Pairs are only
+ * fused within a line, so a breakpoint on the start of a line is never skipped.
+ */
+static KrkOpCode fusedOpcode(KrkOpCode first, KrkOpCode second) {
+	switch (first) {
+		case OP_GET_LOCAL:
+			if (second == OP_GET_LOCAL) return OP_GET_LOCAL_GET_LOCAL;
+			if (second == OP_CONSTANT) return OP_GET_LOCAL_CONSTANT;
+			if (second == OP_GET_PROPERTY) return OP_GET_LOCAL_GET_PROPERTY;
+			break;
+		case OP_SET_LOCAL:
+			if (second == OP_POP) return OP_SET_LOCAL_POP;
+			break;
+		case OP_EQUAL:         if (second == OP_JUMP_IF_FALSE_OR_POP) return OP_EQUAL_JUMP_IF_FALSE; break;
+		case OP_LESS:          if (second == OP_JUMP_IF_FALSE_OR_POP) return OP_LESS_JUMP_IF_FALSE; break;
+		case OP_GREATER:       if (second == OP_JUMP_IF_FALSE_OR_POP) return OP_GREATER_JUMP_IF_FALSE; break;
+		case OP_LESS_EQUAL:    if (second == OP_JUMP_IF_FALSE_OR_POP) return OP_LESS_EQUAL_JUMP_IF_FALSE; break;
+		case OP_GREATER_EQUAL: if (second == OP_JUMP_IF_FALSE_OR_POP) return OP_GREATER_EQUAL_JUMP_IF_FALSE; break;
+		default: break;
+	}
+	return first;
+}
+
+static size_t instructionSize(KrkChunk * chunk, size_t offset) {
+#define SIMPLE(opc) case opc: return 1;
+#define CONSTANT(opc,more) case opc: { size_t constant = chunk->code[offset + 1]; size_t size = 2; (void)constant; more; return size; } \
+	case opc ## _LONG: { size_t constant = (chunk->code[offset + 1] << 16) | \
+	(chunk->code[offset + 2] << 8) | (chunk->code[offset + 3]); size_t size = 4; (void)constant; more; return size; }
+#define OPERANDB(opc,more) case opc: return 2;
+#define OPERAND(opc,more) OPERANDB(opc,more) case opc ## _LONG: return 4;
+#define JUMP(opc,sign) case opc: return 3;
+#define CLOSURE_MORE size += AS_codeobject(chunk->constants.values[constant])->upvalueCount * 2
+#define EXPAND_ARGS_MORE
+#define LOCAL_MORE
+	switch (chunk->code[offset]) {
+#include "opcodes.h"
+	}
+	return 1;
+#undef SIMPLE
+#undef OPERANDB
+#undef OPERAND
+#undef CONSTANT
+#undef JUMP
+#undef CLOSURE_MORE
+#undef LOCAL_MORE
+#undef EXPAND_ARGS_MORE
+}
+
+void _fuseInstructions(KrkCodeObject * function) {
+	KrkChunk * chunk = &function->chunk;
+	size_t line = 0;
+	size_t offset = 0;
+	while (offset < chunk->count) {
+		size_t size = instructionSize(chunk, offset);
+		size_t next = offset + size;
+		if (next >= chunk->count) break;
+
+		/* Find the start of the line after the one containing this instruction. */
+		while (line < chunk->linesCount && chunk->lines[line].startOffset <= offset) line++;
+		int sameLine = line == chunk->linesCount || chunk->lines[line].startOffset > next;
+
+		KrkOpCode fused = sameLine ? fusedOpcode(chunk->code[offset], chunk->code[next]) : chunk->code[offset];
+		if (fused != chunk->code[offset]) {
+			chunk->code[offset] = fused;
+			/* Don't start another pair on the instruction that was just absorbed. */
+			next += instructionSize(chunk, next);
+		}
+		offset = next;
+	}
+}
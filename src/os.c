@@ -9,6 +9,7 @@
 #include <sys/types.h>
 #ifndef _WIN32
 #include <sys/utsname.h>
+#include <sys/wait.h>
 #else
 #include <windows.h>
 #endif
@@ -391,6 +392,27 @@ KRK_FUNC(fork,{
 	return INTEGER_VAL(fork());
 })
 
+KRK_FUNC(waitpid,{
+	FUNCTION_TAKES_AT_LEAST(1);
+	FUNCTION_TAKES_AT_MOST(2);
+	CHECK_ARG(0,int,krk_integer_type,pid);
+	int options = 0;
+	if (argc > 1) {
+		CHECK_ARG(1,int,krk_integer_type,_options);
+		options = _options;
+	}
+	int status = 0;
+	pid_t result = waitpid(pid, &status, options);
+	if (result == -1) {
+		return krk_runtimeError(OSError, "%s", strerror(errno));
+	}
+	krk_push(OBJECT_VAL(krk_newTuple(2)));
+	AS_TUPLE(krk_peek(0))->values.values[0] = INTEGER_VAL(result);
+	AS_TUPLE(krk_peek(0))->values.values[1] = INTEGER_VAL(status);
+	AS_TUPLE(krk_peek(0))->values.count = 2;
+	return krk_pop();
+})
+
 KRK_FUNC(symlink,{
 	FUNCTION_TAKES_EXACTLY(2);
 	CHECK_ARG(0,str,KrkString*,src);
@@ -814,6 +836,13 @@ void _createAndBind_osMod(void) {
 	KRK_DOC(BIND_FUNC(module,fork),
 		"@brief Fork the current process.\n\n"
 		"Returns the PID of the new child process in the original process and @c 0 in the child.");
+	KRK_DOC(BIND_FUNC(module,waitpid),
+		"@brief Wait for a child process to change state.\n"
+		"@arguments pid,options=0\n\n"
+		"Waits for the child process @p pid, or any child if @p pid is @c -1, and returns a two-tuple "
+		"of its PID and its raw wait status, which is @c 0 if it exited with status @c 0. "
+		"With @c WNOHANG in @p options, returns a PID of @c 0 if no child has changed state.");
+	DO_INT(WNOHANG);
 	KRK_DOC(BIND_FUNC(module,symlink),
 		"@brief Create a symbolic link.\n"
 		"@arguments src,dst\n\n"
@@ -0,0 +1,169 @@
+/**
+ * @file    parseargs.c
+ * @brief   Declarative argument parsing for native functions.
+ *
+ * See @ref krk_parseArgs_impl for the format specification.
+ */
+#include <stdarg.h>
+#include <string.h>
+#include <kuroko/vm.h>
+#include <kuroko/value.h>
+#include <kuroko/object.h>
+#include <kuroko/util.h>
+#include <kuroko/threads.h>
+
+static const char * typeNameFor(char spec) {
+	switch (spec) {
+		case 'i': return "int";
+		case 'd': return "float";
+		case 's': case 'S': return "str";
+		case 'z': return "str or None";
+		case 'y': return "bytes";
+		default:  return "object";
+	}
+}
+
+/**
+ * Store @p arg to the local behind @p out, according to its format character.
+ * Returns 0 if the value has the wrong type.
+ */
+static int convertArg(char spec, KrkValue arg, void * out) {
+	switch (spec) {
+		case 'O':
+			*(KrkValue*)out = arg;
+			return 1;
+		case 'i':
+			if (!IS_INTEGER(arg)) return 0;
+			*(krk_integer_type*)out = AS_INTEGER(arg);
+			return 1;
+		case 'd':
+			if (IS_FLOATING(arg)) *(double*)out = AS_FLOATING(arg);
+			else if (IS_INTEGER(arg)) *(double*)out = (double)AS_INTEGER(arg);
+			else return 0;
+			return 1;
+		case 'p':
+			*(int*)out = !krk_isFalsey(arg);
+			return 1;
+		case 'z':
+			if (IS_NONE(arg)) {
+				*(const char**)out = NULL;
+				return 1;
+			}
+			/* fallthrough */
+		case 's':
+			if (!IS_STRING(arg)) return 0;
+			*(const char**)out = AS_CSTRING(arg);
+			return 1;
+		case 'S':
+			if (!IS_STRING(arg)) return 0;
+			*(KrkString**)out = AS_STRING(arg);
+			return 1;
+		case 'y':
+			if (!IS_BYTES(arg)) return 0;
+			*(KrkBytes**)out = AS_BYTES(arg);
+			return 1;
+	}
+	return 0;
+}
+
+/* Held while a call site's names are interned, so no thread sees a partly filled cache. */
+static volatile int _internLock = 0;
+
+int krk_parseArgs_impl(const char * methodName, int argc, const KrkValue argv[], int hasKw,
+		const char * format, const char * const names[], size_t * generation, KrkString ** interned, ...) {
+	size_t argCount = 0, positionalCount = 0, requiredCount = 0;
+	int optional = 0, keywordOnly = 0;
+	for (const char * c = format; *c; ++c) {
+		if (*c == '|') optional = 1;
+		else if (*c == '$') keywordOnly = 1;
+		else {
+			if (!keywordOnly) positionalCount++;
+			if (!optional) requiredCount++;
+			argCount++;
+		}
+	}
+
+	/* The names are published only once all of them are interned, and interned again for a new VM. */
+	if (unlikely(argCount && __atomic_load_n(generation, __ATOMIC_ACQUIRE) != vm.generation)) {
+		_obtain_lock(_internLock);
+		if (*generation != vm.generation) {
+			for (size_t i = 0; i < argCount; ++i) {
+				interned[i] = krk_copyString(names[i], strlen(names[i]));
+				interned[i]->obj.flags |= KRK_OBJ_FLAGS_IMMORTAL;
+			}
+			__atomic_store_n(generation, vm.generation, __ATOMIC_RELEASE);
+		}
+		_release_lock(_internLock);
+	}
+
+	if (unlikely((size_t)argc > positionalCount)) {
+		krk_runtimeError(vm.exceptions->argumentError, "%s() takes %s %d argument%s (%d given)",
+			methodName, (positionalCount == requiredCount) ? "exactly" : "at most",
+			(int)positionalCount, positionalCount == 1 ? "" : "s", argc);
+		return 0;
+	}
+
+	KrkTable * keywords = hasKw ? AS_DICT(argv[argc]) : NULL;
+	size_t keywordsFound = 0;
+	size_t index = 0;
+	optional = 0;
+
+	va_list args;
+	va_start(args, interned);
+	for (const char * c = format; *c; ++c) {
+		if (*c == '|') { optional = 1; continue; }
+		if (*c == '$') continue;
+
+		void * out = va_arg(args, void*);
+		KrkValue arg = KWARGS_VAL(0);
+
+		if (index < (size_t)argc) arg = argv[index];
+
+		if (keywords && keywords->count) {
+			KrkValue fromKeyword;
+			if (krk_tableGet_fast(keywords, interned[index], &fromKeyword)) {
+				if (!IS_KWARGS(arg)) {
+					krk_runtimeError(vm.exceptions->typeError, "%s() got multiple values for argument '%s'", methodName, names[index]);
+					goto _error;
+				}
+				arg = fromKeyword;
+				keywordsFound++;
+			}
+		}
+
+		if (IS_KWARGS(arg)) {
+			if (!optional) {
+				krk_runtimeError(vm.exceptions->typeError, "%s() missing required positional argument: '%s'", methodName, names[index]);
+				goto _error;
+			}
+		} else if (!convertArg(*c, arg, out)) {
+			if (!(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) {
+				krk_runtimeError(vm.exceptions->typeError, "%s() argument '%s' must be %s, not '%s'",
+					methodName, names[index], typeNameFor(*c), krk_typeName(arg));
+			}
+			goto _error;
+		}
+		index++;
+	}
+	va_end(args);
+
+	if (keywords && keywordsFound < keywords->count) {
+		for (size_t i = 0; i < keywords->capacity; ++i) {
+			KrkTableEntry * entry = &keywords->entries[i];
+			if (IS_KWARGS(entry->key)) continue;
+			size_t j = 0;
+			while (j < argCount && !(IS_STRING(entry->key) && AS_STRING(entry->key) == interned[j])) j++;
+			if (j == argCount) {
+				krk_runtimeError(vm.exceptions->typeError, "%s() got an unexpected keyword argument '%s'",
+					methodName, IS_STRING(entry->key) ? AS_CSTRING(entry->key) : "?");
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+
+_error:
+	va_end(args);
+	return 0;
+}
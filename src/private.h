@@ -5,7 +5,175 @@
  * These functions are not part of the public API for Kuroko.
  * They are used internally by the interpreter library.
  */
+#include <string.h>
 #include "kuroko/kuroko.h"
+#include "kuroko/object.h"
+#include "kuroko/vm.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief Encodings with native support in @c str.encode and @c bytes.decode
+ */
+typedef enum {
+	KRK_ENCODING_UTF8,
+	KRK_ENCODING_LATIN1,
+	KRK_ENCODING_UNKNOWN,
+} KrkEncoding;
+
+extern KrkEncoding _encodingFromName(const char * name);
+
+/**
+ * @brief Count the leading ASCII bytes of a buffer.
+ *
+ * Used to skip over runs of plain ASCII when validating or transcoding
+ * UTF-8. Examines sixteen bytes at a time with SSE2 where it is available,
+ * and otherwise eight bytes at a time in a general-purpose register.
+ */
+static inline size_t _asciiPrefix(const unsigned char * bytes, size_t length) {
+	size_t i = 0;
+#ifdef __SSE2__
+	for (; i + 16 <= length; i += 16) {
+		int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(bytes + i)));
+		if (mask) return i + __builtin_ctz(mask);
+	}
+#endif
+	for (; i + 8 <= length; i += 8) {
+		uint64_t word;
+		memcpy(&word, bytes + i, 8);
+		if (word & 0x8080808080808080ULL) break;
+	}
+	while (i < length && bytes[i] < 0x80) i++;
+	return i;
+}
+
+/**
+ * @brief Simplify the bytecode of a newly compiled code object.
+ *
+ * Folds constants, threads jumps, and removes unreachable and redundant
+ * instructions. See @c optimizer.c for details.
+ */
+extern void _optimizeCodeObject(KrkCodeObject * function);
+
+/**
+ * @brief Fuse frequent pairs of instructions into superinstructions.
+ *
+ * Only opcode bytes are rewritten; offsets are unaffected.
+ */
+extern void _fuseInstructions(KrkCodeObject * function);
+
+/**
+ * @brief Resume a generator in a new call frame of the running VM loop.
+ *
+ * Used by OP_CALL_ITER so that iterating over a generator does not
+ * re-enter the VM. Returns 1 if a frame was pushed, 0 if the generator
+ * is finished, and -1 if it can not be resumed this way and should be
+ * called normally.
+ */
+extern int _generatorResume(KrkInstance * generator);
+
+/**
+ * @brief Save the state of a frame pushed by _generatorResume() when it yields.
+ */
+extern void _generatorYield(KrkCallFrame * frame);
+
+/**
+ * @brief Mark a generator resumed by _generatorResume() as finished.
+ */
+extern void _generatorFinish(KrkInstance * generator, KrkValue result);
+
+/**
+ * @brief Fold samples pending in the profiler's ring buffer into its stack counts.
+ *
+ * Called by the VM when the profiler's signal handler sets KRK_THREAD_PROFILE_DRAIN.
+ */
+extern void _profilerDrain(void);
+
+/**
+ * @brief Mark the code objects referenced by collected profiler samples.
+ */
+extern void _profilerMarkRoots(void);
+
+/**
+ * @brief Attribute time to the line @p frame is about to execute.
+ *
+ * Called by the VM before each instruction while KRK_THREAD_LINE_PROFILE is set.
+ */
+extern void _lineProfilerStep(KrkCallFrame * frame);
+
+/**
+ * @brief Mark the code objects selected for line profiling.
+ */
+extern void _lineProfilerMarkRoots(void);
+
+/**
+ * @brief Count the instruction @p frame is about to execute.
+ *
+ * Called by the VM before each instruction while KRK_THREAD_COUNT_INSTRUCTIONS is set.
+ */
+extern void _debugCountInstruction(KrkCallFrame * frame);
+
+/**
+ * @brief Call the functions in gc.callbacks after a collection.
+ *
+ * Called by the VM when a collection has set KRK_THREAD_GC_CALLBACKS.
+ */
+extern void _gcRunCallbacks(void);
+
+/**
+ * @brief Report an exception that no code can catch, and carry on.
+ *
+ * Prints the traceback as for an uncaught exception, then unwinds the
+ * call frames and stack to the given depths and clears the exception.
+ */
+extern void _reportUnraisable(size_t frameCount, size_t stackOffset);
+
+/**
+ * @brief Tell the allocation tracer a block is about to be resized or released.
+ *
+ * Called by krk_reallocate() while KRK_GLOBAL_TRACE_ALLOCATIONS is set.
+ * @return 1 if the block was being traced.
+ */
+extern int _tracemallocRelease(void * ptr);
+
+/**
+ * @brief Tell the allocation tracer a block was allocated or resized.
+ *
+ * @p wasTraced is the result of _tracemallocRelease() for the block's old address.
+ */
+extern void _tracemallocAllocate(void * ptr, size_t oldSize, size_t newSize, int wasTraced);
+
+/**
+ * @brief Mark the code objects of the allocation tracer's sites.
+ */
+extern void _tracemallocMarkRoots(void);
+
+/**
+ * @brief Record the start of a call to the frame that was just pushed.
+ *
+ * Called by the VM while KRK_GLOBAL_TRACE_EVENTS is set, and also for generator
+ * frames each time they are resumed.
+ */
+extern void _traceEnter(KrkCallFrame * frame);
+
+/**
+ * @brief Record the end of the innermost call, before its frame is popped.
+ */
+extern void _traceExit(void);
+
+/**
+ * @brief Record the end of every call deeper than @p depth frames.
+ *
+ * Called when an exception discards frames.
+ */
+extern void _traceUnwind(size_t depth);
+
+/**
+ * @brief Write out and release the trace event ring of a thread that is exiting.
+ */
+extern void _traceThreadExit(void);
 
 extern void _createAndBind_numericClasses(void);
 extern void _createAndBind_strClass(void);
@@ -21,6 +189,10 @@ extern void _createAndBind_builtins(void);
 extern void _createAndBind_type(void);
 extern void _createAndBind_exceptions(void);
 extern void _createAndBind_gcMod(void);
+extern void _createAndBind_profilerMod(void);
+extern void _createAndBind_lineprofilerMod(void);
+extern void _createAndBind_tracemallocMod(void);
+extern void _createAndBind_traceMod(void);
 extern void _createAndBind_timeMod(void);
 extern void _createAndBind_osMod(void);
 extern void _createAndBind_fileioMod(void);
@@ -0,0 +1,367 @@
+/**
+ * @file    profiler.c
+ * @brief   Statistical sampling profiler and the @c profiler module.
+ *
+ * A SIGPROF interval timer interrupts the profiled thread. The timer is
+ * process-wide, so its signals can arrive on any thread; those that arrive
+ * on another thread are counted as dropped. The signal handler copies the code objects of the thread's call frames into a ring
+ * buffer of words: each sample is its depth followed by that many code
+ * objects, outermost first. When the ring is half full, the handler sets
+ * KRK_THREAD_PROFILE_DRAIN and the VM folds the pending samples into a
+ * hash table of distinct stacks before its next instruction; samples that
+ * arrive while the ring is full are counted as dropped.
+ *
+ * The code objects in the ring and in the stack table are marked by the
+ * garbage collector, so their names are still available for output after
+ * the functions themselves are gone.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include <kuroko/vm.h>
+#include <kuroko/value.h>
+#include <kuroko/object.h>
+#include <kuroko/util.h>
+#include <kuroko/profiler.h>
+
+#include "private.h"
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+# include <signal.h>
+# include <sys/time.h>
+# define PROFILER_SUPPORTED 1
+#endif
+
+/* Words in the sample ring; a power of two. */
+#define RING_SIZE (1 << 16)
+#define RING_MASK (RING_SIZE - 1)
+
+/**
+ * @brief A distinct call stack and the number of samples that saw it.
+ */
+struct ProfileStack {
+	uint32_t hash;
+	size_t depth;
+	size_t count;
+	KrkCodeObject ** frames;
+};
+
+static struct {
+	KrkThreadState * thread;       /* Thread being sampled, or NULL when stopped */
+	int frequency;
+#ifdef PROFILER_SUPPORTED
+	struct sigaction previous;     /* SIGPROF handler to restore when stopped */
+#endif
+	uintptr_t * ring;
+	volatile size_t head;          /* Written only by the signal handler */
+	size_t tail;                   /* Written only by the drain */
+	volatile size_t dropped;
+	size_t samples;
+	size_t stackCount;
+	size_t stackCapacity;
+	struct ProfileStack * stacks;  /* Open-addressed; unused entries have no frames */
+} profiler;
+
+#ifdef PROFILER_SUPPORTED
+static void sampleHandler(int signum) {
+	(void)signum;
+	if (&krk_currentThread != profiler.thread) {
+		__atomic_fetch_add(&profiler.dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	size_t depth = krk_currentThread.frameCount;
+	if (!depth) return;
+
+	size_t head = profiler.head;
+	if (head - profiler.tail + depth + 1 > RING_SIZE) {
+		__atomic_fetch_add(&profiler.dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	profiler.ring[head & RING_MASK] = depth;
+	for (size_t i = 0; i < depth; ++i) {
+		profiler.ring[(head + 1 + i) & RING_MASK] = (uintptr_t)krk_currentThread.frames[i].closure->function;
+	}
+	__atomic_signal_fence(__ATOMIC_RELEASE);
+	profiler.head = head + depth + 1;
+
+	/* The VM may be part way through updating its own flags, so this must be atomic. */
+	if (profiler.head - profiler.tail > RING_SIZE / 2) {
+		__atomic_fetch_or(&krk_currentThread.flags, KRK_THREAD_PROFILE_DRAIN, __ATOMIC_RELAXED);
+	}
+}
+#endif
+
+static uint32_t hashFrames(KrkCodeObject ** frames, size_t depth) {
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < depth; ++i) {
+		hash = (hash ^ (uint32_t)((uintptr_t)frames[i] >> 4)) * 16777619u;
+	}
+	return hash;
+}
+
+static struct ProfileStack * findStack(KrkCodeObject ** frames, size_t depth, uint32_t hash) {
+	size_t index = hash & (profiler.stackCapacity - 1);
+	for (;;) {
+		struct ProfileStack * stack = &profiler.stacks[index];
+		if (!stack->frames) return stack;
+		if (stack->hash == hash && stack->depth == depth && !memcmp(stack->frames, frames, sizeof(KrkCodeObject*) * depth)) return stack;
+		index = (index + 1) & (profiler.stackCapacity - 1);
+	}
+}
+
+static void growStacks(void) {
+	struct ProfileStack * old = profiler.stacks;
+	size_t oldCapacity = profiler.stackCapacity;
+	profiler.stackCapacity = oldCapacity ? oldCapacity * 2 : 64;
+	profiler.stacks = calloc(profiler.stackCapacity, sizeof(struct ProfileStack));
+	for (size_t i = 0; i < oldCapacity; ++i) {
+		if (!old[i].frames) continue;
+		*findStack(old[i].frames, old[i].depth, old[i].hash) = old[i];
+	}
+	free(old);
+}
+
+static void recordStack(KrkCodeObject ** frames, size_t depth) {
+	if ((profiler.stackCount + 1) * 4 > profiler.stackCapacity * 3) growStacks();
+	uint32_t hash = hashFrames(frames, depth);
+	struct ProfileStack * stack = findStack(frames, depth, hash);
+	if (!stack->frames) {
+		stack->hash = hash;
+		stack->depth = depth;
+		stack->count = 0;
+		stack->frames = malloc(sizeof(KrkCodeObject*) * depth);
+		memcpy(stack->frames, frames, sizeof(KrkCodeObject*) * depth);
+		profiler.stackCount++;
+	}
+	stack->count++;
+	profiler.samples++;
+}
+
+void _profilerDrain(void) {
+	__atomic_fetch_and(&krk_currentThread.flags, ~KRK_THREAD_PROFILE_DRAIN, __ATOMIC_RELAXED);
+	if (!profiler.ring) return;
+
+	size_t head = profiler.head;
+	__atomic_signal_fence(__ATOMIC_ACQUIRE);
+
+	KrkCodeObject * frames[KRK_CALL_FRAMES_MAX];
+	size_t tail = profiler.tail;
+	while (tail != head) {
+		size_t depth = profiler.ring[tail & RING_MASK];
+		for (size_t i = 0; i < depth; ++i) {
+			frames[i] = (KrkCodeObject*)profiler.ring[(tail + 1 + i) & RING_MASK];
+		}
+		recordStack(frames, depth);
+		tail += depth + 1;
+	}
+	profiler.tail = tail;
+}
+
+void _profilerMarkRoots(void) {
+	if (profiler.ring) {
+		for (size_t i = profiler.tail; i != profiler.head;) {
+			size_t depth = profiler.ring[i & RING_MASK];
+			for (size_t j = 0; j < depth; ++j) {
+				krk_markObject((KrkObj*)profiler.ring[(i + 1 + j) & RING_MASK]);
+			}
+			i += depth + 1;
+		}
+	}
+	for (size_t i = 0; i < profiler.stackCapacity; ++i) {
+		struct ProfileStack * stack = &profiler.stacks[i];
+		for (size_t j = 0; stack->frames && j < stack->depth; ++j) {
+			krk_markObject((KrkObj*)stack->frames[j]);
+		}
+	}
+}
+
+int krk_profilerStart(int frequency) {
+#ifdef PROFILER_SUPPORTED
+	if (profiler.thread || frequency <= 0) return 0;
+	if (!profiler.ring) profiler.ring = malloc(sizeof(uintptr_t) * RING_SIZE);
+
+	profiler.frequency = frequency;
+	profiler.thread = &krk_currentThread;
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = sampleHandler;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGPROF, &action, &profiler.previous);
+
+	struct itimerval timer;
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_usec = frequency >= 1000000 ? 1 : 1000000 / frequency;
+	timer.it_value = timer.it_interval;
+	setitimer(ITIMER_PROF, &timer, NULL);
+	return 1;
+#else
+	(void)frequency;
+	return 0;
+#endif
+}
+
+void krk_profilerStop(void) {
+#ifdef PROFILER_SUPPORTED
+	if (!profiler.thread) return;
+
+	struct itimerval timer;
+	memset(&timer, 0, sizeof(timer));
+	setitimer(ITIMER_PROF, &timer, NULL);
+	sigaction(SIGPROF, &profiler.previous, NULL);
+	profiler.thread = NULL;
+
+	_profilerDrain();
+#endif
+}
+
+void krk_profilerReset(void) {
+	for (size_t i = 0; i < profiler.stackCapacity; ++i) {
+		free(profiler.stacks[i].frames);
+	}
+	free(profiler.stacks);
+	profiler.stacks = NULL;
+	profiler.stackCapacity = 0;
+	profiler.stackCount = 0;
+	profiler.samples = 0;
+	profiler.dropped = 0;
+	profiler.tail = profiler.head;
+
+	/* A stopped profiler has nothing pending, so the ring can go until it is started again. */
+	if (!profiler.thread) {
+		free(profiler.ring);
+		profiler.ring = NULL;
+	}
+}
+
+static const char * frameFile(KrkCodeObject * code) {
+	return code->chunk.filename ? code->chunk.filename->chars : "<unknown>";
+}
+
+static const char * frameName(KrkCodeObject * code) {
+	if (code->qualname) return code->qualname->chars;
+	return code->name ? code->name->chars : "<unnamed>";
+}
+
+KrkValue krk_profilerStacks(void) {
+	_profilerDrain();
+	KrkValue result = krk_dict_of(0, NULL, 0);
+	krk_push(result);
+	for (size_t i = 0; i < profiler.stackCapacity; ++i) {
+		struct ProfileStack * stack = &profiler.stacks[i];
+		if (!stack->frames) continue;
+		struct StringBuilder sb = {0};
+		for (size_t j = 0; j < stack->depth; ++j) {
+			const char * file = frameFile(stack->frames[j]);
+			const char * name = frameName(stack->frames[j]);
+			if (j) pushStringBuilder(&sb, ';');
+			pushStringBuilderStr(&sb, (char*)file, strlen(file));
+			pushStringBuilder(&sb, ':');
+			pushStringBuilderStr(&sb, (char*)name, strlen(name));
+		}
+		krk_push(finishStringBuilder(&sb));
+		/* Distinct code objects can share a name; their counts add up. */
+		KrkValue existing = INTEGER_VAL(0);
+		krk_tableGet(AS_DICT(result), krk_peek(0), &existing);
+		krk_tableSet(AS_DICT(result), krk_peek(0), INTEGER_VAL(AS_INTEGER(existing) + stack->count));
+		krk_pop();
+	}
+	return krk_pop();
+}
+
+void krk_profilerWriteFolded(FILE * f) {
+	_profilerDrain();
+	for (size_t i = 0; i < profiler.stackCapacity; ++i) {
+		struct ProfileStack * stack = &profiler.stacks[i];
+		if (!stack->frames) continue;
+		for (size_t j = 0; j < stack->depth; ++j) {
+			fprintf(f, "%s%s:%s", j ? ";" : "", frameFile(stack->frames[j]), frameName(stack->frames[j]));
+		}
+		fprintf(f, " %zu\n", stack->count);
+	}
+}
+
+static const char * const startArgs[] = {"frequency"};
+KRK_FUNC(start,{
+	krk_integer_type frequency = 100;
+	if (!krk_parseArgs("|i", startArgs, &frequency)) return NONE_VAL();
+	if (frequency <= 0) return krk_runtimeError(vm.exceptions->valueError, "frequency must be positive");
+	if (profiler.thread) return krk_runtimeError(vm.exceptions->valueError, "profiler is already running");
+	if (!krk_profilerStart(frequency)) return krk_runtimeError(vm.exceptions->notImplementedError, "sampling is not supported on this platform");
+})
+
+KRK_FUNC(stop,{
+	FUNCTION_TAKES_NONE();
+	krk_profilerStop();
+})
+
+KRK_FUNC(reset,{
+	FUNCTION_TAKES_NONE();
+	krk_profilerReset();
+})
+
+KRK_FUNC(running,{
+	FUNCTION_TAKES_NONE();
+	return BOOLEAN_VAL(profiler.thread != NULL);
+})
+
+KRK_FUNC(stacks,{
+	FUNCTION_TAKES_NONE();
+	return krk_profilerStacks();
+})
+
+KRK_FUNC(stats,{
+	FUNCTION_TAKES_NONE();
+	_profilerDrain();
+	KrkValue result = krk_dict_of(0, NULL, 0);
+	krk_push(result);
+	krk_attachNamedValue(AS_DICT(result), "samples", INTEGER_VAL(profiler.samples));
+	krk_attachNamedValue(AS_DICT(result), "dropped", INTEGER_VAL(profiler.dropped));
+	krk_attachNamedValue(AS_DICT(result), "stacks", INTEGER_VAL(profiler.stackCount));
+	krk_attachNamedValue(AS_DICT(result), "frequency", INTEGER_VAL(profiler.frequency));
+	return krk_pop();
+})
+
+static const char * const writeArgs[] = {"path"};
+KRK_FUNC(write,{
+	const char * path;
+	if (!krk_parseArgs("s", writeArgs, &path)) return NONE_VAL();
+	FILE * f = fopen(path, "w");
+	if (!f) return krk_runtimeError(vm.exceptions->ioError, "%s: could not open for writing", path);
+	krk_profilerWriteFolded(f);
+	fclose(f);
+})
+
+_noexport
+void _createAndBind_profilerMod(void) {
+	KrkInstance * module = krk_newInstance(vm.baseClasses->moduleClass);
+	krk_attachNamedObject(&vm.modules, "profiler", (KrkObj*)module);
+	krk_attachNamedObject(&module->fields, "__name__", (KrkObj*)S("profiler"));
+	krk_attachNamedValue(&module->fields, "__file__", NONE_VAL());
+	KRK_DOC(module, "@brief Statistical sampling profiler.\n\n"
+		"Samples the call stack of the thread that started it at a fixed rate of CPU time. "
+		"Stacks are reported in the folded format used by flamegraph tools: "
+		"@c file:function frames from outermost to innermost, separated by semicolons.");
+	KRK_DOC(BIND_FUNC(module,start),
+		"@brief Start sampling the current thread.\n"
+		"@arguments frequency=100\n\n"
+		"@p frequency is in samples per second of CPU time. Samples are added to any already collected.");
+	KRK_DOC(BIND_FUNC(module,stop),
+		"@brief Stop sampling. Collected samples are kept.");
+	KRK_DOC(BIND_FUNC(module,reset),
+		"@brief Discard all collected samples.");
+	KRK_DOC(BIND_FUNC(module,running),
+		"@brief Whether the profiler is currently sampling.");
+	KRK_DOC(BIND_FUNC(module,stacks),
+		"@brief Get a @ref dict mapping each folded stack to the number of samples that saw it.");
+	KRK_DOC(BIND_FUNC(module,stats),
+		"@brief Get a @ref dict with the number of @c samples, @c dropped samples, distinct @c stacks, and the sampling @c frequency.\n\n"
+		"Samples are dropped when the buffer is full, and when the timer, which counts the CPU time of the whole "
+		"process, fires on a thread other than the one being profiled.");
+	KRK_DOC(BIND_FUNC(module,write),
+		"@brief Write the collected samples as folded stacks to the file at @p path.\n"
+		"@arguments path");
+}
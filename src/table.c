@@ -15,11 +15,14 @@ void krk_initTable(KrkTable * table) {
 	table->count = 0;
 	table->capacity = 0;
 	table->entries = NULL;
+	table->version = 1;
 }
 
 void krk_freeTable(KrkTable * table) {
 	FREE_ARRAY(KrkTableEntry, table->entries, table->capacity);
+	size_t version = table->version;
 	krk_initTable(table);
+	table->version = version + 1;
 }
 
 inline int krk_hashValue(KrkValue value, uint32_t *hashOut) {
@@ -111,6 +114,7 @@ void krk_tableAdjustCapacity(KrkTable * table, size_t capacity) {
 	FREE_ARRAY(KrkTableEntry, table->entries, table->capacity);
 	table->entries = entries;
 	table->capacity = capacity;
+	table->version++;
 }
 
 int krk_tableSet(KrkTable * table, KrkValue key, KrkValue value) {
@@ -121,7 +125,10 @@ int krk_tableSet(KrkTable * table, KrkValue key, KrkValue value) {
 	KrkTableEntry * entry = krk_findEntry(table->entries, table->capacity, key);
 	if (!entry) return 0;
 	int isNewKey = IS_KWARGS(entry->key);
-	if (isNewKey && IS_NONE(entry->value)) table->count++;
+	if (isNewKey) {
+		if (IS_NONE(entry->value)) table->count++;
+		table->version++;
+	}
 	entry->key = key;
 	entry->value = value;
 	return isNewKey;
@@ -161,6 +168,20 @@ int krk_tableGet_fast(KrkTable * table, KrkString * str, KrkValue * value) {
 	}
 }
 
+KrkTableEntry * krk_tableGetEntry_fast(KrkTable * table, KrkString * str) {
+	if (unlikely(table->count == 0)) return NULL;
+	uint32_t index = str->obj.hash & (table->capacity-1);
+	for (;;) {
+		KrkTableEntry * entry = &table->entries[index];
+		if (IS_KWARGS(entry->key)) {
+			if (IS_NONE(entry->value)) return NULL;
+		} else if (IS_OBJECT(entry->key) && AS_OBJECT(entry->key) == (KrkObj*)str) {
+			return entry;
+		}
+		index = (index + 1) & (table->capacity-1);
+	}
+}
+
 int krk_tableDelete(KrkTable * table, KrkValue key) {
 	if (table->count == 0) return 0;
 	KrkTableEntry * entry = krk_findEntry(table->entries, table->capacity, key);
@@ -169,6 +190,7 @@ int krk_tableDelete(KrkTable * table, KrkValue key) {
 	}
 	entry->key = KWARGS_VAL(0);
 	entry->value = BOOLEAN_VAL(1);
+	table->version++;
 	return 1;
 }
 
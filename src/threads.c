@@ -5,6 +5,8 @@
 #ifdef ENABLE_THREADING
 #include <kuroko/util.h>
 
+#include "private.h"
+
 #include <unistd.h>
 #include <pthread.h>
 
@@ -92,6 +94,7 @@ static void * _startthread(void * _threadObj) {
 	}
 
 	self->alive = 0;
+	_traceThreadExit();
 
 	/* Remove this thread from the thread pool, its stack is garbage anyway */
 	_obtain_lock(_threadLock);
@@ -18,11 +18,19 @@ KRK_FUNC(sleep,{
 		return TYPE_ERROR(int or float,argv[0]);
 	}
 
-	unsigned int usecs = (IS_INTEGER(argv[0]) ? AS_INTEGER(argv[0]) :
-	                      (IS_FLOATING(argv[0]) ? AS_FLOATING(argv[0]) : 0)) *
-	                      1000000;
+	double secs = IS_INTEGER(argv[0]) ? (double)AS_INTEGER(argv[0]) : AS_FLOATING(argv[0]);
+	if (secs != secs) return krk_runtimeError(vm.exceptions->valueError, "sleep length must not be NaN");
+	if (!(secs >= 0.0)) return krk_runtimeError(vm.exceptions->valueError, "sleep length must be non-negative");
+	/* Converting infinite or larger values to time_t is undefined. */
+	if (secs >= (double)((uint64_t)1 << (sizeof(time_t) * 8 - 1))) {
+		return krk_runtimeError(vm.exceptions->valueError, "sleep length is too large");
+	}
 
-	usleep(usecs);
+	/* An interrupted sleep returns early, so a pending signal can be handled. */
+	struct timespec ts;
+	ts.tv_sec = (time_t)secs;
+	ts.tv_nsec = (long)((secs - (double)ts.tv_sec) * 1000000000.0);
+	nanosleep(&ts, NULL);
 
 	return BOOLEAN_VAL(1);
 })
@@ -38,6 +46,67 @@ KRK_FUNC(time,{
 	return FLOATING_VAL(out);
 })
 
+/*
+ * Integers are 32 bits, so nanosecond counts are returned as floats. Doubles hold
+ * whole nanoseconds exactly for about 104 days, which covers clocks that count
+ * from boot or from the start of the process.
+ */
+static KrkValue readClock(clockid_t clock, int nanoseconds) {
+	struct timespec ts;
+	if (clock_gettime(clock, &ts)) {
+		return krk_runtimeError(vm.exceptions->ioError, "%s", strerror(errno));
+	}
+	if (nanoseconds) return FLOATING_VAL((double)ts.tv_sec * 1000000000.0 + (double)ts.tv_nsec);
+	return FLOATING_VAL((double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0);
+}
+
+/* The raw monotonic clock is not slewed by NTP, so intervals measured with it are not stretched or shrunk. */
+#ifdef CLOCK_MONOTONIC_RAW
+# define PERF_CLOCK CLOCK_MONOTONIC_RAW
+#else
+# define PERF_CLOCK CLOCK_MONOTONIC
+#endif
+
+KRK_FUNC(monotonic,{
+	FUNCTION_TAKES_NONE();
+	return readClock(CLOCK_MONOTONIC, 0);
+})
+
+KRK_FUNC(monotonic_ns,{
+	FUNCTION_TAKES_NONE();
+	return readClock(CLOCK_MONOTONIC, 1);
+})
+
+KRK_FUNC(perf_counter,{
+	FUNCTION_TAKES_NONE();
+	return readClock(PERF_CLOCK, 0);
+})
+
+KRK_FUNC(perf_counter_ns,{
+	FUNCTION_TAKES_NONE();
+	return readClock(PERF_CLOCK, 1);
+})
+
+KRK_FUNC(process_time,{
+	FUNCTION_TAKES_NONE();
+	return readClock(CLOCK_PROCESS_CPUTIME_ID, 0);
+})
+
+KRK_FUNC(process_time_ns,{
+	FUNCTION_TAKES_NONE();
+	return readClock(CLOCK_PROCESS_CPUTIME_ID, 1);
+})
+
+KRK_FUNC(thread_time,{
+	FUNCTION_TAKES_NONE();
+	return readClock(CLOCK_THREAD_CPUTIME_ID, 0);
+})
+
+KRK_FUNC(thread_time_ns,{
+	FUNCTION_TAKES_NONE();
+	return readClock(CLOCK_THREAD_CPUTIME_ID, 1);
+})
+
 _noexport
 void _createAndBind_timeMod(void) {
 	KrkInstance * module = krk_newInstance(vm.baseClasses->moduleClass);
@@ -47,11 +116,28 @@ void _createAndBind_timeMod(void) {
 	KRK_DOC(module, "@brief Provides timekeeping functions.");
 	KRK_DOC(BIND_FUNC(module,sleep), "@brief Pause execution of the current thread.\n"
 		"@arguments secs\n\n"
-		"Uses the system @c usleep() function to sleep for @p secs seconds, which may be a @ref float or @ref int. "
-		"The available precision is platform-dependent.");
+		"Uses the system @c nanosleep() function to sleep for @p secs seconds, which may be a @ref float or @ref int. "
+		"The available precision is platform-dependent. Returns early if a signal is received.");
 	KRK_DOC(BIND_FUNC(module,time), "@brief Return the elapsed seconds since the system epoch.\n\n"
 		"Returns a @ref float representation of the number of seconds since the platform's epoch date. "
 		"On POSIX platforms, this is the number of seconds since 1 January 1970. "
 		"The precision of the return value is platform-dependent.");
+	KRK_DOC(BIND_FUNC(module,monotonic), "@brief Return the value of a clock that never goes backwards, in seconds.\n\n"
+		"The clock is not affected by changes to the system time, so only the difference between two "
+		"results is meaningful.");
+	KRK_DOC(BIND_FUNC(module,monotonic_ns), "@brief Return the value of @ref monotonic in nanoseconds.\n\n"
+		"The result is a @ref float with no fractional part, as @ref int is too narrow to hold it.");
+	KRK_DOC(BIND_FUNC(module,perf_counter), "@brief Return the value of the highest-resolution monotonic clock, in seconds.\n\n"
+		"Intended for measuring short intervals. Where available, the clock is not slewed by NTP adjustments. "
+		"Only the difference between two results is meaningful.");
+	KRK_DOC(BIND_FUNC(module,perf_counter_ns), "@brief Return the value of @ref perf_counter in nanoseconds.\n\n"
+		"The result is a @ref float with no fractional part, as @ref int is too narrow to hold it.");
+	KRK_DOC(BIND_FUNC(module,process_time), "@brief Return the CPU time used by the process, in seconds.\n\n"
+		"Includes both user and system time, but not time spent sleeping.");
+	KRK_DOC(BIND_FUNC(module,process_time_ns), "@brief Return the value of @ref process_time in nanoseconds.\n\n"
+		"The result is a @ref float with no fractional part, as @ref int is too narrow to hold it.");
+	KRK_DOC(BIND_FUNC(module,thread_time), "@brief Return the CPU time used by the current thread, in seconds.");
+	KRK_DOC(BIND_FUNC(module,thread_time_ns), "@brief Return the value of @ref thread_time in nanoseconds.\n\n"
+		"The result is a @ref float with no fractional part, as @ref int is too narrow to hold it.");
 }
 
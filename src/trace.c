@@ -0,0 +1,559 @@
+/**
+ * @file    trace.c
+ * @brief   Trace event recorder and the @c trace module.
+ *
+ * Each thread that records events gets a ring of fixed-size binary records:
+ * a timestamp, a phase, and an index into a table of names. Only the owning
+ * thread writes to its ring, and only a holder of the output lock reads from
+ * it, so recording an event takes no locks. A writer thread wakes up
+ * periodically, or when a ring is half full, and writes the pending records
+ * out as JSON; a thread that finds its ring full drains it itself.
+ *
+ * Names are formatted as JSON once, when a function is first called or a
+ * span name is first used while recording. Code objects remember their entry
+ * in the table, tagged with the recording session it belongs to, so a call
+ * is recorded without a lookup.
+ *
+ * Recorded calls follow the call stack: exceptions can discard several frames
+ * at once, so entering or leaving a frame first ends any deeper calls that are
+ * still open, and begin and end events of each thread stay balanced.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <kuroko/vm.h>
+#include <kuroko/value.h>
+#include <kuroko/object.h>
+#include <kuroko/util.h>
+#include <kuroko/trace.h>
+
+#include "private.h"
+
+#ifdef ENABLE_THREADING
+# include <pthread.h>
+# define LOCK()   pthread_mutex_lock(&tracer.lock)
+# define UNLOCK() pthread_mutex_unlock(&tracer.lock)
+#else
+# define LOCK()
+# define UNLOCK()
+#endif
+
+#if defined(__linux__)
+# include <sys/syscall.h>
+#endif
+
+/* Events in each thread's ring; a power of two. */
+#define RING_SIZE (1 << 14)
+#define RING_MASK (RING_SIZE - 1)
+
+/* Milliseconds between drains by the writer thread. */
+#define WRITER_INTERVAL 50
+
+struct TraceEvent {
+	uint64_t time;   /* Nanoseconds since recording started */
+	uint32_t name;   /* Index into the name table; unused by end events */
+	uint32_t phase;  /* 'B', 'E' or 'i' */
+};
+
+struct TraceBuffer {
+	struct TraceBuffer * next;
+	size_t head;          /* Written only by the owning thread */
+	size_t tail;          /* Written only with the output lock held */
+	size_t session;       /* Recording session the thread last joined */
+	long tid;
+	size_t opened;        /* Calls begun and not yet ended */
+	size_t top;           /* Frame depth of the innermost of those calls */
+	struct TraceEvent events[RING_SIZE];
+};
+
+struct SpanName {
+	uint32_t hash;
+	uint32_t name;        /* Index into the name table */
+	char * text;          /* NULL if unused */
+};
+
+static struct {
+	FILE * out;
+	int first;                   /* No event has been written yet */
+	int pid;
+	size_t session;              /* Incremented each time recording starts */
+	uint64_t start;
+	struct TraceBuffer * buffers;
+
+	char ** names;               /* JSON members naming each event */
+	size_t nameCount;
+	size_t nameCapacity;
+	struct SpanName * spanNames; /* Open-addressed */
+	size_t spanNameCount;
+	size_t spanNameCapacity;
+
+#ifdef ENABLE_THREADING
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_t writer;
+	int running;
+#endif
+} tracer = {
+#ifdef ENABLE_THREADING
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.wake = PTHREAD_COND_INITIALIZER,
+#endif
+};
+
+static threadLocal struct TraceBuffer * threadBuffer = NULL;
+
+static uint64_t now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static long threadId(void) {
+#if defined(__linux__)
+	return (long)syscall(SYS_gettid);
+#else
+	static long nextId = 1;
+	return __atomic_fetch_add(&nextId, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+/**
+ * Write @p s as a quoted JSON string to @p out, if it is not NULL.
+ * Returns the length of the quoted string.
+ */
+static size_t quote(char * out, const char * s) {
+	size_t length = 0;
+#define PUT(c) do { if (out) out[length] = (c); length++; } while (0)
+	PUT('"');
+	for (const unsigned char * c = (const unsigned char *)s; *c; ++c) {
+		if (*c == '"' || *c == '\\') {
+			PUT('\\');
+			PUT(*c);
+		} else if (*c < 0x20) {
+			PUT('\\'); PUT('u'); PUT('0'); PUT('0');
+			PUT("0123456789abcdef"[*c >> 4]);
+			PUT("0123456789abcdef"[*c & 0xF]);
+		} else {
+			PUT(*c);
+		}
+	}
+	PUT('"');
+#undef PUT
+	return length;
+}
+
+/**
+ * Add a name to the table; the output lock must be held.
+ * @p category and @p args are already JSON; @p args may be NULL.
+ */
+static uint32_t addName(const char * name, const char * category, const char * args) {
+	size_t length = quote(NULL, name) + strlen(category) + (args ? strlen(args) : 0) + 32;
+	char * member = malloc(length);
+	size_t written = 0;
+	memcpy(member, "\"name\":", 7);
+	written += 7;
+	written += quote(member + written, name);
+	written += snprintf(member + written, length - written, ",\"cat\":\"%s\"%s%s", category, args ? ",\"args\":" : "", args ? args : "");
+
+	if (tracer.nameCount == tracer.nameCapacity) {
+		tracer.nameCapacity = tracer.nameCapacity ? tracer.nameCapacity * 2 : 256;
+		tracer.names = realloc(tracer.names, sizeof(char*) * tracer.nameCapacity);
+	}
+	tracer.names[tracer.nameCount] = member;
+	return tracer.nameCount++;
+}
+
+static uint32_t functionName(KrkCodeObject * code) {
+	/* The session is in the high word, so entries from earlier sessions are not reused. */
+	uint64_t entry = __atomic_load_n(&code->traceName, __ATOMIC_ACQUIRE);
+	if (entry >> 32 == (uint32_t)tracer.session) return (uint32_t)entry;
+
+	LOCK();
+	entry = code->traceName;
+	if (entry >> 32 != (uint32_t)tracer.session) {
+		const char * file = code->chunk.filename ? code->chunk.filename->chars : "<unknown>";
+		char * args = malloc(quote(NULL, file) + 32);
+		size_t written = 0;
+		memcpy(args, "{\"file\":", 8);
+		written += 8;
+		written += quote(args + written, file);
+		snprintf(args + written, 32, ",\"line\":%d}", (int)krk_lineNumber(&code->chunk, 0));
+
+		const char * category = (code->flags & KRK_CODEOBJECT_FLAGS_IS_COROUTINE) ? "coroutine" :
+			(code->flags & KRK_CODEOBJECT_FLAGS_IS_GENERATOR) ? "generator" : "function";
+		uint32_t name = addName((code->qualname ? code->qualname : code->name)->chars, category, args);
+		free(args);
+
+		entry = ((uint64_t)(uint32_t)tracer.session << 32) | name;
+		__atomic_store_n(&code->traceName, entry, __ATOMIC_RELEASE);
+	}
+	UNLOCK();
+	return (uint32_t)entry;
+}
+
+static uint32_t spanName(const char * text) {
+	uint32_t hash = 2166136261U;
+	for (const unsigned char * c = (const unsigned char *)text; *c; ++c) hash = (hash ^ *c) * 16777619U;
+
+	LOCK();
+	if ((tracer.spanNameCount + 1) * 4 > tracer.spanNameCapacity * 3) {
+		struct SpanName * old = tracer.spanNames;
+		size_t oldCapacity = tracer.spanNameCapacity;
+		tracer.spanNameCapacity = oldCapacity ? oldCapacity * 2 : 64;
+		tracer.spanNames = calloc(tracer.spanNameCapacity, sizeof(struct SpanName));
+		for (size_t i = 0; i < oldCapacity; ++i) {
+			if (!old[i].text) continue;
+			size_t index = old[i].hash & (tracer.spanNameCapacity - 1);
+			while (tracer.spanNames[index].text) index = (index + 1) & (tracer.spanNameCapacity - 1);
+			tracer.spanNames[index] = old[i];
+		}
+		free(old);
+	}
+
+	size_t index = hash & (tracer.spanNameCapacity - 1);
+	while (tracer.spanNames[index].text) {
+		if (tracer.spanNames[index].hash == hash && !strcmp(tracer.spanNames[index].text, text)) break;
+		index = (index + 1) & (tracer.spanNameCapacity - 1);
+	}
+	if (!tracer.spanNames[index].text) {
+		tracer.spanNames[index] = (struct SpanName){hash, addName(text, "span", NULL), strdup(text)};
+		tracer.spanNameCount++;
+	}
+	uint32_t name = tracer.spanNames[index].name;
+	UNLOCK();
+	return name;
+}
+
+static void freeNames(void) {
+	for (size_t i = 0; i < tracer.nameCount; ++i) free(tracer.names[i]);
+	for (size_t i = 0; i < tracer.spanNameCapacity; ++i) free(tracer.spanNames[i].text);
+	free(tracer.names);
+	free(tracer.spanNames);
+	tracer.names = NULL;
+	tracer.nameCount = 0;
+	tracer.nameCapacity = 0;
+	tracer.spanNames = NULL;
+	tracer.spanNameCount = 0;
+	tracer.spanNameCapacity = 0;
+}
+
+/* The output lock must be held. */
+static void writeEvent(struct TraceBuffer * buffer, struct TraceEvent * event) {
+	if (!tracer.out) return;
+	fputs(tracer.first ? "\n{" : ",\n{", tracer.out);
+	tracer.first = 0;
+	if (event->phase != 'E') {
+		fputs(tracer.names[event->name], tracer.out);
+		fputc(',', tracer.out);
+	}
+	fprintf(tracer.out, "\"ph\":\"%c\",%s\"ts\":%llu.%03u,\"pid\":%d,\"tid\":%ld}",
+		(char)event->phase, event->phase == 'i' ? "\"s\":\"t\"," : "",
+		(unsigned long long)(event->time / 1000), (unsigned int)(event->time % 1000),
+		tracer.pid, buffer->tid);
+}
+
+/* The output lock must be held. */
+static void drain(struct TraceBuffer * buffer) {
+	size_t head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+	for (size_t i = buffer->tail; i != head; ++i) {
+		writeEvent(buffer, &buffer->events[i & RING_MASK]);
+	}
+	__atomic_store_n(&buffer->tail, head, __ATOMIC_RELEASE);
+}
+
+static void drainAll(void) {
+	for (struct TraceBuffer * buffer = tracer.buffers; buffer; buffer = buffer->next) {
+		drain(buffer);
+	}
+	if (tracer.out) fflush(tracer.out);
+}
+
+/**
+ * Get the current thread's ring, creating it or joining it to the
+ * current recording session as needed.
+ */
+static struct TraceBuffer * currentBuffer(void) {
+	struct TraceBuffer * buffer = threadBuffer;
+	if (likely(buffer && buffer->session == tracer.session)) return buffer;
+
+	LOCK();
+	if (!buffer) {
+		buffer = calloc(1, sizeof(struct TraceBuffer));
+		buffer->tid = threadId();
+		buffer->next = tracer.buffers;
+		tracer.buffers = buffer;
+		threadBuffer = buffer;
+	}
+	buffer->session = tracer.session;
+	buffer->tail = buffer->head;
+	buffer->opened = 0;
+	if (tracer.out) {
+		fprintf(tracer.out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%ld,\"args\":{\"name\":",
+			tracer.first ? "\n" : ",\n", tracer.pid, buffer->tid);
+		if (&krk_currentThread == vm.threads) {
+			fputs("\"main\"}}", tracer.out);
+		} else {
+			fprintf(tracer.out, "\"thread %ld\"}}", buffer->tid);
+		}
+		tracer.first = 0;
+	}
+	UNLOCK();
+	return buffer;
+}
+
+static void record(struct TraceBuffer * buffer, uint32_t phase, uint32_t name) {
+	size_t head = buffer->head;
+	if (head - __atomic_load_n(&buffer->tail, __ATOMIC_ACQUIRE) == RING_SIZE) {
+		LOCK();
+		drain(buffer);
+		UNLOCK();
+	}
+	buffer->events[head & RING_MASK] = (struct TraceEvent){now() - tracer.start, name, phase};
+	__atomic_store_n(&buffer->head, head + 1, __ATOMIC_RELEASE);
+#ifdef ENABLE_THREADING
+	if (!((head + 1) & (RING_MASK >> 1))) pthread_cond_signal(&tracer.wake);
+#endif
+}
+
+/* End the calls deeper than @p depth. */
+static void unwind(struct TraceBuffer * buffer, size_t depth) {
+	while (buffer->opened && buffer->top > depth) {
+		record(buffer, 'E', 0);
+		buffer->opened--;
+		buffer->top--;
+	}
+	if (!buffer->opened) buffer->top = depth;
+}
+
+void _traceEnter(KrkCallFrame * frame) {
+	struct TraceBuffer * buffer = currentBuffer();
+	size_t depth = krk_currentThread.frameCount;
+	unwind(buffer, depth - 1);
+	record(buffer, 'B', functionName(frame->closure->function));
+	buffer->opened++;
+	buffer->top = depth;
+}
+
+void _traceExit(void) {
+	_traceUnwind(krk_currentThread.frameCount - 1);
+}
+
+void _traceUnwind(size_t depth) {
+	struct TraceBuffer * buffer = threadBuffer;
+	if (!buffer || buffer->session != tracer.session) return;
+	unwind(buffer, depth);
+}
+
+void _traceThreadExit(void) {
+	struct TraceBuffer * buffer = threadBuffer;
+	if (!buffer) return;
+	if (vm.globalFlags & KRK_GLOBAL_TRACE_EVENTS) _traceUnwind(0);
+
+	LOCK();
+	drain(buffer);
+	for (struct TraceBuffer ** link = &tracer.buffers; *link; link = &(*link)->next) {
+		if (*link == buffer) {
+			*link = buffer->next;
+			break;
+		}
+	}
+	UNLOCK();
+
+	free(buffer);
+	threadBuffer = NULL;
+}
+
+void krk_traceBegin(const char * name) {
+	if (!(vm.globalFlags & KRK_GLOBAL_TRACE_EVENTS)) return;
+	struct TraceBuffer * buffer = currentBuffer();
+	record(buffer, 'B', spanName(name));
+}
+
+void krk_traceEnd(void) {
+	if (!(vm.globalFlags & KRK_GLOBAL_TRACE_EVENTS)) return;
+	record(currentBuffer(), 'E', 0);
+}
+
+void krk_traceInstant(const char * name) {
+	if (!(vm.globalFlags & KRK_GLOBAL_TRACE_EVENTS)) return;
+	struct TraceBuffer * buffer = currentBuffer();
+	record(buffer, 'i', spanName(name));
+}
+
+#ifdef ENABLE_THREADING
+static void * writerThread(void * unused) {
+	(void)unused;
+	LOCK();
+	while (tracer.running) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += WRITER_INTERVAL * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		pthread_cond_timedwait(&tracer.wake, &tracer.lock, &deadline);
+		drainAll();
+	}
+	UNLOCK();
+	return NULL;
+}
+#endif
+
+int krk_traceStart(const char * path) {
+	if (vm.globalFlags & KRK_GLOBAL_TRACE_EVENTS) return 0;
+	FILE * out = fopen(path, "w");
+	if (!out) return 0;
+
+	LOCK();
+	freeNames();
+	tracer.out = out;
+	tracer.first = 1;
+	tracer.pid = getpid();
+	tracer.session++;
+	tracer.start = now();
+	fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", out);
+	UNLOCK();
+
+#ifdef ENABLE_THREADING
+	tracer.running = 1;
+	if (pthread_create(&tracer.writer, NULL, writerThread, NULL)) tracer.running = 0;
+#endif
+
+	vm.globalFlags |= KRK_GLOBAL_TRACE_EVENTS;
+	return 1;
+}
+
+void krk_traceStop(void) {
+	if (!(vm.globalFlags & KRK_GLOBAL_TRACE_EVENTS)) return;
+
+	/* Calls this thread is still in are ended where recording stops. */
+	_traceUnwind(0);
+	vm.globalFlags &= ~KRK_GLOBAL_TRACE_EVENTS;
+
+#ifdef ENABLE_THREADING
+	if (tracer.running) {
+		LOCK();
+		tracer.running = 0;
+		pthread_cond_signal(&tracer.wake);
+		UNLOCK();
+		pthread_join(tracer.writer, NULL);
+	}
+#endif
+
+	LOCK();
+	drainAll();
+	fputs("\n]}\n", tracer.out);
+	fclose(tracer.out);
+	tracer.out = NULL;
+	freeNames();
+	UNLOCK();
+}
+
+static const char * const startArgs[] = {"path"};
+KRK_FUNC(start,{
+	const char * path;
+	if (!krk_parseArgs("s", startArgs, &path)) return NONE_VAL();
+	if (vm.globalFlags & KRK_GLOBAL_TRACE_EVENTS) return krk_runtimeError(vm.exceptions->valueError, "trace events are already being recorded");
+	if (!krk_traceStart(path)) return krk_runtimeError(vm.exceptions->ioError, "%s: could not open for writing", path);
+})
+
+KRK_FUNC(stop,{
+	FUNCTION_TAKES_NONE();
+	krk_traceStop();
+})
+
+KRK_FUNC(is_tracing,{
+	FUNCTION_TAKES_NONE();
+	return BOOLEAN_VAL(!!(vm.globalFlags & KRK_GLOBAL_TRACE_EVENTS));
+})
+
+static const char * const nameArgs[] = {"name"};
+KRK_FUNC(begin,{
+	const char * name;
+	if (!krk_parseArgs("s", nameArgs, &name)) return NONE_VAL();
+	krk_traceBegin(name);
+})
+
+KRK_FUNC(end,{
+	FUNCTION_TAKES_NONE();
+	krk_traceEnd();
+})
+
+KRK_FUNC(instant,{
+	const char * name;
+	if (!krk_parseArgs("s", nameArgs, &name)) return NONE_VAL();
+	krk_traceInstant(name);
+})
+
+static KrkClass * span;
+
+#define IS_span(o) (krk_isInstanceOf(o, span))
+#define AS_span(o) (AS_INSTANCE(o))
+#define CURRENT_CTYPE KrkInstance *
+#define CURRENT_NAME  self
+
+KRK_METHOD(span,__init__,{
+	METHOD_TAKES_EXACTLY(1);
+	CHECK_ARG(1,str,KrkString*,name);
+	krk_attachNamedObject(&self->fields, "name", (KrkObj*)name);
+	return argv[0];
+})
+
+KRK_METHOD(span,__enter__,{
+	METHOD_TAKES_NONE();
+	KrkValue name;
+	if (!krk_tableGet_fast(&self->fields, S("name"), &name) || !IS_STRING(name)) {
+		return krk_runtimeError(vm.exceptions->typeError, "span name must be a str");
+	}
+	krk_traceBegin(AS_CSTRING(name));
+	return argv[0];
+})
+
+KRK_METHOD(span,__exit__,{
+	krk_traceEnd();
+})
+
+#undef CURRENT_CTYPE
+#undef CURRENT_NAME
+
+_noexport
+void _createAndBind_traceMod(void) {
+	KrkInstance * module = krk_newInstance(vm.baseClasses->moduleClass);
+	krk_attachNamedObject(&vm.modules, "trace", (KrkObj*)module);
+	krk_attachNamedObject(&module->fields, "__name__", (KrkObj*)S("trace"));
+	krk_attachNamedValue(&module->fields, "__file__", NONE_VAL());
+	KRK_DOC(module, "@brief Trace events for timeline views.\n\n"
+		"Records the start and end of every function call, and of every slice of a generator or "
+		"coroutine between being resumed and yielding, on each thread. The output is Chrome "
+		"trace-event JSON, which can be loaded into Perfetto or chrome://tracing. "
+		"Spans and instant events can be added to the timeline; they cost little when nothing is being recorded.");
+	KRK_DOC(BIND_FUNC(module,start),
+		"@brief Start recording trace events to a file.\n"
+		"@arguments path\n\n"
+		"Events are written out in the background while recording.");
+	KRK_DOC(BIND_FUNC(module,stop),
+		"@brief Stop recording, write the remaining events and close the file.");
+	KRK_DOC(BIND_FUNC(module,is_tracing),
+		"@brief Whether trace events are being recorded.");
+	KRK_DOC(BIND_FUNC(module,begin),
+		"@brief Begin a span named @p name on the current thread.\n"
+		"@arguments name\n\n"
+		"Spans nest with calls and with each other, and must be ended on the same thread.");
+	KRK_DOC(BIND_FUNC(module,end),
+		"@brief End the innermost span begun on the current thread.");
+	KRK_DOC(BIND_FUNC(module,instant),
+		"@brief Record an instant event named @p name on the current thread.\n"
+		"@arguments name");
+
+	krk_makeClass(module, &span, "span", vm.baseClasses->objectClass);
+	KRK_DOC(span, "@brief A span that lasts for the body of a @c with statement.\n"
+		"@arguments name");
+	BIND_METHOD(span,__init__);
+	BIND_METHOD(span,__enter__);
+	BIND_METHOD(span,__exit__);
+	krk_finalizeClass(span);
+}
@@ -0,0 +1,468 @@
+/**
+ * @file    tracemalloc.c
+ * @brief   Allocation tracer and the @c tracemalloc module.
+ *
+ * When KRK_GLOBAL_TRACE_ALLOCATIONS is set, krk_reallocate() reports each
+ * allocation, resize and release here. Traced blocks are kept in a hash
+ * table keyed by address, each pointing at the allocation site that was
+ * executing when it was allocated; sites are identified by code object
+ * and instruction offset and hold the live totals of their blocks.
+ * Resolving sites to source lines is left until a snapshot is taken.
+ *
+ * Every thread allocates, so the tables are only touched while holding a
+ * lock. The tracer's own tables are allocated with malloc(), so they are not
+ * traced, can not trigger a collection, and never re-enter the tracer. The code objects of allocation
+ * sites are marked by the garbage collector, so a site's address can not
+ * be reused by another function while it is still being reported.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include <kuroko/vm.h>
+#include <kuroko/value.h>
+#include <kuroko/object.h>
+#include <kuroko/util.h>
+#include <kuroko/tracemalloc.h>
+#include <kuroko/threads.h>
+
+#include "private.h"
+
+#define TOMBSTONE ((void*)1)
+
+struct TracedBlock {
+	void * ptr;     /* NULL if unused, TOMBSTONE if released */
+	size_t site;
+	size_t weight;
+};
+
+struct AllocationSite {
+	KrkCodeObject * code;  /* NULL for allocations made outside of any call frame */
+	size_t offset;
+	size_t bytes;
+	size_t blocks;
+};
+
+/* Sites copied by a snapshot that is being built, whose code objects must stay alive until it is done. */
+struct SnapshotSites {
+	struct AllocationSite * sites;
+	size_t count;
+	struct SnapshotSites * next;
+};
+
+static struct {
+	size_t interval;
+	size_t countdown;
+	size_t traced;
+	size_t peak;
+	int suspended;          /* Snapshots being built; releases are still recorded while suspended */
+	struct SnapshotSites * snapshots;
+
+	struct TracedBlock * blocks;
+	size_t blockCapacity;
+	size_t blockCount;      /* Including tombstones */
+
+	struct AllocationSite * sites;
+	size_t siteCount;
+	size_t siteCapacity;
+	size_t * siteIndex;     /* Open-addressed; entries are site numbers plus one */
+	size_t siteIndexCapacity;
+} tracer;
+
+static volatile int _tracerLock = 0;
+
+static size_t hashPointer(const void * ptr) {
+	uintptr_t x = (uintptr_t)ptr;
+	x ^= x >> 17;
+	x *= 0xed5ad4bbU;
+	x ^= x >> 11;
+	return (size_t)x;
+}
+
+static struct TracedBlock * findBlock(void * ptr) {
+	size_t index = hashPointer(ptr) & (tracer.blockCapacity - 1);
+	struct TracedBlock * tombstone = NULL;
+	for (;;) {
+		struct TracedBlock * block = &tracer.blocks[index];
+		if (!block->ptr) return tombstone ? tombstone : block;
+		if (block->ptr == TOMBSTONE) {
+			if (!tombstone) tombstone = block;
+		} else if (block->ptr == ptr) {
+			return block;
+		}
+		index = (index + 1) & (tracer.blockCapacity - 1);
+	}
+}
+
+static void growBlocks(void) {
+	struct TracedBlock * old = tracer.blocks;
+	size_t oldCapacity = tracer.blockCapacity;
+	tracer.blockCapacity = oldCapacity ? oldCapacity * 2 : 1024;
+	tracer.blocks = calloc(tracer.blockCapacity, sizeof(struct TracedBlock));
+	tracer.blockCount = 0;
+	for (size_t i = 0; i < oldCapacity; ++i) {
+		if (!old[i].ptr || old[i].ptr == TOMBSTONE) continue;
+		*findBlock(old[i].ptr) = old[i];
+		tracer.blockCount++;
+	}
+	free(old);
+}
+
+static size_t * findSite(KrkCodeObject * code, size_t offset) {
+	size_t index = (hashPointer(code) ^ (offset * 0x9E3779B1U)) & (tracer.siteIndexCapacity - 1);
+	for (;;) {
+		size_t * entry = &tracer.siteIndex[index];
+		if (!*entry) return entry;
+		struct AllocationSite * site = &tracer.sites[*entry - 1];
+		if (site->code == code && site->offset == offset) return entry;
+		index = (index + 1) & (tracer.siteIndexCapacity - 1);
+	}
+}
+
+static void growSiteIndex(void) {
+	free(tracer.siteIndex);
+	tracer.siteIndexCapacity = tracer.siteIndexCapacity ? tracer.siteIndexCapacity * 2 : 256;
+	tracer.siteIndex = calloc(tracer.siteIndexCapacity, sizeof(size_t));
+	for (size_t i = 0; i < tracer.siteCount; ++i) {
+		*findSite(tracer.sites[i].code, tracer.sites[i].offset) = i + 1;
+	}
+}
+
+/**
+ * Find or create the site for the instruction the current thread is executing.
+ */
+static size_t currentSite(void) {
+	KrkCodeObject * code = NULL;
+	size_t offset = 0;
+	if (krk_currentThread.frameCount) {
+		KrkCallFrame * frame = &krk_currentThread.frames[krk_currentThread.frameCount - 1];
+		code = frame->closure->function;
+		offset = frame->ip - code->chunk.code;
+	}
+
+	if ((tracer.siteCount + 1) * 4 > tracer.siteIndexCapacity * 3) growSiteIndex();
+	size_t * entry = findSite(code, offset);
+	if (*entry) return *entry - 1;
+
+	if (tracer.siteCount == tracer.siteCapacity) {
+		tracer.siteCapacity = tracer.siteCapacity ? tracer.siteCapacity * 2 : 64;
+		tracer.sites = realloc(tracer.sites, sizeof(struct AllocationSite) * tracer.siteCapacity);
+	}
+	tracer.sites[tracer.siteCount] = (struct AllocationSite){code, offset, 0, 0};
+	*entry = ++tracer.siteCount;
+	return tracer.siteCount - 1;
+}
+
+int _tracemallocRelease(void * ptr) {
+	_obtain_lock(_tracerLock);
+	int released = 0;
+	if (tracer.blocks) {
+		struct TracedBlock * block = findBlock(ptr);
+		if (block->ptr == ptr) {
+			tracer.sites[block->site].bytes -= block->weight;
+			tracer.sites[block->site].blocks--;
+			tracer.traced -= block->weight;
+			block->ptr = TOMBSTONE;
+			released = 1;
+		}
+	}
+	_release_lock(_tracerLock);
+	return released;
+}
+
+static void traceAllocation(void * ptr, size_t oldSize, size_t newSize, int wasTraced) {
+	/* Another thread may have stopped tracing since this allocation checked. */
+	if (tracer.suspended || !(vm.globalFlags & KRK_GLOBAL_TRACE_ALLOCATIONS)) return;
+
+	/* Blocks that were traced stay traced as they are resized; others are sampled by the bytes they gain. */
+	size_t weight = newSize;
+	if (tracer.interval > 1) {
+		if (!wasTraced) {
+			size_t grown = newSize > oldSize ? newSize - oldSize : 0;
+			if (grown < tracer.countdown) {
+				tracer.countdown -= grown;
+				return;
+			}
+			tracer.countdown = tracer.interval;
+		}
+		if (weight < tracer.interval) weight = tracer.interval;
+	} else if (!wasTraced && newSize <= oldSize) {
+		return;
+	}
+
+	if ((tracer.blockCount + 1) * 4 > tracer.blockCapacity * 3) growBlocks();
+	struct TracedBlock * block = findBlock(ptr);
+	if (!block->ptr) tracer.blockCount++;
+	size_t site = currentSite();
+	*block = (struct TracedBlock){ptr, site, weight};
+	tracer.sites[site].bytes += weight;
+	tracer.sites[site].blocks++;
+	tracer.traced += weight;
+	if (tracer.traced > tracer.peak) tracer.peak = tracer.traced;
+}
+
+void _tracemallocAllocate(void * ptr, size_t oldSize, size_t newSize, int wasTraced) {
+	_obtain_lock(_tracerLock);
+	traceAllocation(ptr, oldSize, newSize, wasTraced);
+	_release_lock(_tracerLock);
+}
+
+void _tracemallocMarkRoots(void) {
+	_obtain_lock(_tracerLock);
+	for (size_t i = 0; i < tracer.siteCount; ++i) {
+		krk_markObject((KrkObj*)tracer.sites[i].code);
+	}
+	for (struct SnapshotSites * copy = tracer.snapshots; copy; copy = copy->next) {
+		for (size_t i = 0; i < copy->count; ++i) krk_markObject((KrkObj*)copy->sites[i].code);
+	}
+	_release_lock(_tracerLock);
+}
+
+static void clearTraces(void) {
+	free(tracer.blocks);
+	free(tracer.sites);
+	free(tracer.siteIndex);
+	tracer.blocks = NULL;
+	tracer.blockCapacity = 0;
+	tracer.blockCount = 0;
+	tracer.sites = NULL;
+	tracer.siteCount = 0;
+	tracer.siteCapacity = 0;
+	tracer.siteIndex = NULL;
+	tracer.siteIndexCapacity = 0;
+	tracer.traced = 0;
+	tracer.peak = 0;
+}
+
+int krk_tracemallocStart(size_t interval) {
+	_obtain_lock(_tracerLock);
+	int started = !(vm.globalFlags & KRK_GLOBAL_TRACE_ALLOCATIONS);
+	if (started) {
+		tracer.interval = interval;
+		tracer.countdown = interval;
+		vm.globalFlags |= KRK_GLOBAL_TRACE_ALLOCATIONS;
+	}
+	_release_lock(_tracerLock);
+	return started;
+}
+
+void krk_tracemallocStop(void) {
+	_obtain_lock(_tracerLock);
+	vm.globalFlags &= ~KRK_GLOBAL_TRACE_ALLOCATIONS;
+	clearTraces();
+	_release_lock(_tracerLock);
+}
+
+KrkValue krk_tracemallocSnapshot(void) {
+	/* Copy the sites, as other threads can change them while the result is built. */
+	_obtain_lock(_tracerLock);
+	struct SnapshotSites copy = {malloc(sizeof(struct AllocationSite) * (tracer.siteCount + 1)), tracer.siteCount, tracer.snapshots};
+	if (copy.count) memcpy(copy.sites, tracer.sites, sizeof(struct AllocationSite) * copy.count);
+	tracer.snapshots = &copy;
+	/* Building the result allocates; leave it out of the traces. */
+	tracer.suspended++;
+	_release_lock(_tracerLock);
+
+	KrkValue result = krk_dict_of(0, NULL, 0);
+	krk_push(result);
+	for (size_t i = 0; i < copy.count; ++i) {
+		struct AllocationSite * site = &copy.sites[i];
+		if (!site->blocks) continue;
+
+		char key[1024];
+		if (site->code) {
+			/* The instruction pointer has already moved past the opcode. */
+			size_t offset = site->offset ? site->offset - 1 : 0;
+			snprintf(key, sizeof(key), "%s:%d",
+				site->code->chunk.filename ? site->code->chunk.filename->chars : "<unknown>",
+				(int)krk_lineNumber(&site->code->chunk, offset));
+		} else {
+			snprintf(key, sizeof(key), "<unknown>:0");
+		}
+		krk_push(OBJECT_VAL(krk_copyString(key, strlen(key))));
+
+		/* Several instructions can share a line. */
+		double bytes = site->bytes, blocks = site->blocks;
+		KrkValue existing;
+		if (krk_tableGet(AS_DICT(result), krk_peek(0), &existing)) {
+			bytes += AS_FLOATING(AS_TUPLE(existing)->values.values[0]);
+			blocks += AS_FLOATING(AS_TUPLE(existing)->values.values[1]);
+		}
+
+		KrkTuple * totals = krk_newTuple(2);
+		krk_push(OBJECT_VAL(totals));
+		totals->values.values[totals->values.count++] = FLOATING_VAL(bytes);
+		totals->values.values[totals->values.count++] = FLOATING_VAL(blocks);
+		krk_tableSet(AS_DICT(result), krk_peek(1), krk_peek(0));
+		krk_pop();
+		krk_pop();
+	}
+
+	_obtain_lock(_tracerLock);
+	struct SnapshotSites ** link = &tracer.snapshots;
+	while (*link != &copy) link = &(*link)->next;
+	*link = copy.next;
+	tracer.suspended--;
+	_release_lock(_tracerLock);
+	free(copy.sites);
+	return krk_pop();
+}
+
+static const char * const startArgs[] = {"interval"};
+KRK_FUNC(start,{
+	krk_integer_type interval = 1;
+	if (!krk_parseArgs("|i", startArgs, &interval)) return NONE_VAL();
+	if (interval < 1) return krk_runtimeError(vm.exceptions->valueError, "interval must be positive");
+	krk_tracemallocStart(interval);
+})
+
+KRK_FUNC(stop,{
+	FUNCTION_TAKES_NONE();
+	krk_tracemallocStop();
+})
+
+KRK_FUNC(is_tracing,{
+	FUNCTION_TAKES_NONE();
+	return BOOLEAN_VAL(!!(vm.globalFlags & KRK_GLOBAL_TRACE_ALLOCATIONS));
+})
+
+KRK_FUNC(clear_traces,{
+	FUNCTION_TAKES_NONE();
+	_obtain_lock(_tracerLock);
+	clearTraces();
+	_release_lock(_tracerLock);
+})
+
+KRK_FUNC(get_traced_memory,{
+	FUNCTION_TAKES_NONE();
+	_obtain_lock(_tracerLock);
+	size_t traced = tracer.traced, peak = tracer.peak;
+	_release_lock(_tracerLock);
+	KrkTuple * result = krk_newTuple(2);
+	result->values.values[result->values.count++] = FLOATING_VAL((double)traced);
+	result->values.values[result->values.count++] = FLOATING_VAL((double)peak);
+	return OBJECT_VAL(result);
+})
+
+KRK_FUNC(snapshot,{
+	FUNCTION_TAKES_NONE();
+	return krk_tracemallocSnapshot();
+})
+
+struct SiteDifference {
+	KrkValue site;
+	double bytes;
+	double blocks;
+};
+
+static int compareDifferences(const void * a, const void * b) {
+	const struct SiteDifference * left = a, * right = b;
+	double l = left->bytes < 0 ? -left->bytes : left->bytes;
+	double r = right->bytes < 0 ? -right->bytes : right->bytes;
+	return (l < r) - (l > r);
+}
+
+static int numberValue(KrkValue value, double * out) {
+	if (IS_FLOATING(value)) *out = AS_FLOATING(value);
+	else if (IS_INTEGER(value)) *out = AS_INTEGER(value);
+	else return 0;
+	return 1;
+}
+
+static int snapshotTotals(KrkValue value, double * bytes, double * blocks) {
+	if (!IS_TUPLE(value) || AS_TUPLE(value)->values.count != 2 ||
+		!numberValue(AS_TUPLE(value)->values.values[0], bytes) || !numberValue(AS_TUPLE(value)->values.values[1], blocks)) {
+		krk_runtimeError(vm.exceptions->typeError, "snapshot entries must be tuples of two numbers");
+		return 0;
+	}
+	return 1;
+}
+
+static const char * const compareArgs[] = {"old", "new"};
+KRK_FUNC(compare,{
+	KrkValue old, new;
+	if (!krk_parseArgs("OO", compareArgs, &old, &new)) return NONE_VAL();
+	if (!krk_isInstanceOf(old, vm.baseClasses->dictClass)) return TYPE_ERROR(dict,old);
+	if (!krk_isInstanceOf(new, vm.baseClasses->dictClass)) return TYPE_ERROR(dict,new);
+
+	KrkTable * oldTable = AS_DICT(old);
+	KrkTable * newTable = AS_DICT(new);
+	struct SiteDifference * differences = malloc(sizeof(struct SiteDifference) * (oldTable->count + newTable->count + 1));
+	size_t count = 0;
+
+	for (size_t i = 0; i < newTable->capacity; ++i) {
+		KrkTableEntry * entry = &newTable->entries[i];
+		if (IS_KWARGS(entry->key)) continue;
+		double bytes, blocks, oldBytes = 0, oldBlocks = 0;
+		KrkValue previous;
+		if (!snapshotTotals(entry->value, &bytes, &blocks)) goto _error;
+		if (krk_tableGet(oldTable, entry->key, &previous) && !snapshotTotals(previous, &oldBytes, &oldBlocks)) goto _error;
+		if (bytes == oldBytes && blocks == oldBlocks) continue;
+		differences[count++] = (struct SiteDifference){entry->key, bytes - oldBytes, blocks - oldBlocks};
+	}
+
+	for (size_t i = 0; i < oldTable->capacity; ++i) {
+		KrkTableEntry * entry = &oldTable->entries[i];
+		if (IS_KWARGS(entry->key)) continue;
+		double bytes, blocks;
+		KrkValue current;
+		if (krk_tableGet(newTable, entry->key, &current)) continue;
+		if (!snapshotTotals(entry->value, &bytes, &blocks)) goto _error;
+		differences[count++] = (struct SiteDifference){entry->key, -bytes, -blocks};
+	}
+
+	if (count) qsort(differences, count, sizeof(struct SiteDifference), compareDifferences);
+
+	KrkValue result = krk_list_of(0, NULL, 0);
+	krk_push(result);
+	for (size_t i = 0; i < count; ++i) {
+		KrkTuple * difference = krk_newTuple(3);
+		krk_push(OBJECT_VAL(difference));
+		difference->values.values[difference->values.count++] = differences[i].site;
+		difference->values.values[difference->values.count++] = FLOATING_VAL(differences[i].bytes);
+		difference->values.values[difference->values.count++] = FLOATING_VAL(differences[i].blocks);
+		krk_writeValueArray(AS_LIST(result), krk_peek(0));
+		krk_pop();
+	}
+	free(differences);
+	return krk_pop();
+
+_error:
+	free(differences);
+	return NONE_VAL();
+})
+
+_noexport
+void _createAndBind_tracemallocMod(void) {
+	KrkInstance * module = krk_newInstance(vm.baseClasses->moduleClass);
+	krk_attachNamedObject(&vm.modules, "tracemalloc", (KrkObj*)module);
+	krk_attachNamedObject(&module->fields, "__name__", (KrkObj*)S("tracemalloc"));
+	krk_attachNamedValue(&module->fields, "__file__", NONE_VAL());
+	KRK_DOC(module, "@brief Allocation tracer.\n\n"
+		"Attributes allocations to the source line that was executing when they were made, "
+		"and keeps the number of bytes and blocks that are still live for each line. "
+		"Snapshots taken at two points in a program can be compared to find where memory grew.");
+	KRK_DOC(BIND_FUNC(module,start),
+		"@brief Start tracing allocations.\n"
+		"@arguments interval=1\n\n"
+		"With an @p interval greater than 1, allocations are sampled: roughly one allocation "
+		"is traced for every @p interval bytes allocated, and counts for at least @p interval bytes. "
+		"Allocations made before tracing started are not traced.");
+	KRK_DOC(BIND_FUNC(module,stop),
+		"@brief Stop tracing allocations and discard all traces.");
+	KRK_DOC(BIND_FUNC(module,is_tracing),
+		"@brief Whether allocations are being traced.");
+	KRK_DOC(BIND_FUNC(module,clear_traces),
+		"@brief Discard all traces, without stopping.");
+	KRK_DOC(BIND_FUNC(module,get_traced_memory),
+		"@brief Get a tuple of the current and peak number of traced bytes.\n\n"
+		"Byte and block counts from this module are floats, as they can outgrow an int.");
+	KRK_DOC(BIND_FUNC(module,snapshot),
+		"@brief Get the live traced allocations.\n\n"
+		"Returns a @ref dict mapping @c file:line strings to tuples of the number of bytes and "
+		"blocks allocated on that line that have not been released.");
+	KRK_DOC(BIND_FUNC(module,compare),
+		"@brief Compare two snapshots.\n"
+		"@arguments old,new\n\n"
+		"Returns a list of tuples of a @c file:line string, the change in bytes and the change in "
+		"blocks, for the lines that changed, largest changes in bytes first.");
+}
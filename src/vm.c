@@ -13,6 +13,10 @@
 #include <kuroko/object.h>
 #include <kuroko/table.h>
 #include <kuroko/util.h>
+#include <kuroko/profiler.h>
+#include <kuroko/lineprofiler.h>
+#include <kuroko/tracemalloc.h>
+#include <kuroko/trace.h>
 
 #include "private.h"
 
@@ -89,6 +93,16 @@ KrkThreadState krk_currentThread;
 # define FRAME_OUT(frame)
 #endif
 
+#ifndef KRK_NO_TRACING
+# define TRACE_ENTER(frame) if (unlikely(vm.globalFlags & KRK_GLOBAL_TRACE_EVENTS)) _traceEnter(frame)
+# define TRACE_EXIT() if (unlikely(vm.globalFlags & KRK_GLOBAL_TRACE_EVENTS)) _traceExit()
+# define TRACE_UNWIND(depth) if (unlikely(vm.globalFlags & KRK_GLOBAL_TRACE_EVENTS)) _traceUnwind(depth)
+#else
+# define TRACE_ENTER(frame)
+# define TRACE_EXIT()
+# define TRACE_UNWIND(depth)
+#endif
+
 /*
  * In some threading configurations, particular on Windows,
  * we can't have executables reference our thread-local thread
@@ -110,6 +124,7 @@ static KrkValue _specialMethodNames[METHOD__MAX];
  * happens on startup (twice) and after an exception.
  */
 void krk_resetStack(void) {
+	TRACE_UNWIND(0);
 	krk_currentThread.stackTop = krk_currentThread.stack;
 	krk_currentThread.stackMax = krk_currentThread.stack + krk_currentThread.stackSize;
 	krk_currentThread.frameCount = 0;
@@ -426,6 +441,12 @@ void krk_finalizeClass(KrkClass * _class) {
 		}
 	}
 
+	/* A subclass that overrides __call__ can not be advanced by its base's _iternext */
+	if (_class->base && _class->_iternext == _class->base->_iternext && _class->_call != _class->base->_call) {
+		_class->_iternext = NULL;
+		_class->_iterpair = NULL;
+	}
+
 	if (_class->base && _class->_eq != _class->base->_eq) {
 		if (_class->_hash == _class->base->_hash) {
 			_class->_hash = NULL;
@@ -577,6 +598,79 @@ int krk_processComplexArguments(int argCount, KrkValueArray * positionals, KrkTa
 }
 #undef unpackArray
 
+/* Calls with more keyword arguments than this always take the general path. */
+#define FAST_KEYWORD_LIMIT 16
+
+/**
+ * Bind the keyword arguments of a simple call directly to parameter slots.
+ *
+ * A simple call has only positionals and name=value pairs - no unpacking - and
+ * targets a function without *args or **kwargs. Each name is looked up in the
+ * code object's argument index; as names are interned, this is a pointer match.
+ * Nothing is allocated once the index has been built.
+ *
+ * Returns 1 if the arguments were bound, leaving exactly one value for each
+ * argument slot on the stack, and 0 if the call should take the general path,
+ * in which case the stack is untouched. Anything that would raise an error
+ * takes the general path, so it can produce the usual message.
+ */
+static int bindSimpleKeywords(KrkCodeObject * function, int argCount) {
+	size_t potentialPositionalArgs = function->requiredArgs + function->keywordArgs;
+	size_t kwargsCount = AS_INTEGER(krk_currentThread.stackTop[-1]);
+	size_t positionalCount = argCount - 1 - kwargsCount * 2;
+
+	if (function->flags & (KRK_CODEOBJECT_FLAGS_COLLECTS_ARGS | KRK_CODEOBJECT_FLAGS_COLLECTS_KWS)) return 0;
+	if (kwargsCount > FAST_KEYWORD_LIMIT || positionalCount > potentialPositionalArgs) return 0;
+
+	if (unlikely(function->argumentIndex.capacity == 0)) {
+		if (!potentialPositionalArgs) return 0;
+		for (size_t i = 0; i < (size_t)function->requiredArgs; ++i) {
+			krk_tableSet(&function->argumentIndex, function->requiredArgNames.values[i], INTEGER_VAL(i));
+		}
+		for (size_t i = 0; i < (size_t)function->keywordArgs; ++i) {
+			krk_tableSet(&function->argumentIndex, function->keywordArgNames.values[i], INTEGER_VAL(i + function->requiredArgs));
+		}
+	}
+
+	KrkValue * startOfExtras = &krk_currentThread.stackTop[-1 - kwargsCount * 2];
+	size_t slots[FAST_KEYWORD_LIMIT];
+	size_t requiredBound = positionalCount < (size_t)function->requiredArgs ? positionalCount : (size_t)function->requiredArgs;
+
+	for (size_t i = 0; i < kwargsCount; ++i) {
+		KrkValue name = startOfExtras[i*2];
+		KrkValue slot;
+		if (!IS_STRING(name)) return 0;
+		if (!krk_tableGet_fast(&function->argumentIndex, AS_STRING(name), &slot)) return 0;
+		slots[i] = AS_INTEGER(slot);
+		if (slots[i] < positionalCount) return 0;
+		for (size_t j = 0; j < i; ++j) {
+			if (slots[j] == slots[i]) return 0;
+		}
+		if (slots[i] < (size_t)function->requiredArgs) requiredBound++;
+	}
+
+	if (requiredBound < (size_t)function->requiredArgs) return 0;
+
+	/* Everything binds; make room for the unset slots before moving values around. */
+	krk_reserve_stack(potentialPositionalArgs);
+	KrkValue * startOfPositionals = &krk_currentThread.stackTop[-argCount];
+	KrkValue values[FAST_KEYWORD_LIMIT];
+	startOfExtras = &startOfPositionals[positionalCount];
+
+	for (size_t i = 0; i < kwargsCount; ++i) {
+		values[i] = startOfExtras[i*2+1];
+	}
+	for (size_t i = positionalCount; i < potentialPositionalArgs; ++i) {
+		startOfPositionals[i] = KWARGS_VAL(0);
+	}
+	for (size_t i = 0; i < kwargsCount; ++i) {
+		startOfPositionals[slots[i]] = values[i];
+	}
+
+	krk_currentThread.stackTop = &startOfPositionals[potentialPositionalArgs];
+	return 1;
+}
+
 /**
  * Call a managed method.
  * Takes care of argument count checking, default argument filling,
@@ -595,7 +689,10 @@ static int call(KrkClosure * closure, int argCount, int callableOnStack) {
 	KrkValueArray * positionals;
 	KrkTable * keywords;
 
-	if (argCount && IS_KWARGS(krk_currentThread.stackTop[-1])) {
+	if (argCount && IS_KWARGS(krk_currentThread.stackTop[-1]) && bindSimpleKeywords(closure->function, argCount)) {
+		argCount = potentialPositionalArgs;
+		argCountX = argCount;
+	} else if (argCount && IS_KWARGS(krk_currentThread.stackTop[-1])) {
 
 		KrkValue myList = krk_list_of(0,NULL,0);
 		krk_currentThread.scratchSpace[0] = myList;
@@ -736,13 +833,18 @@ _finishKwarg:
 
 	if (unlikely(krk_currentThread.frameCount == KRK_CALL_FRAMES_MAX)) goto _errorAfterKeywords;
 
-	KrkCallFrame * frame = &krk_currentThread.frames[krk_currentThread.frameCount++];
+	KrkCallFrame * frame = &krk_currentThread.frames[krk_currentThread.frameCount];
 	frame->closure = closure;
 	frame->ip = closure->function->chunk.code;
 	frame->slots = (krk_currentThread.stackTop - argCount) - krk_currentThread.stack;
 	frame->outSlots = (krk_currentThread.stackTop - argCount - callableOnStack) - krk_currentThread.stack;
 	frame->globals = &closure->function->globalsContext->fields;
+	frame->generator = NULL;
+	/* The profiler's signal handler may read the frame as soon as it is counted. */
+	__atomic_signal_fence(__ATOMIC_RELEASE);
+	krk_currentThread.frameCount++;
 	FRAME_IN(frame);
+	TRACE_ENTER(frame);
 	return 1;
 
 _errorDuringPositionals:
@@ -1054,7 +1156,8 @@ KRK_FUNC(getsizeof,{
 		case KRK_OBJ_STRING: {
 			KrkString * self = AS_STRING(argv[0]);
 			mySize += sizeof(KrkString) + self->length /* For the UTF8 */
-			+ ((self->codes && (self->chars != self->codes)) ? (self->type * self->codesLength) : 0);
+			+ ((self->codes && (self->chars != self->codes)) ? (self->type * self->codesLength) : 0)
+			+ (self->offsets ? (sizeof(size_t) * (self->codesLength / KRK_STRING_STRIDE + 1)) : 0);
 			break;
 		}
 		case KRK_OBJ_BYTES: {
@@ -1144,7 +1247,9 @@ KRK_FUNC(unload,{
 })
 
 void krk_initVM(int flags) {
+	static size_t generation = 0;
 	vm.globalFlags = flags & 0xFF00;
+	vm.generation = ++generation;
 
 	/* Reset current thread */
 	krk_resetStack();
@@ -1239,6 +1344,10 @@ void krk_initVM(int flags) {
 	_createAndBind_exceptions();
 	_createAndBind_generatorClass();
 	_createAndBind_gcMod();
+	_createAndBind_profilerMod();
+	_createAndBind_lineprofilerMod();
+	_createAndBind_tracemallocMod();
+	_createAndBind_traceMod();
 	_createAndBind_timeMod();
 	_createAndBind_osMod();
 	_createAndBind_fileioMod();
@@ -1335,6 +1444,11 @@ void krk_initVM(int flags) {
  * Reclaim resources used by the VM.
  */
 void krk_freeVM() {
+	krk_profilerStop();
+	krk_profilerReset();
+	krk_lineProfilerClear();
+	krk_tracemallocStop();
+	krk_traceStop();
 	krk_freeTable(&vm.strings);
 	krk_freeTable(&vm.modules);
 	memset(_specialMethodNames,0,sizeof(_specialMethodNames));
@@ -1496,7 +1610,7 @@ MAKE_BIT_OP(mod,%,rmod) /* not a bit op, but doesn't work on floating point */
 			if (IS_INTEGER(b)) return BOOLEAN_VAL(AS_FLOATING(a) operator AS_INTEGER(b)); \
 			else if (IS_FLOATING(b)) return BOOLEAN_VAL(AS_FLOATING(a) operator AS_FLOATING(b)); \
 		} else if (IS_FLOATING(b)) { \
-			if (IS_INTEGER(a)) return BOOLEAN_VAL(AS_INTEGER(a) operator AS_INTEGER(b)); \
+			if (IS_INTEGER(a)) return BOOLEAN_VAL(AS_INTEGER(a) operator AS_FLOATING(b)); \
 		} \
 		return tryBind("__" #name "__", a, b, #operator, "__" #inv "__"); \
 	}
@@ -1517,6 +1631,16 @@ MAKE_COMPARATOR(ge, >=, le)
  * stack manipulation could result in a handler being in the wrong place,
  * at which point there's no guarantees about what happens.
  */
+/**
+ * Generators resumed directly by OP_CALL_ITER whose frames are being
+ * discarded by an exception are finished, as if they had been called.
+ */
+static void abandonGenerators(int fromFrame) {
+	for (int i = fromFrame; i < (int)krk_currentThread.frameCount; ++i) {
+		if (krk_currentThread.frames[i].generator) _generatorFinish(krk_currentThread.frames[i].generator, NONE_VAL());
+	}
+}
+
 static int handleException() {
 	int stackOffset, frameOffset;
 	int exitSlot = (krk_currentThread.exitOnFrame >= 0) ? krk_currentThread.frames[krk_currentThread.exitOnFrame].outSlots : 0;
@@ -1535,7 +1659,11 @@ static int handleException() {
 			 * this reset, so the repl can throw errors and keep accepting new lines.
 			 */
 			if (!(vm.globalFlags & KRK_GLOBAL_CLEAN_OUTPUT)) krk_dumpTraceback();
+			abandonGenerators(0);
+			TRACE_UNWIND(0);
 			krk_currentThread.frameCount = 0;
+		} else {
+			abandonGenerators(krk_currentThread.exitOnFrame);
 		}
 		/* If exitSlot was not 0, there was an exception during a call to runNext();
 		 * this is likely to be raised higher up the stack as an exception in the outer
@@ -1550,6 +1678,8 @@ static int handleException() {
 	}
 
 	/* We found an exception handler and can reset the VM to its call frame. */
+	abandonGenerators(frameOffset + 1);
+	TRACE_UNWIND(frameOffset + 1);
 	closeUpvalues(stackOffset);
 	krk_currentThread.stackTop = krk_currentThread.stack + stackOffset + 1;
 	krk_currentThread.frameCount = frameOffset + 1;
@@ -1559,6 +1689,17 @@ static int handleException() {
 	return 0;
 }
 
+void _reportUnraisable(size_t frameCount, size_t stackOffset) {
+	if (!(vm.globalFlags & KRK_GLOBAL_CLEAN_OUTPUT)) krk_dumpTraceback();
+	abandonGenerators(frameCount);
+	TRACE_UNWIND(frameCount);
+	closeUpvalues(stackOffset);
+	krk_currentThread.stackTop = krk_currentThread.stack + stackOffset;
+	krk_currentThread.frameCount = frameCount;
+	krk_currentThread.flags &= ~KRK_THREAD_HAS_EXCEPTION;
+	krk_currentThread.currentException = NONE_VAL();
+}
+
 /**
  * Load a module.
  *
@@ -2026,12 +2167,101 @@ KrkValue krk_valueSetAttribute(KrkValue owner, char * name, KrkValue to) {
 	else if ((IS_FLOATING(b) && AS_FLOATING(b) == 0.0)) { krk_runtimeError(vm.exceptions->zeroDivisionError, "float division by zero"); goto _finishException; } \
 	a = krk_operator_ ## op (a,b); \
 	krk_currentThread.stackTop[-2] = a; krk_pop(); break; }
+#define SPECIALIZED_OP(generic,guard,expr) { KrkValue b = krk_peek(0); KrkValue a = krk_peek(1); \
+	if (likely(guard(a) && guard(b))) { krk_currentThread.stackTop[-2] = (expr); krk_pop(); break; } \
+	frame->ip[-1] = generic; frame->ip--; break; }
+#define COMPARE_AND_BRANCH(compare) { KrkValue b = krk_peek(0); KrkValue a = krk_peek(1); \
+	KrkValue result = (compare); \
+	krk_currentThread.stackTop[-2] = result; krk_pop(); \
+	if (unlikely(krk_currentThread.flags & KRK_THREAD_HAS_EXCEPTION)) break; \
+	uint16_t offset = (frame->ip[1] << 8) | frame->ip[2]; frame->ip += 3; \
+	if (krk_isFalsey(result)) frame->ip += offset; \
+	else krk_pop(); \
+	break; }
+#define INT_COMPARE(op,name) ((IS_INTEGER(a) && IS_INTEGER(b)) ? BOOLEAN_VAL(AS_INTEGER(a) op AS_INTEGER(b)) : krk_operator_ ## name (a,b))
 #define READ_CONSTANT(s) (frame->closure->function->chunk.constants.values[OPERAND])
 #define READ_STRING(s) AS_STRING(READ_CONSTANT(s))
 
 extern FUNC_SIG(list,append);
 extern FUNC_SIG(dict,__setitem__);
 extern FUNC_SIG(set,add);
+extern FUNC_SIG(str,__add__);
+
+/**
+ * Quickening.
+ *
+ * The generic arithmetic and comparison instructions count how many times
+ * they have run. When an instruction reaches KRK_QUICKEN_THRESHOLD, it looks
+ * at its current operands and, if there is a form of the instruction that is
+ * specialized for those types, rewrites its opcode in place. Specialized forms
+ * check that their operands still have the expected types and otherwise
+ * rewrite themselves back to the generic form and run again as that.
+ */
+#define KRK_QUICKEN_THRESHOLD 8
+
+static KrkOpCode specializeOperator(KrkOpCode opcode, KrkValue a, KrkValue b) {
+	int ints = IS_INTEGER(a) && IS_INTEGER(b);
+	int floats = IS_FLOATING(a) && IS_FLOATING(b);
+	switch (opcode) {
+		case OP_ADD:
+			if (IS_STRING(a) && IS_STRING(b)) return OP_ADD_STR;
+			return ints ? OP_ADD_INT : floats ? OP_ADD_FLOAT : opcode;
+		case OP_SUBTRACT:      return ints ? OP_SUBTRACT_INT : floats ? OP_SUBTRACT_FLOAT : opcode;
+		case OP_MULTIPLY:      return ints ? OP_MULTIPLY_INT : floats ? OP_MULTIPLY_FLOAT : opcode;
+		case OP_LESS:          return ints ? OP_LESS_INT : floats ? OP_LESS_FLOAT : opcode;
+		case OP_GREATER:       return ints ? OP_GREATER_INT : floats ? OP_GREATER_FLOAT : opcode;
+		case OP_LESS_EQUAL:    return ints ? OP_LESS_EQUAL_INT : floats ? OP_LESS_EQUAL_FLOAT : opcode;
+		case OP_GREATER_EQUAL: return ints ? OP_GREATER_EQUAL_INT : floats ? OP_GREATER_EQUAL_FLOAT : opcode;
+		default: return opcode;
+	}
+}
+
+static inline void quickenOperator(KrkCallFrame * frame) {
+	KrkCodeObject * code = frame->closure->function;
+	if (unlikely(!code->quickenCounters)) {
+		uint8_t * counters = ALLOCATE(uint8_t, code->chunk.count);
+		memset(counters, 0, code->chunk.count);
+		code->quickenCounters = counters;
+	}
+	size_t offset = (frame->ip - 1) - code->chunk.code;
+	if (likely(++code->quickenCounters[offset] < KRK_QUICKEN_THRESHOLD)) return;
+	code->quickenCounters[offset] = 0;
+	frame->ip[-1] = specializeOperator(frame->ip[-1], krk_peek(1), krk_peek(0));
+}
+
+static KrkValue addStrings(KrkValue a, KrkValue b) {
+	KrkValue argv[] = {a, b};
+	return FUNC_NAME(str,__add__)(2, argv, 0);
+}
+
+/**
+ * Global lookup caching.
+ *
+ * OP_GET_GLOBAL remembers the table entry each name resolved to, along with
+ * the versions of the globals and builtins tables at the time. As long as
+ * neither table has gained or lost keys since, the entry is still the one a
+ * full lookup would find and its value can be read directly.
+ */
+static KrkTableEntry * resolveGlobal(KrkCallFrame * frame, size_t index) {
+	KrkCodeObject * code = frame->closure->function;
+	if (unlikely(!code->globalCaches)) {
+		KrkGlobalCache * caches = ALLOCATE(KrkGlobalCache, code->chunk.constants.count);
+		for (size_t i = 0; i < code->chunk.constants.count; ++i) {
+			caches[i].globalsVersion = caches[i].builtinsVersion = (size_t)-1;
+			caches[i].entry = NULL;
+		}
+		code->globalCaches = caches;
+	}
+	KrkString * name = AS_STRING(code->chunk.constants.values[index]);
+	KrkTableEntry * entry = krk_tableGetEntry_fast(frame->globals, name);
+	if (!entry) entry = krk_tableGetEntry_fast(&vm.builtins->fields, name);
+	if (!entry) return NULL;
+	KrkGlobalCache * cache = &code->globalCaches[index];
+	cache->globalsVersion = frame->globals->version;
+	cache->builtinsVersion = vm.builtins->fields.version;
+	cache->entry = entry;
+	return entry;
+}
 
 /**
  * VM main loop.
@@ -2041,7 +2271,25 @@ static KrkValue run() {
 
 	while (1) {
 #ifndef KRK_NO_TRACING
-		if (unlikely(krk_currentThread.flags & (KRK_THREAD_ENABLE_TRACING | KRK_THREAD_SINGLE_STEP | KRK_THREAD_SIGNALLED))) {
+		if (unlikely(krk_currentThread.flags & (KRK_THREAD_ENABLE_TRACING | KRK_THREAD_SINGLE_STEP | KRK_THREAD_SIGNALLED | KRK_THREAD_PROFILE_DRAIN | KRK_THREAD_COUNT_INSTRUCTIONS | KRK_THREAD_GC_CALLBACKS | KRK_THREAD_LINE_PROFILE))) {
+			if (krk_currentThread.flags & KRK_THREAD_PROFILE_DRAIN) {
+				_profilerDrain();
+			}
+
+			if (krk_currentThread.flags & KRK_THREAD_GC_CALLBACKS) {
+				_gcRunCallbacks();
+			}
+
+			if (krk_currentThread.flags & KRK_THREAD_LINE_PROFILE) {
+				_lineProfilerStep(frame);
+			}
+
+#ifndef KRK_DISABLE_DEBUG
+			if (krk_currentThread.flags & KRK_THREAD_COUNT_INSTRUCTIONS) {
+				_debugCountInstruction(frame);
+			}
+#endif
+
 			if (krk_currentThread.flags & KRK_THREAD_ENABLE_TRACING) {
 				krk_debug_dumpStack(stderr, frame);
 				krk_disassembleInstruction(stderr, frame->closure->function,
@@ -2129,7 +2377,17 @@ _finishReturn: (void)0;
 					break;
 				}
 				FRAME_OUT(frame);
+				TRACE_EXIT();
 				krk_currentThread.frameCount--;
+				if (frame->generator) {
+					/* The generator is finished; the loop that resumed it jumps to its exit. */
+					_generatorFinish(frame->generator, result);
+					krk_currentThread.stackTop = &krk_currentThread.stack[frame->outSlots];
+					krk_push(OBJECT_VAL(frame->generator));
+					frame = &krk_currentThread.frames[krk_currentThread.frameCount - 1];
+					frame->ip += (frame->ip[-2] << 8) | frame->ip[-1];
+					break;
+				}
 				if (krk_currentThread.frameCount == 0) {
 					krk_pop();
 					return result;
@@ -2158,13 +2416,33 @@ _finishReturn: (void)0;
 				krk_push(BOOLEAN_VAL(krk_valuesSame(a,b)));
 				break;
 			}
-			case OP_LESS: BINARY_OP(lt);
-			case OP_GREATER: BINARY_OP(gt);
-			case OP_LESS_EQUAL: BINARY_OP(le);
-			case OP_GREATER_EQUAL: BINARY_OP(ge);
-			case OP_ADD: BINARY_OP(add);
-			case OP_SUBTRACT: BINARY_OP(sub)
-			case OP_MULTIPLY: BINARY_OP(mul)
+			case OP_LESS: quickenOperator(frame); BINARY_OP(lt);
+			case OP_GREATER: quickenOperator(frame); BINARY_OP(gt);
+			case OP_LESS_EQUAL: quickenOperator(frame); BINARY_OP(le);
+			case OP_GREATER_EQUAL: quickenOperator(frame); BINARY_OP(ge);
+			case OP_ADD: quickenOperator(frame); BINARY_OP(add);
+			case OP_SUBTRACT: quickenOperator(frame); BINARY_OP(sub)
+			case OP_MULTIPLY: quickenOperator(frame); BINARY_OP(mul)
+			case OP_ADD_INT: SPECIALIZED_OP(OP_ADD, IS_INTEGER, INTEGER_VAL(AS_INTEGER(a) + AS_INTEGER(b)))
+			case OP_ADD_FLOAT: SPECIALIZED_OP(OP_ADD, IS_FLOATING, FLOATING_VAL(AS_FLOATING(a) + AS_FLOATING(b)))
+			case OP_ADD_STR: SPECIALIZED_OP(OP_ADD, IS_STRING, addStrings(a,b))
+			case OP_SUBTRACT_INT: SPECIALIZED_OP(OP_SUBTRACT, IS_INTEGER, INTEGER_VAL(AS_INTEGER(a) - AS_INTEGER(b)))
+			case OP_SUBTRACT_FLOAT: SPECIALIZED_OP(OP_SUBTRACT, IS_FLOATING, FLOATING_VAL(AS_FLOATING(a) - AS_FLOATING(b)))
+			case OP_MULTIPLY_INT: SPECIALIZED_OP(OP_MULTIPLY, IS_INTEGER, INTEGER_VAL(AS_INTEGER(a) * AS_INTEGER(b)))
+			case OP_MULTIPLY_FLOAT: SPECIALIZED_OP(OP_MULTIPLY, IS_FLOATING, FLOATING_VAL(AS_FLOATING(a) * AS_FLOATING(b)))
+			case OP_LESS_INT: SPECIALIZED_OP(OP_LESS, IS_INTEGER, BOOLEAN_VAL(AS_INTEGER(a) < AS_INTEGER(b)))
+			case OP_LESS_FLOAT: SPECIALIZED_OP(OP_LESS, IS_FLOATING, BOOLEAN_VAL(AS_FLOATING(a) < AS_FLOATING(b)))
+			case OP_GREATER_INT: SPECIALIZED_OP(OP_GREATER, IS_INTEGER, BOOLEAN_VAL(AS_INTEGER(a) > AS_INTEGER(b)))
+			case OP_GREATER_FLOAT: SPECIALIZED_OP(OP_GREATER, IS_FLOATING, BOOLEAN_VAL(AS_FLOATING(a) > AS_FLOATING(b)))
+			case OP_LESS_EQUAL_INT: SPECIALIZED_OP(OP_LESS_EQUAL, IS_INTEGER, BOOLEAN_VAL(AS_INTEGER(a) <= AS_INTEGER(b)))
+			case OP_LESS_EQUAL_FLOAT: SPECIALIZED_OP(OP_LESS_EQUAL, IS_FLOATING, BOOLEAN_VAL(AS_FLOATING(a) <= AS_FLOATING(b)))
+			case OP_GREATER_EQUAL_INT: SPECIALIZED_OP(OP_GREATER_EQUAL, IS_INTEGER, BOOLEAN_VAL(AS_INTEGER(a) >= AS_INTEGER(b)))
+			case OP_GREATER_EQUAL_FLOAT: SPECIALIZED_OP(OP_GREATER_EQUAL, IS_FLOATING, BOOLEAN_VAL(AS_FLOATING(a) >= AS_FLOATING(b)))
+			case OP_EQUAL_JUMP_IF_FALSE: COMPARE_AND_BRANCH(BOOLEAN_VAL(krk_valuesEqual(a,b)))
+			case OP_LESS_JUMP_IF_FALSE: COMPARE_AND_BRANCH(INT_COMPARE(<,lt))
+			case OP_GREATER_JUMP_IF_FALSE: COMPARE_AND_BRANCH(INT_COMPARE(>,gt))
+			case OP_LESS_EQUAL_JUMP_IF_FALSE: COMPARE_AND_BRANCH(INT_COMPARE(<=,le))
+			case OP_GREATER_EQUAL_JUMP_IF_FALSE: COMPARE_AND_BRANCH(INT_COMPARE(>=,ge))
 			case OP_DIVIDE: BINARY_OP_CHECK_ZERO(truediv)
 			case OP_FLOORDIV: BINARY_OP_CHECK_ZERO(floordiv)
 			case OP_MODULO: BINARY_OP_CHECK_ZERO(mod)
@@ -2312,6 +2590,8 @@ _finishReturn: (void)0;
 				subclass->allocSize = AS_CLASS(superclass)->allocSize;
 				subclass->_ongcsweep = AS_CLASS(superclass)->_ongcsweep;
 				subclass->_ongcscan = AS_CLASS(superclass)->_ongcscan;
+				subclass->_iternext = AS_CLASS(superclass)->_iternext;
+				subclass->_iterpair = AS_CLASS(superclass)->_iterpair;
 				krk_pop(); /* Super class */
 				break;
 			}
@@ -2386,7 +2666,16 @@ _finishReturn: (void)0;
 			}
 			case OP_YIELD: {
 				KrkValue result = krk_peek(0);
+				TRACE_EXIT();
 				krk_currentThread.frameCount--;
+				if (frame->generator) {
+					/* Resumed by OP_CALL_ITER: hand the value to the loop in the frame below. */
+					_generatorYield(frame);
+					krk_currentThread.stackTop = &krk_currentThread.stack[frame->outSlots];
+					krk_push(result);
+					frame = &krk_currentThread.frames[krk_currentThread.frameCount - 1];
+					break;
+				}
 				assert(krk_currentThread.frameCount == (size_t)krk_currentThread.exitOnFrame);
 				/* Do NOT restore the stack */
 				return result;
@@ -2496,10 +2785,80 @@ _finishReturn: (void)0;
 				frame->ip = exitIp;
 				break;
 			}
+			case OP_FOR_RANGE_INIT: {
+				/*
+				 * Emitted before the OP_CALL and OP_INVOKE_ITER that start a
+				 * `for ... in range(...)` loop, with a placeholder slot under
+				 * the callee. If the callee is still the built-in range and the
+				 * arguments are integers, replace all of that with the bound and
+				 * the counter for OP_FOR_RANGE and skip the call.
+				 */
+				int argCount = frame->ip[1];
+				KrkValue callee = krk_peek(argCount);
+				if (likely(IS_CLASS(callee) && AS_CLASS(callee) == vm.baseClasses->rangeClass)) {
+					KrkValue min = argCount == 2 ? krk_peek(1) : INTEGER_VAL(0);
+					KrkValue max = krk_peek(0);
+					if (likely(IS_INTEGER(min) && IS_INTEGER(max))) {
+						krk_currentThread.stackTop -= argCount + 1;
+						krk_currentThread.stackTop[-1] = INTEGER_VAL(AS_INTEGER(max));
+						krk_push(INTEGER_VAL(AS_INTEGER(min)));
+						frame->ip += 3;
+					}
+				}
+				break;
+			}
+			case OP_FOR_RANGE: {
+				TWO_BYTE_OPERAND;
+				KrkValue counter = krk_peek(0);
+				if (unlikely(KRK_VAL_TYPE(counter) != KRK_VAL_INTEGER)) goto _callIter;
+				if (AS_INTEGER(counter) < AS_INTEGER(krk_peek(1))) {
+					krk_currentThread.stackTop[-1] = INTEGER_VAL(AS_INTEGER(counter) + 1);
+					krk_push(counter);
+				} else {
+					krk_push(NONE_VAL());
+					frame->ip += OPERAND;
+				}
+				break;
+			}
 			case OP_CALL_ITER: {
 				TWO_BYTE_OPERAND;
+_callIter: ;
 				uint16_t offset = OPERAND;
 				KrkValue iter = krk_peek(0);
+				if (IS_INSTANCE(iter) && AS_INSTANCE(iter)->_class == vm.baseClasses->generatorClass) {
+					int resumed = _generatorResume(AS_INSTANCE(iter));
+					if (resumed == 1) {
+						frame = &krk_currentThread.frames[krk_currentThread.frameCount - 1];
+						break;
+					} else if (resumed == 0) {
+						krk_push(iter);
+						frame->ip += offset;
+						break;
+					}
+				}
+				if (IS_INSTANCE(iter) && AS_INSTANCE(iter)->_class->_iterpair && frame->ip[0] == OP_UNPACK && frame->ip[1] == 2) {
+					/* Unpacking into two loop variables; skip building the tuple. */
+					KrkValue pair[2];
+					if (AS_INSTANCE(iter)->_class->_iterpair(AS_INSTANCE(iter), pair)) {
+						krk_push(pair[0]);
+						krk_push(pair[1]);
+						frame->ip += 2;
+					} else {
+						krk_push(iter);
+						frame->ip += offset;
+					}
+					break;
+				}
+				if (IS_INSTANCE(iter) && AS_INSTANCE(iter)->_class->_iternext) {
+					KrkValue value;
+					if (AS_INSTANCE(iter)->_class->_iternext(AS_INSTANCE(iter), &value)) {
+						krk_push(value);
+					} else {
+						krk_push(iter);
+						frame->ip += offset;
+					}
+					break;
+				}
 				krk_push(iter);
 				krk_push(krk_callStack(0));
 				if (krk_valuesSame(iter, krk_peek(0))) frame->ip += offset;
@@ -2528,15 +2887,19 @@ _finishReturn: (void)0;
 				THREE_BYTE_OPERAND;
 			case OP_GET_GLOBAL: {
 				ONE_BYTE_OPERAND;
-				KrkString * name = READ_STRING(OPERAND);
-				KrkValue value;
-				if (!krk_tableGet_fast(frame->globals, name, &value)) {
-					if (!krk_tableGet_fast(&vm.builtins->fields, name, &value)) {
-						krk_runtimeError(vm.exceptions->nameError, "Undefined variable '%s'.", name->chars);
-						goto _finishException;
-					}
+				KrkGlobalCache * caches = frame->closure->function->globalCaches;
+				if (likely(caches != NULL) &&
+				    likely(caches[OPERAND].globalsVersion == frame->globals->version) &&
+				    likely(caches[OPERAND].builtinsVersion == vm.builtins->fields.version)) {
+					krk_push(caches[OPERAND].entry->value);
+					break;
+				}
+				KrkTableEntry * entry = resolveGlobal(frame, OPERAND);
+				if (!entry) {
+					krk_runtimeError(vm.exceptions->nameError, "Undefined variable '%s'.", READ_STRING(OPERAND)->chars);
+					goto _finishException;
 				}
-				krk_push(value);
+				krk_push(entry->value);
 				break;
 			}
 			case OP_SET_GLOBAL_LONG:
@@ -2586,6 +2949,37 @@ _finishReturn: (void)0;
 				krk_currentThread.stack[frame->slots + OPERAND] = krk_peek(0);
 				break;
 			}
+			case OP_GET_LOCAL_GET_LOCAL: {
+				ONE_BYTE_OPERAND;
+				krk_push(krk_currentThread.stack[frame->slots + OPERAND]);
+				krk_push(krk_currentThread.stack[frame->slots + frame->ip[1]]);
+				frame->ip += 2;
+				break;
+			}
+			case OP_GET_LOCAL_CONSTANT: {
+				ONE_BYTE_OPERAND;
+				krk_push(krk_currentThread.stack[frame->slots + OPERAND]);
+				krk_push(frame->closure->function->chunk.constants.values[frame->ip[1]]);
+				frame->ip += 2;
+				break;
+			}
+			case OP_GET_LOCAL_GET_PROPERTY: {
+				ONE_BYTE_OPERAND;
+				krk_push(krk_currentThread.stack[frame->slots + OPERAND]);
+				KrkString * name = AS_STRING(frame->closure->function->chunk.constants.values[frame->ip[1]]);
+				frame->ip += 2;
+				if (unlikely(!valueGetProperty(name))) {
+					krk_runtimeError(vm.exceptions->attributeError, "'%s' object has no attribute '%s'", krk_typeName(krk_peek(0)), name->chars);
+					goto _finishException;
+				}
+				break;
+			}
+			case OP_SET_LOCAL_POP: {
+				ONE_BYTE_OPERAND;
+				krk_currentThread.stack[frame->slots + OPERAND] = krk_pop();
+				frame->ip += 1;
+				break;
+			}
 			case OP_CALL_LONG:
 				THREE_BYTE_OPERAND;
 			case OP_CALL: {
@@ -0,0 +1,344 @@
+/**
+ * @file bench-core.c
+ * @brief Microbenchmarks for the runtime's core data structures.
+ *
+ * Times hash table inserts, lookups and deletes, string interning,
+ * krk_reallocate, value array growth and value comparisons directly from C,
+ * with sequential integer, random string and tuple keys, so changes to
+ * hashing or allocation can be measured without the interpreter in the way.
+ *
+ * Each benchmark is run several times with fresh inputs; the median and
+ * fastest times per operation are reported, along with the growth of the
+ * VM's allocated byte count per operation, before anything is released.
+ * The garbage collector is paused while a benchmark runs, and the objects
+ * it made are collected between runs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <kuroko/kuroko.h>
+#include <kuroko/vm.h>
+#include <kuroko/value.h>
+#include <kuroko/object.h>
+#include <kuroko/table.h>
+#include <kuroko/memory.h>
+
+struct Benchmark {
+	const char * name;
+	void (*setup)(size_t n);   /**< Prepare inputs; not timed */
+	void (*run)(size_t n);     /**< Perform @c n operations */
+	void (*teardown)(size_t n);/**< Release what setup and run made; not timed */
+};
+
+static uint64_t rngState = 0x2545F4914F6CDD1DULL;
+static KrkValue * keys = NULL;
+static KrkValue * others = NULL;
+static char ** buffers = NULL;
+static void ** blocks = NULL;
+static KrkTable table;
+static KrkValueArray array;
+static volatile size_t sink;
+
+static uint64_t rng(void) {
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 7;
+	rngState ^= rngState << 17;
+	return rngState;
+}
+
+static uint64_t now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Random identifier-like text of 6 to 24 characters. */
+static char * randomText(void) {
+	static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz_0123456789";
+	size_t length = 6 + rng() % 19;
+	char * text = malloc(length + 1);
+	for (size_t i = 0; i < length; ++i) text[i] = alphabet[rng() % (sizeof(alphabet) - 1)];
+	text[length] = '\0';
+	return text;
+}
+
+static KrkValue makeTuple(krk_integer_type a, krk_integer_type b) {
+	KrkTuple * tuple = krk_newTuple(2);
+	tuple->values.values[tuple->values.count++] = INTEGER_VAL(a);
+	tuple->values.values[tuple->values.count++] = INTEGER_VAL(b);
+	return OBJECT_VAL(tuple);
+}
+
+static void makeIntKeys(size_t n) {
+	keys = malloc(sizeof(KrkValue) * n);
+	for (size_t i = 0; i < n; ++i) keys[i] = INTEGER_VAL(i);
+}
+
+static void makeStringKeys(size_t n) {
+	keys = malloc(sizeof(KrkValue) * n);
+	for (size_t i = 0; i < n; ++i) {
+		char * text = randomText();
+		keys[i] = OBJECT_VAL(krk_copyString(text, strlen(text)));
+		free(text);
+	}
+}
+
+static void makeTupleKeys(size_t n) {
+	keys = malloc(sizeof(KrkValue) * n);
+	for (size_t i = 0; i < n; ++i) keys[i] = makeTuple(i, rng() % 1000);
+}
+
+static void makeBuffers(size_t n) {
+	buffers = malloc(sizeof(char*) * n);
+	for (size_t i = 0; i < n; ++i) buffers[i] = randomText();
+}
+
+static void fillTable(size_t n) {
+	krk_initTable(&table);
+	for (size_t i = 0; i < n; ++i) krk_tableSet(&table, keys[i], keys[i]);
+}
+
+static void releaseAll(size_t n) {
+	krk_freeTable(&table);
+	krk_freeValueArray(&array);
+	free(keys);
+	free(others);
+	if (buffers) {
+		for (size_t i = 0; i < n; ++i) free(buffers[i]);
+		free(buffers);
+	}
+	if (blocks) {
+		for (size_t i = 0; i < n; ++i) {
+			size_t size = (size_t)blocks[i * 2 + 1];
+			krk_reallocate(blocks[i * 2], size, 0);
+		}
+		free(blocks);
+	}
+	keys = others = NULL;
+	buffers = NULL;
+	blocks = NULL;
+}
+
+/* Setups */
+static void setupInt(size_t n) { makeIntKeys(n); krk_initTable(&table); }
+static void setupString(size_t n) { makeStringKeys(n); krk_initTable(&table); }
+static void setupTuple(size_t n) { makeTupleKeys(n); krk_initTable(&table); }
+static void setupIntFilled(size_t n) { makeIntKeys(n); fillTable(n); }
+static void setupStringFilled(size_t n) { makeStringKeys(n); fillTable(n); }
+static void setupTupleFilled(size_t n) { makeTupleKeys(n); fillTable(n); }
+
+static void setupStringMisses(size_t n) {
+	setupStringFilled(n);
+	others = malloc(sizeof(KrkValue) * n);
+	for (size_t i = 0; i < n; ++i) {
+		char * text = randomText();
+		others[i] = OBJECT_VAL(krk_copyString(text, strlen(text)));
+		free(text);
+	}
+}
+
+static void setupBuffers(size_t n) { makeBuffers(n); }
+
+static void setupInterned(size_t n) {
+	makeBuffers(n);
+	keys = malloc(sizeof(KrkValue) * n);
+	for (size_t i = 0; i < n; ++i) keys[i] = OBJECT_VAL(krk_copyString(buffers[i], strlen(buffers[i])));
+}
+
+static void setupBlocks(size_t n) {
+	blocks = calloc(n * 2, sizeof(void*));
+}
+
+static void setupArray(size_t n) {
+	krk_initValueArray(&array);
+}
+
+static void setupEqualInts(size_t n) {
+	makeIntKeys(n);
+	others = malloc(sizeof(KrkValue) * n);
+	for (size_t i = 0; i < n; ++i) others[i] = INTEGER_VAL(rng() & 1 ? i : i + 1);
+}
+
+static void setupEqualStrings(size_t n) {
+	/* Half of the pairs are the same interned string */
+	makeStringKeys(n);
+	others = malloc(sizeof(KrkValue) * n);
+	for (size_t i = 0; i < n; ++i) others[i] = keys[rng() & 1 ? i : (i + 1) % n];
+}
+
+static void setupEqualTuples(size_t n) {
+	/* Distinct tuples, so every pair is compared element by element */
+	makeTupleKeys(n);
+	others = malloc(sizeof(KrkValue) * n);
+	for (size_t i = 0; i < n; ++i) {
+		KrkTuple * tuple = AS_TUPLE(keys[i]);
+		others[i] = makeTuple(AS_INTEGER(tuple->values.values[0]), AS_INTEGER(tuple->values.values[1]) + (rng() & 1));
+	}
+}
+
+static void setupEqualMixed(size_t n) {
+	/* Integers against floats, which go through the type's __eq__ */
+	makeIntKeys(n);
+	others = malloc(sizeof(KrkValue) * n);
+	for (size_t i = 0; i < n; ++i) others[i] = FLOATING_VAL((double)(rng() & 1 ? i : i + 1));
+}
+
+/* Operations */
+static void runTableSet(size_t n) {
+	for (size_t i = 0; i < n; ++i) krk_tableSet(&table, keys[i], keys[i]);
+}
+
+static void runTableGet(size_t n) {
+	KrkValue value;
+	size_t found = 0;
+	for (size_t i = 0; i < n; ++i) found += krk_tableGet(&table, keys[i], &value);
+	sink = found;
+}
+
+static void runTableGetMiss(size_t n) {
+	KrkValue value;
+	size_t found = 0;
+	for (size_t i = 0; i < n; ++i) found += krk_tableGet(&table, others[i], &value);
+	sink = found;
+}
+
+static void runTableDelete(size_t n) {
+	size_t found = 0;
+	for (size_t i = 0; i < n; ++i) found += krk_tableDelete(&table, keys[i]);
+	sink = found;
+}
+
+static void runIntern(size_t n) {
+	size_t total = 0;
+	for (size_t i = 0; i < n; ++i) total += krk_copyString(buffers[i], strlen(buffers[i]))->length;
+	sink = total;
+}
+
+static void runAllocate(size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		size_t size = 16 + (rng() % 16) * 16;
+		blocks[i * 2] = krk_reallocate(NULL, 0, size);
+		blocks[i * 2 + 1] = (void*)size;
+	}
+}
+
+static void runGrow(size_t n) {
+	/* One buffer grown a little at a time, like a string being built */
+	void * buffer = NULL;
+	for (size_t i = 0; i < n; ++i) buffer = krk_reallocate(buffer, i * 16, (i + 1) * 16);
+	blocks[0] = buffer;
+	blocks[1] = (void*)(n * 16);
+}
+
+static void runArrayWrite(size_t n) {
+	for (size_t i = 0; i < n; ++i) krk_writeValueArray(&array, INTEGER_VAL(i));
+}
+
+static void runEqual(size_t n) {
+	size_t equal = 0;
+	for (size_t i = 0; i < n; ++i) equal += krk_valuesEqual(keys[i], others[i]);
+	sink = equal;
+}
+
+static struct Benchmark benchmarks[] = {
+	{"table.set.int",          setupInt,           runTableSet,     releaseAll},
+	{"table.set.str",          setupString,        runTableSet,     releaseAll},
+	{"table.set.tuple",        setupTuple,         runTableSet,     releaseAll},
+	{"table.get.int",          setupIntFilled,     runTableGet,     releaseAll},
+	{"table.get.str",          setupStringFilled,  runTableGet,     releaseAll},
+	{"table.get.tuple",        setupTupleFilled,   runTableGet,     releaseAll},
+	{"table.get.str.miss",     setupStringMisses,  runTableGetMiss, releaseAll},
+	{"table.delete.int",       setupIntFilled,     runTableDelete,  releaseAll},
+	{"table.delete.str",       setupStringFilled,  runTableDelete,  releaseAll},
+	{"string.intern.new",      setupBuffers,       runIntern,       releaseAll},
+	{"string.intern.existing", setupInterned,      runIntern,       releaseAll},
+	{"reallocate.alloc",       setupBlocks,        runAllocate,     releaseAll},
+	{"reallocate.grow",        setupBlocks,        runGrow,         releaseAll},
+	{"valuearray.write",       setupArray,         runArrayWrite,   releaseAll},
+	{"values.equal.int",       setupEqualInts,     runEqual,        releaseAll},
+	{"values.equal.str",       setupEqualStrings,  runEqual,        releaseAll},
+	{"values.equal.tuple",     setupEqualTuples,   runEqual,        releaseAll},
+	{"values.equal.mixed",     setupEqualMixed,    runEqual,        releaseAll},
+};
+
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(*benchmarks))
+
+static int compareTimes(const void * a, const void * b) {
+	uint64_t left = *(const uint64_t*)a, right = *(const uint64_t*)b;
+	return left < right ? -1 : left > right;
+}
+
+static void runBenchmark(struct Benchmark * bench, size_t n, int repeat) {
+	uint64_t * times = malloc(sizeof(uint64_t) * repeat);
+	double bytes = 0;
+
+	for (int r = 0; r < repeat; ++r) {
+		vm.globalFlags |= KRK_GLOBAL_GC_PAUSED;
+		bench->setup(n);
+		size_t before = vm.bytesAllocated;
+		uint64_t start = now();
+		bench->run(n);
+		times[r] = now() - start;
+		bytes += ((double)vm.bytesAllocated - (double)before) / n;
+		bench->teardown(n);
+		vm.globalFlags &= ~KRK_GLOBAL_GC_PAUSED;
+		krk_collectGarbage();
+	}
+
+	qsort(times, repeat, sizeof(uint64_t), compareTimes);
+	printf("%-24s %10zu %10.2f %10.2f %10.1f\n", bench->name, n,
+		(double)times[repeat / 2] / n, (double)times[0] / n, bytes / repeat);
+	fflush(stdout);
+	free(times);
+}
+
+static int usage(char * argv[]) {
+	fprintf(stderr, "usage: %s [-n OPS] [-r REPEAT] [-s SEED] [-l] [NAME...]\n\n"
+		" -n OPS     Operations per run (default 100000)\n"
+		" -r REPEAT  Runs of each benchmark (default 5)\n"
+		" -s SEED    Seed for random keys\n"
+		" -l         List benchmarks and exit\n\n"
+		"Only benchmarks whose names contain one of the NAMEs are run.\n", argv[0]);
+	return 1;
+}
+
+int main(int argc, char * argv[]) {
+	size_t n = 100000;
+	int repeat = 5;
+	int list = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:r:s:lh")) != -1) {
+		switch (opt) {
+			case 'n': n = strtoul(optarg, NULL, 10); break;
+			case 'r': repeat = atoi(optarg); break;
+			case 's': rngState = strtoull(optarg, NULL, 10) | 1; break;
+			case 'l': list = 1; break;
+			default: return usage(argv);
+		}
+	}
+	if (!n || repeat <= 0) return usage(argv);
+
+	if (list) {
+		for (size_t i = 0; i < BENCHMARK_COUNT; ++i) printf("%s\n", benchmarks[i].name);
+		return 0;
+	}
+
+	krk_initVM(0);
+	krk_startModule("__main__");
+
+	printf("%-24s %10s %10s %10s %10s\n", "benchmark", "ops", "ns/op", "min ns/op", "bytes/op");
+	for (size_t i = 0; i < BENCHMARK_COUNT; ++i) {
+		int selected = optind == argc;
+		for (int j = optind; j < argc && !selected; ++j) {
+			if (strstr(benchmarks[i].name, argv[j])) selected = 1;
+		}
+		if (selected) runBenchmark(&benchmarks[i], n, repeat);
+	}
+
+	krk_freeVM();
+	return 0;
+}
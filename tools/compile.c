@@ -204,6 +204,74 @@ static void _writeFunction(FILE * out, KrkCodeObject * f) {
 	}
 }
 
+static int _writeValue(FILE * out, KrkValue value);
+static int _writeTuple(FILE * out, KrkTuple * t) {
+	if (t->values.count < 256) {
+		fwrite((uint8_t[]){'t', (uint8_t)t->values.count}, 1, 2, out);
+	} else {
+		fwrite("T",1,1,out);
+		uint32_t len = t->values.count;
+		fwrite(&len, 1, sizeof(uint32_t), out);
+	}
+	for (size_t i = 0; i < t->values.count; ++i) {
+		if (_writeValue(out, t->values.values[i])) return 1;
+	}
+	return 0;
+}
+
+static int _writeValue(FILE * out, KrkValue value) {
+	switch (KRK_VAL_TYPE(value)) {
+		case KRK_VAL_OBJECT:
+			switch (AS_OBJECT(value)->type) {
+				case KRK_OBJ_STRING:
+					WRITE_STRING(AS_STRING(value));
+					break;
+				case KRK_OBJ_BYTES:
+					WRITE_BYTES(AS_BYTES(value));
+					break;
+				case KRK_OBJ_TUPLE:
+					if (_writeTuple(out, AS_TUPLE(value))) return 1;
+					break;
+				case KRK_OBJ_CODEOBJECT:
+					WRITE_FUNCTION(AS_codeobject(value));
+					break;
+				default:
+					fprintf(stderr,
+						"Invalid object found in constants table,"
+						"this marashal format can not store '%s'\n",
+						krk_typeName(value));
+					return 1;
+			}
+			break;
+		case KRK_VAL_KWARGS: /* This should always be KWARGS_VAL(0) */
+			WRITE_KWARGS(AS_INTEGER(value));
+			break;
+		case KRK_VAL_INTEGER:
+			WRITE_INTEGER(AS_INTEGER(value));
+			break;
+		default:
+			if (IS_FLOATING(value)) {
+				WRITE_FLOATING(AS_FLOATING(value));
+				break;
+			}
+			fprintf(stderr,
+				"Invalid value found in constants table,"
+				"this marashal format can not store '%s'\n",
+				krk_typeName(value));
+			return 1;
+	}
+	return 0;
+}
+
+/* Tuple constants are made by the optimizer and may contain strings. */
+static void internTupleStrings(KrkTuple * tuple) {
+	for (size_t i = 0; i < tuple->values.count; ++i) {
+		KrkValue value = tuple->values.values[i];
+		if (IS_STRING(value)) internString(AS_STRING(value));
+		else if (IS_TUPLE(value)) internTupleStrings(AS_TUPLE(value));
+	}
+}
+
 static int doFirstPass(FILE * out) {
 	/* Go through all functions and build string tables and function index */
 
@@ -232,6 +300,8 @@ static int doFirstPass(FILE * out) {
 			if (IS_OBJECT(value)) {
 				if (IS_STRING(value)) {
 					internString(AS_STRING(value));
+				} else if (IS_TUPLE(value)) {
+					internTupleStrings(AS_TUPLE(value));
 				} else if (IS_codeobject(value)) {
 					/* If we haven't seen this function yet, append it to the list */
 					krk_push(value);
@@ -299,44 +369,7 @@ static int doSecondPass(FILE * out) {
 		}
 
 		for (size_t i = 0; i < func->chunk.constants.count; ++i) {
-			KrkValue * val = &func->chunk.constants.values[i];
-			switch (KRK_VAL_TYPE(*val)) {
-				case KRK_VAL_OBJECT:
-					switch (AS_OBJECT(*val)->type) {
-						case KRK_OBJ_STRING:
-							WRITE_STRING(AS_STRING(*val));
-							break;
-						case KRK_OBJ_BYTES:
-							WRITE_BYTES(AS_BYTES(*val));
-							break;
-						case KRK_OBJ_CODEOBJECT:
-							WRITE_FUNCTION(AS_codeobject(*val));
-							break;
-						default:
-							fprintf(stderr,
-								"Invalid object found in constants table,"
-								"this marashal format can not store '%s'\n",
-								krk_typeName(*val));
-							return 1;
-					}
-					break;
-				case KRK_VAL_KWARGS: /* This should always be KWARGS_VAL(0) */
-					WRITE_KWARGS(AS_INTEGER(*val));
-					break;
-				case KRK_VAL_INTEGER:
-					WRITE_INTEGER(AS_INTEGER(*val));
-					break;
-				default:
-					if (IS_FLOATING(*val)) {
-						WRITE_FLOATING(AS_FLOATING(*val));
-						break;
-					}
-					fprintf(stderr,
-						"Invalid value found in constants table,"
-						"this marashal format can not store '%s'\n",
-						krk_typeName(*val));
-					return 1;
-			}
+			if (_writeValue(out, func->chunk.constants.values[i])) return 1;
 		}
 	}
 
@@ -427,6 +460,17 @@ static KrkValue valueFromConstant(int i, FILE * inFile) {
 			DEBUGOUT("float %g\n", val);
 			return FLOATING_VAL(val);
 		}
+		case 'b':
+		case 'B': {
+			uint32_t len = (c == 'b') ? fgetc(inFile) : 0;
+			if (c == 'B') assert(fread(&len, 1, sizeof(uint32_t), inFile) == sizeof(uint32_t));
+			uint8_t * data = malloc(len ? len : 1);
+			assert(fread(data, 1, len, inFile) == len);
+			DEBUGOUT("bytes of %lu\n", (unsigned long)len);
+			KrkBytes * bytes = krk_newBytes(len, data);
+			free(data);
+			return OBJECT_VAL(bytes);
+		}
 		case 'f':
 		case 'F': {
 			uint32_t ind = (c == 'f') ? fgetc(inFile) : 0;
@@ -437,6 +481,18 @@ static KrkValue valueFromConstant(int i, FILE * inFile) {
 		case 'k': {
 			return KWARGS_VAL(0);
 		}
+		case 't':
+		case 'T': {
+			uint32_t len = (c == 't') ? fgetc(inFile) : 0;
+			if (c == 'T') assert(fread(&len, 1, sizeof(uint32_t), inFile) == sizeof(uint32_t));
+			DEBUGOUT("tuple of %lu\n", (unsigned long)len);
+			KrkTuple * tuple = krk_newTuple(len);
+			krk_push(OBJECT_VAL(tuple));
+			for (size_t j = 0; j < len; ++j) {
+				tuple->values.values[tuple->values.count++] = valueFromConstant(j, inFile);
+			}
+			return krk_pop();
+		}
 		default: {
 			fprintf(stderr, "Unknown type '%c'.\n", c);
 			return NONE_VAL();